@@ -0,0 +1,538 @@
+#include "FTPChecksum.h"
+
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define FTP_CHECKSUM_HARDWARE_CRC32C 1
+#endif
+
+namespace {
+
+// 按字节查表的slicing-by-8表，table[0]为普通的单字节表
+struct CrcTable {
+    uint32_t table[8][256];
+
+    explicit CrcTable(uint32_t polynomial)
+    {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int k = 0; k < 8; ++k) {
+                crc = (crc & 1) ? (crc >> 1) ^ polynomial : crc >> 1;
+            }
+            table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int s = 1; s < 8; ++s) {
+                table[s][i] = (table[s - 1][i] >> 8) ^ table[0][table[s - 1][i] & 0xff];
+            }
+        }
+    }
+};
+
+const CrcTable crc32Table(0xEDB88320u);
+const CrcTable crc32cTable(0x82F63B78u);
+
+#if defined(FTP_CHECKSUM_HARDWARE_CRC32C)
+const bool hasHardwareCrc32c = __builtin_cpu_supports("sse4.2");
+#endif
+
+const uint32_t md5K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+const int md5Shift[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+const uint32_t sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint64_t xxhPrime1 = 0x9E3779B185EBCA87ULL;
+const uint64_t xxhPrime2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t xxhPrime3 = 0x165667B19E3779F9ULL;
+const uint64_t xxhPrime4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t xxhPrime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint32_t rotl32(uint32_t x, int n) { return (x << n) | (x >> (32 - n)); }
+inline uint32_t rotr32(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+inline uint64_t rotl64(uint64_t x, int n) { return (x << n) | (x >> (64 - n)); }
+
+inline uint32_t load32le(const uint8_t* p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline uint64_t load64le(const uint8_t* p)
+{
+    return (uint64_t)load32le(p) | ((uint64_t)load32le(p + 4) << 32);
+}
+
+inline uint32_t load32be(const uint8_t* p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+inline uint64_t xxhRound(uint64_t acc, uint64_t input)
+{
+    acc += input * xxhPrime2;
+    acc = rotl64(acc, 31);
+    return acc * xxhPrime1;
+}
+
+inline uint64_t xxhMerge(uint64_t acc, uint64_t value)
+{
+    acc ^= xxhRound(0, value);
+    return acc * xxhPrime1 + xxhPrime4;
+}
+
+/**
+ * @brief 按64字节分块的哈希（MD5、SHA-256）共用的累计过程
+ */
+template<typename State, typename Block>
+void blockUpdate(State& state, const uint8_t* data, size_t size, Block block)
+{
+    state.length += size;
+
+    if (state.used > 0) {
+        size_t n = std::min(size, sizeof(state.block) - state.used);
+        memcpy(state.block + state.used, data, n);
+        state.used += n;
+        data += n;
+        size -= n;
+        if (state.used < sizeof(state.block)) {
+            return;
+        }
+        block(state.h, state.block);
+        state.used = 0;
+    }
+
+    while (size >= sizeof(state.block)) {
+        block(state.h, data);
+        data += sizeof(state.block);
+        size -= sizeof(state.block);
+    }
+
+    memcpy(state.block, data, size);
+    state.used = size;
+}
+
+/**
+ * @brief MD5和SHA-256的结尾填充：0x80、补零、64位比特长度
+ */
+template<typename State, typename Block>
+void blockFinish(State& state, bool bigEndian, Block block)
+{
+    uint64_t bits = state.length * 8;
+
+    uint8_t padding[72];
+    size_t padSize = (state.used < 56) ? 56 - state.used : 120 - state.used;
+    memset(padding, 0, sizeof(padding));
+    padding[0] = 0x80;
+    for (int i = 0; i < 8; ++i) {
+        padding[padSize + i] = bigEndian ? (uint8_t)(bits >> (56 - 8 * i)) : (uint8_t)(bits >> (8 * i));
+    }
+
+    uint64_t length = state.length;
+    blockUpdate(state, padding, padSize + 8, block);
+    state.length = length;
+}
+
+std::string toHex(const uint8_t* bytes, size_t size)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string text(size * 2, '0');
+    for (size_t i = 0; i < size; ++i) {
+        text[2 * i] = digits[bytes[i] >> 4];
+        text[2 * i + 1] = digits[bytes[i] & 0x0f];
+    }
+    return text;
+}
+
+}  // namespace
+
+FTPChecksum::FTPChecksum(Algorithm algorithm)
+    : algorithm_(algorithm)
+{
+    reset();
+}
+
+void FTPChecksum::reset()
+{
+    crc_ = 0xFFFFFFFFu;
+
+    static const uint32_t md5Init[4] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 };
+    memcpy(md5_.h, md5Init, sizeof(md5Init));
+    md5_.used = 0;
+    md5_.length = 0;
+
+    static const uint32_t sha256Init[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(sha256_.h, sha256Init, sizeof(sha256Init));
+    sha256_.used = 0;
+    sha256_.length = 0;
+
+    xxh64_.v[0] = xxhPrime1 + xxhPrime2;
+    xxh64_.v[1] = xxhPrime2;
+    xxh64_.v[2] = 0;
+    xxh64_.v[3] = 0 - xxhPrime1;
+    xxh64_.used = 0;
+    xxh64_.length = 0;
+}
+
+void FTPChecksum::update(const void* data, size_t size)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+    switch (algorithm_) {
+    case CRC32:
+        crc_ = crc32(crc_, bytes, size, crc32Table.table);
+        break;
+    case CRC32C:
+#if defined(FTP_CHECKSUM_HARDWARE_CRC32C)
+        if (hasHardwareCrc32c) {
+            crc_ = crc32cHardware(crc_, bytes, size);
+            break;
+        }
+#endif
+        crc_ = crc32(crc_, bytes, size, crc32cTable.table);
+        break;
+    case MD5:
+        blockUpdate(md5_, bytes, size, md5Block);
+        break;
+    case SHA256:
+        blockUpdate(sha256_, bytes, size, sha256Block);
+        break;
+    case XXH64: {
+        xxh64_.length += size;
+        if (xxh64_.used > 0) {
+            size_t n = std::min(size, sizeof(xxh64_.block) - xxh64_.used);
+            memcpy(xxh64_.block + xxh64_.used, bytes, n);
+            xxh64_.used += n;
+            bytes += n;
+            size -= n;
+            if (xxh64_.used < sizeof(xxh64_.block)) {
+                break;
+            }
+            xxh64Block(xxh64_.v, xxh64_.block);
+            xxh64_.used = 0;
+        }
+        while (size >= sizeof(xxh64_.block)) {
+            xxh64Block(xxh64_.v, bytes);
+            bytes += sizeof(xxh64_.block);
+            size -= sizeof(xxh64_.block);
+        }
+        memcpy(xxh64_.block, bytes, size);
+        xxh64_.used = size;
+        break;
+    }
+    case None:
+        break;
+    }
+}
+
+std::string FTPChecksum::hex() const
+{
+    switch (algorithm_) {
+    case CRC32:
+    case CRC32C: {
+        char text[9];
+        snprintf(text, sizeof(text), "%08x", (unsigned)~crc_);
+        return text;
+    }
+    case MD5: {
+        Md5State state = md5_;
+        blockFinish(state, false, md5Block);
+        uint8_t digest[16];
+        for (int i = 0; i < 4; ++i) {
+            for (int k = 0; k < 4; ++k) {
+                digest[4 * i + k] = (uint8_t)(state.h[i] >> (8 * k));
+            }
+        }
+        return toHex(digest, sizeof(digest));
+    }
+    case SHA256: {
+        Sha256State state = sha256_;
+        blockFinish(state, true, sha256Block);
+        uint8_t digest[32];
+        for (int i = 0; i < 8; ++i) {
+            for (int k = 0; k < 4; ++k) {
+                digest[4 * i + k] = (uint8_t)(state.h[i] >> (24 - 8 * k));
+            }
+        }
+        return toHex(digest, sizeof(digest));
+    }
+    case XXH64: {
+        const uint64_t* v = xxh64_.v;
+        uint64_t h;
+        if (xxh64_.length >= 32) {
+            h = rotl64(v[0], 1) + rotl64(v[1], 7) + rotl64(v[2], 12) + rotl64(v[3], 18);
+            for (int i = 0; i < 4; ++i) {
+                h = xxhMerge(h, v[i]);
+            }
+        } else {
+            h = xxhPrime5;
+        }
+        h += xxh64_.length;
+
+        const uint8_t* p = xxh64_.block;
+        size_t remaining = xxh64_.used;
+        while (remaining >= 8) {
+            h ^= xxhRound(0, load64le(p));
+            h = rotl64(h, 27) * xxhPrime1 + xxhPrime4;
+            p += 8;
+            remaining -= 8;
+        }
+        if (remaining >= 4) {
+            h ^= (uint64_t)load32le(p) * xxhPrime1;
+            h = rotl64(h, 23) * xxhPrime2 + xxhPrime3;
+            p += 4;
+            remaining -= 4;
+        }
+        while (remaining > 0) {
+            h ^= (*p) * xxhPrime5;
+            h = rotl64(h, 11) * xxhPrime1;
+            ++p;
+            --remaining;
+        }
+
+        h ^= h >> 33;
+        h *= xxhPrime2;
+        h ^= h >> 29;
+        h *= xxhPrime3;
+        h ^= h >> 32;
+
+        char text[17];
+        snprintf(text, sizeof(text), "%016llx", (unsigned long long)h);
+        return text;
+    }
+    case None:
+        break;
+    }
+    return std::string();
+}
+
+bool FTPChecksum::updateFromFile(const std::string& path, curl_off_t length)
+{
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::vector<char> buffer(1024 * 1024);
+    curl_off_t remaining = length;
+    while (length < 0 || remaining > 0) {
+        size_t want = buffer.size();
+        if (length >= 0 && remaining < (curl_off_t)want) {
+            want = (size_t)remaining;
+        }
+        file.read(buffer.data(), want);
+        size_t got = (size_t)file.gcount();
+        if (got == 0) {
+            break;
+        }
+        update(buffer.data(), got);
+        remaining -= got;
+    }
+
+    return length < 0 ? !file.bad() : remaining == 0;
+}
+
+const char* FTPChecksum::name(Algorithm algorithm)
+{
+    switch (algorithm) {
+    case CRC32:  return "CRC32";
+    case CRC32C: return "CRC32C";
+    case XXH64:  return "XXH64";
+    case MD5:    return "MD5";
+    case SHA256: return "SHA-256";
+    case None:   break;
+    }
+    return "";
+}
+
+bool FTPChecksum::equals(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size() || a.empty()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        char x = (a[i] >= 'A' && a[i] <= 'Z') ? a[i] - 'A' + 'a' : a[i];
+        char y = (b[i] >= 'A' && b[i] <= 'Z') ? b[i] - 'A' + 'a' : b[i];
+        if (x != y) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FTPChecksum::isDigest(Algorithm algorithm, std::string_view text)
+{
+    size_t digits = 0;
+    switch (algorithm) {
+    case CRC32:
+    case CRC32C: digits = 8;  break;
+    case XXH64:  digits = 16; break;
+    case MD5:    digits = 32; break;
+    case SHA256: digits = 64; break;
+    case None:   return false;
+    }
+
+    if (text.size() != digits) {
+        return false;
+    }
+    for (char c : text) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t FTPChecksum::crc32(uint32_t crc, const uint8_t* data, size_t size, const uint32_t (*table)[256])
+{
+    while (size >= 8) {
+        uint32_t one = load32le(data) ^ crc;
+        uint32_t two = load32le(data + 4);
+        crc = table[7][one & 0xff] ^ table[6][(one >> 8) & 0xff] ^ table[5][(one >> 16) & 0xff] ^ table[4][one >> 24] ^
+              table[3][two & 0xff] ^ table[2][(two >> 8) & 0xff] ^ table[1][(two >> 16) & 0xff] ^ table[0][two >> 24];
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = (crc >> 8) ^ table[0][(crc ^ *data++) & 0xff];
+    }
+    return crc;
+}
+
+#if defined(FTP_CHECKSUM_HARDWARE_CRC32C)
+__attribute__((target("sse4.2")))
+uint32_t FTPChecksum::crc32cHardware(uint32_t crc, const uint8_t* data, size_t size)
+{
+    uint64_t crc64 = crc;
+    while (size >= 8) {
+        uint64_t value;
+        memcpy(&value, data, sizeof(value));
+        crc64 = _mm_crc32_u64(crc64, value);
+        data += 8;
+        size -= 8;
+    }
+    crc = (uint32_t)crc64;
+    while (size-- > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#else
+uint32_t FTPChecksum::crc32cHardware(uint32_t crc, const uint8_t* data, size_t size)
+{
+    return crc32(crc, data, size, crc32cTable.table);
+}
+#endif
+
+void FTPChecksum::md5Block(uint32_t* h, const uint8_t* block)
+{
+    uint32_t m[16];
+    for (int i = 0; i < 16; ++i) {
+        m[i] = load32le(block + 4 * i);
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+    for (int i = 0; i < 64; ++i) {
+        uint32_t f;
+        int g;
+        if (i < 16) {
+            f = (b & c) | (~b & d);
+            g = i;
+        } else if (i < 32) {
+            f = (d & b) | (~d & c);
+            g = (5 * i + 1) % 16;
+        } else if (i < 48) {
+            f = b ^ c ^ d;
+            g = (3 * i + 5) % 16;
+        } else {
+            f = c ^ (b | ~d);
+            g = (7 * i) % 16;
+        }
+        f += a + md5K[i] + m[g];
+        a = d;
+        d = c;
+        c = b;
+        b += rotl32(f, md5Shift[i]);
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+}
+
+void FTPChecksum::sha256Block(uint32_t* h, const uint8_t* block)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = load32be(block + 4 * i);
+    }
+    for (int i = 16; i < 64; ++i) {
+        uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+    for (int i = 0; i < 64; ++i) {
+        uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = k + s1 + ch + sha256K[i] + w[i];
+        uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = s0 + maj;
+        k = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+    h[5] += f;
+    h[6] += g;
+    h[7] += k;
+}
+
+void FTPChecksum::xxh64Block(uint64_t* v, const uint8_t* block)
+{
+    for (int i = 0; i < 4; ++i) {
+        v[i] = xxhRound(v[i], load64le(block + 8 * i));
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef FTPCHECKSUM_H
+#define FTPCHECKSUM_H
+
+#include <string>
+#include <string_view>
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <curl/curl.h>
+
+/**
+ * @brief 流式校验和计算
+ *
+ * 在读写回调中随数据逐块调用update，传输结束时即得到校验和，不需要再读一遍文件。
+ * CRC32、MD5和SHA-256可以与服务器的HASH/XCRC/XMD5命令比较；CRC32C和XXH64速度更快，
+ * 但服务器一般不支持，只能与校验文件比较。结果统一为小写十六进制文本。
+ */
+class FTPChecksum
+{
+public:
+    enum Algorithm {
+        None,
+        CRC32,      // IEEE 802.3，与XCRC和HASH CRC32一致
+        CRC32C,     // Castagnoli，x86-64上使用SSE4.2指令
+        XXH64,      // xxHash 64位，种子为0，按xxhsum的大端文本输出
+        MD5,        // 与XMD5和HASH MD5一致
+        SHA256      // 与HASH SHA-256一致
+    };
+
+public:
+    explicit FTPChecksum(Algorithm algorithm);
+
+    Algorithm algorithm() const { return algorithm_; }
+
+    /**
+     * @brief 清除已累计的数据
+     */
+    void reset();
+
+    /**
+     * @brief 累计一块数据
+     * @param data 数据
+     * @param size 字节数
+     */
+    void update(const void* data, size_t size);
+
+    /**
+     * @brief 获取当前已累计数据的校验和，不影响继续累计
+     * @return 小写十六进制文本
+     */
+    std::string hex() const;
+
+    /**
+     * @brief 累计本地文件开头的一部分，用于续传时补上已存在的部分
+     * @param path 本地文件路径
+     * @param length 字节数，为-1时读取整个文件
+     * @return 读取成功且长度足够时返回true
+     */
+    bool updateFromFile(const std::string& path, curl_off_t length);
+
+    /**
+     * @brief 算法在HASH命令中的名称，如 "SHA-256"
+     */
+    static const char* name(Algorithm algorithm);
+
+    /**
+     * @brief 比较两个十六进制校验和，忽略大小写
+     */
+    static bool equals(std::string_view a, std::string_view b);
+
+    /**
+     * @brief 判断文本是否为该算法的十六进制校验和（位数正确且只含十六进制字符），用于识别服务器回复和校验文件的内容
+     */
+    static bool isDigest(Algorithm algorithm, std::string_view text);
+
+private:
+    struct Md5State {
+        uint32_t h[4];
+        uint8_t block[64];
+        size_t used;
+        uint64_t length;
+    };
+
+    struct Sha256State {
+        uint32_t h[8];
+        uint8_t block[64];
+        size_t used;
+        uint64_t length;
+    };
+
+    struct Xxh64State {
+        uint64_t v[4];
+        uint8_t block[32];
+        size_t used;
+        uint64_t length;
+    };
+
+    static uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size, const uint32_t (*table)[256]);
+    static uint32_t crc32cHardware(uint32_t crc, const uint8_t* data, size_t size);
+
+    static void md5Block(uint32_t* h, const uint8_t* block);
+    static void sha256Block(uint32_t* h, const uint8_t* block);
+    static void xxh64Block(uint64_t* v, const uint8_t* block);
+
+private:
+    Algorithm algorithm_;
+    uint32_t crc_;
+    Md5State md5_;
+    Sha256State sha256_;
+    Xxh64State xxh64_;
+};
+
+#endif  // FTPCHECKSUM_H
@@ -1,67 +1,195 @@
 #include "FTPClient.h"
 
 #include <future>
+#include <thread>
+#include <algorithm>
 #include <ctime>
+#include <cstring>
 #include <iterator>
-#include <experimental/filesystem>
+#include <memory>
 
 #if defined(_WIN32)
 #include <windows.h>
 #elif defined(__linux__) || defined(__APPLE__)
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 FTPClient::FTPClient(const std::string& host, const std::string& username, const std::string& password)
     : host_(host),
       username_(username),
-      password_(password)
+      password_(password),
+      maxConcurrentTransfers_(8),
+      adaptiveConcurrency_(false),
+      adaptiveMinTransfers_(1),
+      adaptiveMaxTransfers_(64),
+      schedulingPolicy_(FTPTransferEngine::Fifo),
+      smallFileLimit_(-1),
+      reservedSmallSlots_(0),
+      receiveBufferSize_(0),
+      sendBufferSize_(512 * 1024),
+      mlsdUnsupported_(false),
+      checksumAlgorithm_(FTPChecksum::None),
+      hashCommandUnsupported_(false),
+      legacyChecksumUnsupported_(false),
+      partialSuffix_(".part"),
+      retryPolicy_(3, std::chrono::milliseconds(1000), std::chrono::milliseconds(30000)),
+      creatingDirectories_(false)
 {
     curl_global_init(CURL_GLOBAL_ALL);
 
+    enableDeleteAfterDownload_ = false;
 
+    connectionPool_ = FTPConnectionPool::shared(host_, username_, password_);
+
+    // 所有传输都经过进度回调，在其中按主机和全局带宽上限设置句柄的速率上限
+    progress_.setThrottle(throttleCallback, connectionPool_->trafficHost().get());
+
+    batchMetricsBaseline_ = metrics_.snapshot();
 }
 
 FTPClient::~FTPClient()
 {
+    // 引擎和连接池中的句柄须在 curl_global_cleanup 之前释放，删除队列先处理完剩余的文件
+    deleteQueue_.reset();
+    transferEngine_.reset();
+    connectionPool_.reset();
     curl_global_cleanup();
 }
 
-size_t FTPClient::writeCallback(void* contents, size_t size, size_t nmemb, std::ofstream* file)
+void FTPClient::setConnectionPoolOptions(size_t maxSize, int idleTimeoutSeconds)
 {
-    size_t dataSize = size * nmemb;
-    file->write((char*)contents, dataSize);
-    return dataSize;
+    connectionPool_->setMaxSize(maxSize);
+    connectionPool_->setIdleTimeout(std::chrono::seconds(idleTimeoutSeconds));
 }
 
-size_t FTPClient::readCallback(void* buffer, size_t size, size_t nmemb, std::ifstream* file)
+void FTPClient::setGlobalBandwidthLimit(curl_off_t bytesPerSecond)
 {
-    file->read((char*)buffer, size * nmemb);
-    return file->gcount();
+    FTPTrafficControl::globalBandwidth().setRate(bytesPerSecond);
 }
 
-bool FTPClient::resumeEnabled(CURL* curl, const std::string& remoteFilePath)
+void FTPClient::setHostBandwidthLimit(curl_off_t bytesPerSecond)
+{
+    connectionPool_->trafficHost()->bandwidth().setRate(bytesPerSecond);
+}
+
+void FTPClient::setHostConnectionLimit(size_t maxConnections)
 {
-    std::stringstream command;
-    command << "SIZE " << remoteFilePath;
+    connectionPool_->trafficHost()->setConnectionLimit(maxConnections);
+}
+
+curl_off_t FTPClient::throttleCallback(void* context, FTPProgressTracker::ThrottleEvent event)
+{
+    FTPTrafficControl::Host* host = static_cast<FTPTrafficControl::Host*>(context);
+    switch (event) {
+    case FTPProgressTracker::TransferBegin:
+        host->beginTransfer();
+        break;
+    case FTPProgressTracker::TransferEnd:
+        host->endTransfer();
+        return 0;
+    default:
+        break;
+    }
+    return host->transferRate();
+}
 
-    curl_easy_setopt(curl, CURLOPT_URL, ("ftp://" + host_).c_str());
-    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, command.str().c_str());
+void FTPClient::setLocalWriteOptions(size_t bufferSize, bool preallocate, bool directIO)
+{
+    sinkOptions_.bufferSize = bufferSize;
+    sinkOptions_.preallocate = preallocate;
+    sinkOptions_.directIO = directIO;
+}
 
-    curl_easy_perform(curl);
+void FTPClient::setReceiveBufferSize(long bytes)
+{
+    receiveBufferSize_ = bytes;
+}
 
+void FTPClient::setSendBufferSize(long bytes)
+{
+    sendBufferSize_ = bytes;
+}
 
-    // 清理设置的选项
-    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, NULL);
+void FTPClient::setChecksumVerification(FTPChecksum::Algorithm algorithm, const std::string& sidecarSuffix)
+{
+    checksumAlgorithm_ = algorithm;
+    checksumSuffix_ = sidecarSuffix;
+    // 服务器是否支持与算法有关，更换算法后重新尝试
+    hashCommandUnsupported_ = false;
+    legacyChecksumUnsupported_ = false;
+}
 
-    long responseCode;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+void FTPClient::setDeleteCallback(DeleteCallback callback)
+{
+    deleteCallback_ = callback;
+}
 
-    if (responseCode == 213) {
-        return true;
+size_t FTPClient::writeCallback(void* contents, size_t size, size_t nmemb, DownloadTask* task)
+{
+    size_t dataSize = size * nmemb;
+
+    // 收到数据时SIZE已经返回，续传时得到的是剩余部分的大小
+    if (!task->reserved) {
+        task->reserved = true;
+        curl_off_t remaining = -1;
+        if (curl_easy_getinfo(task->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &remaining) == CURLE_OK && remaining > 0) {
+            task->file->reserve(task->file->position() + remaining);
+        }
     }
 
-    return false;
+    if (task->checksum) {
+        task->checksum->update(contents, dataSize);
+    }
+
+    if (!task->file->write((const char*)contents, dataSize)) {
+        return 0;
+    }
+    return dataSize;
+}
+
+size_t FTPClient::uploadReadCallback(char* buffer, size_t size, size_t nitems, UploadTask* task)
+{
+    size_t count = task->file->read(buffer, size * nitems);
+    if (count == CURL_READFUNC_ABORT || count == CURL_READFUNC_PAUSE) {
+        return count;
+    }
+
+    // libcurl回退后重新读取的部分已经累计过
+    curl_off_t end = task->position + (curl_off_t)count;
+    if (task->checksum && end > task->hashed) {
+        curl_off_t skip = task->hashed > task->position ? task->hashed - task->position : 0;
+        task->checksum->update(buffer + skip, (size_t)(end - task->position - skip));
+        task->hashed = end;
+    }
+    task->position = end;
+    return count;
+}
+
+int FTPClient::uploadSeekCallback(UploadTask* task, curl_off_t offset, int origin)
+{
+    int result = FTPFileSource::seekCallback(task->file.get(), offset, origin);
+    if (result == CURL_SEEKFUNC_OK) {
+        task->position = offset;
+        // 跳过了未累计的数据，无法再得到完整的校验和
+        if (offset > task->hashed) {
+            task->checksum.reset();
+        }
+    }
+    return result;
+}
+
+bool FTPClient::resumeEnabled(CURL* curl, const std::string& remoteFilePath)
+{
+    RemoteFileStat stat;
+    if (!probeRemoteFile(curl, remoteFilePath, stat)) {
+        return false;
+    }
+
+    // 续传需要服务器同时支持SIZE和REST
+    return stat.resumable && stat.fileSize >= 0;
 }
 
 off_t FTPClient::getLocalFileSize(const std::string& localFilePath)
@@ -81,430 +209,1885 @@ off_t FTPClient::getLocalFileSize(const std::string& localFilePath)
 
 off_t FTPClient::getRemoteFileSize(CURL* curl, const std::string& remoteFilePath)
 {
-    // 设置远程路径和URL
-    std::stringstream str;
-    curl_easy_setopt(curl, CURLOPT_URL, ("ftp://" + host_ + remoteFilePath).c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, copyDataSizeCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &str);
-    curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
-    CURLcode result = curl_easy_perform(curl);
-
-    curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, NULL);
-
-    if (result == CURLE_OK) {
-        double fileSize;
-        curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &fileSize);
-        return static_cast<off_t>(fileSize);
-    } else {
-        std::cerr << "Failed to get remote file size for: " << remoteFilePath << ". Error: " << curl_easy_strerror(result) << std::endl;
+    RemoteFileStat stat;
+    if (!probeRemoteFile(curl, remoteFilePath, stat) || stat.fileSize < 0) {
         return 0;
     }
-}
 
+    return static_cast<off_t>(stat.fileSize);
+}
 
-bool FTPClient::deleteRemoteFile(CURL* curl, const std::string& remoteFilePath)
+bool FTPClient::getRemoteFileStat(const std::string& remoteFilePath, RemoteFileStat& stat)
 {
+    std::string path = remoteFilePath;
+    sanitizePath(path);
+    if (path.empty() || path[0] != '/') {
+        path.insert(0, "/");
+    }
 
-    std::stringstream command;
-    command << "DELE " << remoteFilePath;
+    FTPConnectionPool::Lease lease = connectionPool_->acquire();
+    if (!lease) {
+        stat.exists = false;
+        stat.resumable = false;
+        stat.fileSize = -1;
+        stat.modifyTime = -1;
+        return false;
+    }
 
-    curl_easy_setopt(curl, CURLOPT_URL, ("ftp://" + host_).c_str());
-    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, command.str().c_str());
+    return probeRemoteFile(lease.get(), path, stat);
+}
 
+bool FTPClient::probeRemoteFile(CURL* curl, const std::string& remoteFilePath, RemoteFileStat& stat)
+{
+    prepareRemoteFileStat(curl, remoteFilePath, &stat);
     CURLcode result = curl_easy_perform(curl);
+    clearRemoteFileStat(curl);
 
-    // 清理设置的选项
-    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, NULL);
-
-    if (result != CURLE_OK) {
-        std::cerr << "Failed to delete remote file: " << remoteFilePath << std::endl;
-        return false;
-    }
+    return remoteFileStatResult(curl, result, remoteFilePath, stat);
+}
 
-    return true;
+void FTPClient::clearRemoteFileStat(CURL* curl)
+{
+    // 清理设置的选项，句柄接下来可能用于传输
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+    curl_easy_setopt(curl, CURLOPT_FILETIME, 0L);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, NULL);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, NULL);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, NULL);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, NULL);
 }
 
-bool FTPClient::createLocalFolder(const std::string& localFolderPath)
+bool FTPClient::localFileUpToDate(const std::string& localFilePath, const RemoteFileStat& stat)
 {
-#if defined(_WIN32)
-    std::wstring wFolderPath = std::wstring(localFolderPath.begin(), localFolderPath.end());
-    if (CreateDirectoryW(wFolderPath.c_str(), NULL) || GetLastError() == ERROR_ALREADY_EXISTS) {
-        return true;
-    } else {
-        std::cerr << "Failed to create local folder: " << localFolderPath << std::endl;
+    struct stat st;
+    if (!stat.exists || stat.fileSize < 0 || ::stat(localFilePath.c_str(), &st) != 0) {
         return false;
     }
-#elif defined(__linux__) || defined(__APPLE__)
-    if (mkdir(localFolderPath.c_str(), 0777) == 0 || errno == EEXIST) {
-        return true;
-    } else if (errno == ENOENT) {
-        std::string command = "mkdir -p " + localFolderPath;
-        if (system(command.c_str()) == 0) {
-            return true;
-        }
-    }
-    std::cerr << "Failed to create local folder: " << localFolderPath << std::endl;
-    return false;
-#else
-    // Unsupported platform
-    std::cerr << "Platform not supported." << std::endl;
-    return false;
-#endif
+    // 下载不保留远程的修改时间，本地文件在远程文件最后一次修改之后写入才认为是同一版本
+    return (curl_off_t)st.st_size == stat.fileSize && (stat.modifyTime < 0 || st.st_mtime >= stat.modifyTime);
 }
 
-bool FTPClient::createRemoteDirectory(const std::string &remoteDirectoryPath)
+void FTPClient::prepareRemoteFileStat(CURL* curl, const std::string& remoteFilePath, RemoteFileStat* stat)
+{
+    stat->exists = false;
+    stat->resumable = false;
+    stat->fileSize = -1;
+    stat->modifyTime = -1;
+
+    curl_easy_setopt(curl, CURLOPT_URL, ("ftp://" + host_ + replaceSpacesWithPercent20(remoteFilePath)).c_str());
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_FILETIME, 1L);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, statHeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, stat);
+    // libcurl把生成的头信息同时作为正文写出，不设置写回调时会输出到stdout
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, statHeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, stat);
+}
+
+bool FTPClient::remoteFileStatResult(CURL* curl, CURLcode result, const std::string& remoteFilePath, RemoteFileStat& stat)
 {
-    CURL* curlCreateDir = curl_easy_init();
-    if (!curlCreateDir) {
+    if (result == CURLE_REMOTE_FILE_NOT_FOUND || result == CURLE_REMOTE_ACCESS_DENIED) {
+        // MDTM回复550或无法CWD进入所在目录，文件不存在，上传时从头开始；查询本身已完成，按成功计入耗时统计
+        metrics_.record(FTPTransferMetrics::Command, curl, CURLE_OK);
         return false;
     }
-
-    curl_easy_setopt(curlCreateDir, CURLOPT_URL, ("ftp://" + host_).c_str());
-    curl_easy_setopt(curlCreateDir, CURLOPT_USERNAME, username_.c_str());
-    curl_easy_setopt(curlCreateDir, CURLOPT_PASSWORD, password_.c_str());
-
-    std::string directory;
-    std::string mkdir;
-    std::istringstream iss(remoteDirectoryPath);
-    while (std::getline(iss, directory, '/')) {
-        if (directory.empty()) continue;
-
-        mkdir += "/" + directory;
-        std::stringstream command;
-        command << "MKD " << mkdir;
-
-        curl_easy_setopt(curlCreateDir, CURLOPT_CUSTOMREQUEST, command.str().c_str());
-        curl_easy_perform(curlCreateDir);
-
-        long responseCode;
-        curl_easy_getinfo(curlCreateDir, CURLINFO_RESPONSE_CODE, &responseCode);
-
-        if (responseCode != 257) {
-            curl_easy_cleanup(curlCreateDir);
-            return false;
-        }
+    metrics_.record(FTPTransferMetrics::Command, curl, result);
+    if (result != CURLE_OK) {
+        std::cerr << "Failed to get remote file info for: " << remoteFilePath << ". Error: " << curl_easy_strerror(result) << std::endl;
+        return false;
     }
 
-    curl_easy_cleanup(curlCreateDir);
+    curl_off_t fileSize = -1;
+    curl_off_t fileTime = -1;
+    curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &fileSize);
+    curl_easy_getinfo(curl, CURLINFO_FILETIME_T, &fileTime);
 
+    stat.exists = true;
+    stat.fileSize = fileSize;
+    stat.modifyTime = static_cast<time_t>(fileTime);
     return true;
 }
 
-std::vector<FTPClient::FTPFileInfo> FTPClient::listRemoteFiles(const std::string& remoteFolderPath)
+size_t FTPClient::statHeaderCallback(char* buffer, size_t size, size_t nitems, RemoteFileStat* stat)
 {
-    std::string strcomm = replaceSpacesWithPercent20(remoteFolderPath);
-    strcomm = "/" + strcomm;
-
-    std::vector<FTPFileInfo> fileList;
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        return fileList;
+    // libcurl在REST 0成功时生成 "Accept-ranges: bytes"
+    static const char acceptRanges[] = "Accept-ranges: bytes";
+    size_t length = size * nitems;
+    if (length >= sizeof(acceptRanges) - 1 && strncmp(buffer, acceptRanges, sizeof(acceptRanges) - 1) == 0) {
+        stat->resumable = true;
     }
+    return length;
+}
 
-    curl_easy_setopt(curl, CURLOPT_USERNAME, username_.c_str());
-    curl_easy_setopt(curl, CURLOPT_PASSWORD, password_.c_str());
-//    curl_easy_setopt(curl, CURLOPT_URL, ("ftp://" + host_).c_str());
-    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "LIST");
-
-    curl_easy_setopt(curl, CURLOPT_URL, ("ftp://" + host_ + strcomm).c_str());
-//    curl_easy_setopt(curl, CURLOPT_DIRLISTONLY, 1L);
-
-    std::stringstream responseStream;
-
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeToStringStreamCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &responseStream);
-
+bool FTPClient::deleteRemoteFile(CURL* curl, const std::string& remoteFilePath)
+{
+    curl_slist* commands = prepareDeleteRemoteFile(curl, remoteFilePath);
     CURLcode result = curl_easy_perform(curl);
+    invalidateListing(remoteFilePath);
 
     // 清理设置的选项
-    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, NULL);
-    curl_easy_cleanup(curl);
-
-    if (result == CURLE_OK) {
-        std::string file;
-        while (std::getline(responseStream, file)) {
-            std::istringstream iss(file);
-            std::vector<std::string> tokens{
-                std::istream_iterator<std::string>{iss},
-                std::istream_iterator<std::string>{}
-            };
-
-            std::string fileOrDirectoryName;
-            // 从第8项开始遍历并连接字符串
-            for (size_t i = 8; i < tokens.size(); ++i) {
-                fileOrDirectoryName += (fileOrDirectoryName.empty() ? "" : " ") + tokens[i];
-            }
+    curl_easy_setopt(curl, CURLOPT_QUOTE, NULL);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+    curl_slist_free_all(commands);
 
-            if (tokens.size() >= 9 && tokens[0][0] == 'd') {
-                // 是目录
-                if(tokens[8] != "." && tokens[8] != "..")
-                {
-                    const auto& subFileList = listRemoteFiles(remoteFolderPath + fileOrDirectoryName + "/");
-                    fileList.insert(fileList.end(), subFileList.begin(), subFileList.end());
-                }
-            }else if(tokens.size() >= 9 && tokens[0][0] == '-'){
-                FTPFileInfo file;
-                file.permissions = tokens[0];
-                file.userName = tokens[2];
-                file.userGroup = tokens[3];
-                file.fileSize = std::stol(tokens[4]);
-                file.date = tokens[5] + "-" + tokens[6] + " " + tokens[7];
-                file.path = "/" + remoteFolderPath;
-                file.fileName = fileOrDirectoryName;
-                fileList.push_back(file);
-            }
-        }
-    } else {
-        std::cerr << "Failed to list remote files: " << remoteFolderPath << std::endl;
+    if (result != CURLE_OK) {
+        std::cerr << "Failed to delete remote file: " << remoteFilePath << std::endl;
+        return false;
     }
 
-    return fileList;
+    return true;
 }
 
-std::vector<std::string> FTPClient::listLocalFiles(const std::string &localFolderPath)
+curl_slist* FTPClient::prepareDeleteRemoteFile(CURL* curl, const std::string& remoteFilePath)
 {
-    std::vector<std::string> fileList;
-    // 遍历文件夹内的文件和子文件夹
-    for (const auto& entry : std::experimental::filesystem::directory_iterator(localFolderPath))
-    {
-        std::experimental::filesystem::file_status status = entry.status();
-        if (std::experimental::filesystem::is_directory(status)) {
-            const auto& subFileList = listLocalFiles(entry.path().string());
-            fileList.insert(fileList.end(), subFileList.begin(), subFileList.end());
-        } else if (std::experimental::filesystem::is_regular_file(status)) {
-            fileList.push_back(entry.path().string());
-        }
-    }
-    return fileList;
-}
+    // 通过QUOTE在控制连接上发送DELE，NOBODY使libcurl不再打开数据连接
+    curl_slist* commands = curl_slist_append(NULL, ("DELE " + remoteFilePath).c_str());
 
-std::map<int, FTPClient::FileTransferInfo> *FTPClient::getFileTransferInfoAddr()
-{
-    std::cout << &taskProgress << std::endl;
-    return &taskProgress;
-}
+    curl_easy_setopt(curl, CURLOPT_URL, ("ftp://" + host_ + "/").c_str());
+    curl_easy_setopt(curl, CURLOPT_QUOTE, commands);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)0);
+    curl_easy_setopt(curl, CURLOPT_UPLOAD, 0L);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
 
-size_t FTPClient::writeToStringStreamCallback(void* contents, size_t size, size_t nmemb, std::stringstream* stream)
-{
-    size_t dataSize = size * nmemb;
-    stream->write((char*)contents, dataSize);
-    return dataSize;
+    return commands;
 }
 
-size_t FTPClient::copyDataSizeCallback(void *contents, size_t size, size_t nmemb, void *data)
+void FTPClient::initChecksumQuery(ChecksumQuery& query, const std::string& remoteFilePath, bool allowSidecar)
 {
-    return size * nmemb;
+    query.remotePath = remoteFilePath;
+    query.allowSidecar = allowSidecar;
+    query.commands = NULL;
+    query.response.clear();
+    query.value.clear();
+    query.source = nextChecksumSource(query, HashCommand);
 }
 
-int FTPClient::progressCallback(void *p, double dltotal, double dlnow, double ultotal, double ulnow)
+FTPClient::ChecksumSource FTPClient::nextChecksumSource(const ChecksumQuery& query, ChecksumSource from)
 {
-    if (p == NULL) {
-        std::cerr << "Error: p is null." << std::endl;
-        return -1;
-    }
+    // HASH支持的算法中只取CRC32、MD5和SHA-256，XCRC/XMD5只对应其中两种
+    bool hashAlgorithm = checksumAlgorithm_ == FTPChecksum::CRC32 || checksumAlgorithm_ == FTPChecksum::MD5 ||
+                         checksumAlgorithm_ == FTPChecksum::SHA256;
+    bool legacyAlgorithm = checksumAlgorithm_ == FTPChecksum::CRC32 || checksumAlgorithm_ == FTPChecksum::MD5;
 
-    FileTransferInfo* fileInfo = static_cast<FileTransferInfo*>(p);
-    switch (fileInfo->transferType) {
-    case Download:{
-        fileInfo->totalSize = (long)dltotal;
-        fileInfo->transferredSize = (long)dlnow;
-        fileInfo->remainingSize = (long)(dltotal - dlnow);
-        if(dltotal == 0){
-            dlnow = 0;
-            dltotal = 1;
-        }
-        fileInfo->transferProgress = (dlnow / dltotal) * 100;
-        break;
+    if (from <= HashCommand && hashAlgorithm && !hashCommandUnsupported_) {
+        return HashCommand;
     }
-    case Upload:{
-//        fileInfo->totalSize = (long)ultotal;
-        fileInfo->transferredSize = (long)ulnow;
-        fileInfo->remainingSize = (long)(fileInfo->totalSize - ulnow);
-
-        fileInfo->transferProgress = (ulnow / (double)fileInfo->totalSize) * 100;
-        break;
+    if (from <= LegacyCommand && legacyAlgorithm && !legacyChecksumUnsupported_) {
+        return LegacyCommand;
     }
-    default:
-        break;
+    if (from <= SidecarFile && query.allowSidecar && !checksumSuffix_.empty()) {
+        return SidecarFile;
     }
-
-//    std::cout << "process: " << fileInfo->transferProgress << "%" << fileInfo->filename << std::endl;
-
-    return 0;
+    return NoChecksumSource;
 }
 
-void FTPClient::recordDownloadedFile(const std::string& localFilePath)
+void FTPClient::prepareChecksumQuery(CURL* curl, ChecksumQuery& query)
 {
+    query.response.clear();
+    query.commands = NULL;
 
-    std::ofstream recordFile("downloaded_files.txt", std::ios::app);
-    recordFile << localFilePath << std::endl;
-    recordFile.close();
-}
+    if (query.source == SidecarFile) {
+        curl_easy_setopt(curl, CURLOPT_URL, ("ftp://" + host_ + replaceSpacesWithPercent20(query.remotePath + checksumSuffix_)).c_str());
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+    } else {
+        if (query.source == HashCommand) {
+            // 不加*前缀，OPTS失败时libcurl不再发送HASH，避免服务器按默认算法白白读一遍文件
+            query.commands = curl_slist_append(NULL, (std::string("OPTS HASH ") + FTPChecksum::name(checksumAlgorithm_)).c_str());
+            query.commands = curl_slist_append(query.commands, ("HASH " + query.remotePath).c_str());
+        } else {
+            const char* command = checksumAlgorithm_ == FTPChecksum::CRC32 ? "XCRC " : "XMD5 ";
+            query.commands = curl_slist_append(NULL, (command + query.remotePath).c_str());
+        }
 
-bool FTPClient::isDownloaded(const std::string& keyword) {
+        // 与删除文件相同，命令在控制连接上发送，服务器的回复由头回调交付
+        curl_easy_setopt(curl, CURLOPT_URL, ("ftp://" + host_ + "/").c_str());
+        curl_easy_setopt(curl, CURLOPT_QUOTE, query.commands);
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, writeToStringCallback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &query.response);
+    }
 
-    return isKeywordMatched("downloaded_files.txt", keyword);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeToStringCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &query.response);
+    curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)0);
+    curl_easy_setopt(curl, CURLOPT_UPLOAD, 0L);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
 }
 
-bool FTPClient::isKeywordMatched(const std::string& filePath, const std::string& keyword)
+bool FTPClient::checksumQueryResult(CURL* curl, ChecksumQuery& query, CURLcode result)
 {
-    if (keyword.empty()) {
-        return false;
-    }
+    metrics_.record(FTPTransferMetrics::Command, curl, result);
 
-    std::ifstream file(filePath);
-    if (!file) {
-        std::cerr << "Failed to open local file: " << filePath << std::endl;
-        return false;
+    long responseCode = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+
+    // 清理设置的选项，句柄接下来可能用于传输
+    curl_easy_setopt(curl, CURLOPT_QUOTE, NULL);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, NULL);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, NULL);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, NULL);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, NULL);
+    curl_slist_free_all(query.commands);
+    query.commands = NULL;
+
+    if (result == CURLE_OK) {
+        query.value = parseChecksumReply(query.response, checksumAlgorithm_, query.source);
     }
 
-    std::string line;
-    while (std::getline(file, line)) {
-        if (line.find(keyword) != std::string::npos) {
-            file.close();
-            return true;
+    if (query.value.empty() && query.source != SidecarFile) {
+        // 命令或算法不被识别，或回复无法解析，之后不再尝试该命令；其他错误（如文件不存在）只影响本文件
+        bool rejected = responseCode == 500 || responseCode == 501 || responseCode == 502 || responseCode == 504;
+        if (result == CURLE_OK || rejected) {
+            if (query.source == HashCommand) {
+                hashCommandUnsupported_ = true;
+            } else {
+                legacyChecksumUnsupported_ = true;
+            }
         }
     }
 
-    file.close();
-    return false;
+    if (!query.value.empty()) {
+        return true;
+    }
+    query.source = nextChecksumSource(query, (ChecksumSource)(query.source + 1));
+    return query.source == NoChecksumSource;
 }
 
-bool FTPClient::fileExists(const std::string &filePath)
+std::string FTPClient::parseChecksumReply(std::string_view response, FTPChecksum::Algorithm algorithm, ChecksumSource source)
 {
-    std::ifstream file(filePath);
-    return file.good();
+    std::string value;
+    FTPListParser::forEachLine(response, [&](std::string_view line) {
+        if (!value.empty()) {
+            return;
+        }
+
+        // 按空白拆分，只需要前四个字段
+        std::string_view fields[4];
+        size_t count = 0;
+        while (count < 4) {
+            size_t begin = line.find_first_not_of(" \t");
+            if (begin == std::string_view::npos) {
+                break;
+            }
+            line.remove_prefix(begin);
+            size_t end = line.find_first_of(" \t");
+            fields[count++] = line.substr(0, end);
+            line.remove_prefix(end == std::string_view::npos ? line.size() : end);
+        }
+
+        std::string_view digest;
+        if (source == HashCommand) {
+            // 213 SHA-256 0-1048575 <校验和> <文件名>
+            if (count == 4 && fields[0] == "213" && FTPChecksum::equals(fields[1], FTPChecksum::name(algorithm))) {
+                digest = fields[3];
+            }
+        } else if (source == LegacyCommand) {
+            // 250 <校验和>
+            if (count >= 2 && (fields[0] == "250" || fields[0] == "200")) {
+                digest = fields[1];
+            }
+        } else if (count >= 1) {
+            // 校验文件的第一个字段为校验和，与sha256sum等工具生成的格式一致
+            digest = fields[0];
+        }
+
+        if (FTPChecksum::isDigest(algorithm, digest)) {
+            value.assign(digest.data(), digest.size());
+        }
+    });
+    return value;
 }
 
-void FTPClient::sanitizePath(std::string &path)
+void FTPClient::fetchRemoteChecksum(CURL* curl, ChecksumQuery& query)
 {
-    std::replace(path.begin(), path.end(), '\\', '/');
-    // 删除路径结尾的 /
-    if (!path.empty() && path.back() == '/') {
-        path.erase(path.length() - 1);
+    while (query.source != NoChecksumSource) {
+        prepareChecksumQuery(curl, query);
+        CURLcode result = curl_easy_perform(curl);
+        if (checksumQueryResult(curl, query, result)) {
+            break;
+        }
     }
 }
 
-// 将URL中空格替换为%20，解决包含空格无法传输问题
-std::string FTPClient::replaceSpacesWithPercent20(const std::string &str)
+void FTPClient::scheduleChecksumQuery(std::shared_ptr<ChecksumQuery> query, std::function<void()> onFinished)
 {
-    std::string result = str;
-    size_t pos = 0;
-    while ((pos = result.find(' ', pos)) != std::string::npos) {
-        result.replace(pos, 1, "%20");
-        pos += 3; // 移过替换的字符
+    if (query->source == NoChecksumSource) {
+        onFinished();
+        return;
     }
 
-    return result;
+    FTPTransferEngine::Job job;
+    job.prepare = [this, query](CURL* curl) {
+        prepareChecksumQuery(curl, *query);
+        return true;
+    };
+    job.complete = [this, query, onFinished](CURL* curl, CURLcode result) {
+        if (curl == NULL) {
+            curl_slist_free_all(query->commands);
+            query->commands = NULL;
+            onFinished();
+            return;
+        }
+        if (checksumQueryResult(curl, *query, result)) {
+            onFinished();
+            return;
+        }
+        // 换用下一个来源
+        scheduleChecksumQuery(query, onFinished);
+    };
+
+    transferEngine().submit(std::move(job));
 }
 
-// 实现下载文件的函数
-FTPClient::FTP_Code FTPClient::downloadFile(const std::string &remoteFilePath, const std::string &localFilePath,
-                                            const std::vector<std::string> &filterKeywords)
+FTPClient::FTP_Code FTPClient::checkDownloadChecksum(DownloadTask& task, const std::string& expected)
 {
-
-    std::string sanitizedRemotePath = remoteFilePath;
-    std::string sanitizedLocalPath = localFilePath;
-
-    sanitizePath(sanitizedRemotePath);
-    sanitizePath(sanitizedLocalPath);
-
-    //  在目标文件开头插入 /
-    if (!sanitizedRemotePath.empty() && sanitizedRemotePath[0] != '/') {
-        sanitizedRemotePath.insert(0, "/");
+    if (expected.empty()) {
+        std::cout << "No remote checksum available, file not verified: " << task.remotePath << std::endl;
+        return FTP_OK;
     }
 
-    // 将本地路径拆分为目录和文件名
-    size_t separatorIndex = sanitizedLocalPath.find_last_of('/');
-    std::string loacalDirectoryPath = sanitizedLocalPath.substr(0, separatorIndex);
-    std::string loacalFileName = sanitizedLocalPath.substr(separatorIndex + 1);
+    std::string actual = task.checksum->hex();
+    if (FTPChecksum::equals(actual, expected)) {
+        return FTP_OK;
+    }
 
-    // 过滤关键词
-    for (const std::string& keyword : filterKeywords) {
-        if (loacalFileName.find(keyword) != std::string::npos) {
-            return FILENAME_CONTAINS_KEYWORD;
-        }
+    std::cerr << "Checksum mismatch for: " << task.remotePath << ". Local: " << actual << ", remote: " << expected << std::endl;
+    // 删除写入的文件，下次不会从错误的内容续传
+    if (!task.inMemory) {
+        remove(task.writePath.c_str());
     }
+    return CHECKSUM_MISMATCH;
+}
 
-    if (!createLocalFolder(loacalDirectoryPath)) {
-        return CREATE_FOLDER_FAILED;
+FTPClient::FTP_Code FTPClient::checkUploadChecksum(UploadTask& task, const std::string& expected)
+{
+    if (expected.empty()) {
+        std::cout << "No remote checksum available, upload not verified: " << task.remotePath << std::endl;
+        return FTP_OK;
     }
 
-    CURL* curl_download = curl_easy_init();
-    if (!curl_download) {
-        return INITIALIZATION_FAILED;
+    std::string actual = task.checksum->hex();
+    if (FTPChecksum::equals(actual, expected)) {
+        return FTP_OK;
     }
 
-    curl_easy_setopt(curl_download, CURLOPT_USERNAME, username_.c_str());
-    curl_easy_setopt(curl_download, CURLOPT_PASSWORD, password_.c_str());
+    std::cerr << "Checksum mismatch for: " << task.remotePath << ". Local: " << actual << ", remote: " << expected << std::endl;
+    return CHECKSUM_MISMATCH;
+}
+
+std::string FTPClient::sidecarContent(const UploadTask& task)
+{
+    size_t separatorIndex = task.remotePath.find_last_of('/');
+    std::string fileName = task.remotePath.substr(separatorIndex + 1);
+    return task.checksum->hex() + "  " + fileName + "\n";
+}
 
-    std::ofstream file;
-    bool isResumeEnabled = resumeEnabled(curl_download, sanitizedRemotePath);
-    if (fileExists(sanitizedLocalPath) && isResumeEnabled) {
-        file.open(sanitizedLocalPath, std::ios::out | std::ios::in  | std::ios::binary); // 断点续传时以追加模式打开文件
-    } else {
-        file.open(sanitizedLocalPath, std::ios::out | std::ios::trunc | std::ios::binary); // 直接下载时重新创建文件
+FTPClient::FTP_Code FTPClient::verifyUpload(CURL* curl, UploadTask& task)
+{
+    ChecksumQuery query;
+    initChecksumQuery(query, task.remotePath, false);
+    fetchRemoteChecksum(curl, query);
+    if (!query.value.empty() || checksumSuffix_.empty()) {
+        return checkUploadChecksum(task, query.value);
     }
 
-    if (!file.is_open()) {
-        curl_easy_cleanup(curl_download);
-        std::cerr << "Failed to open local file: " << sanitizedLocalPath << std::endl;
-        return LOCAL_FILE_OPEN_FAILED;
+    // 服务器不能计算校验和，上传校验文件供下载方校验
+    std::string content = sidecarContent(task);
+    UploadTask sidecar;
+    initUploadTask(sidecar, std::string(), task.remotePath + checksumSuffix_);
+    sidecar.file.reset(new FTPMemorySource(content.data(), content.size()));
+    sidecar.inMemory = true;
+    sidecar.sidecar = true;
+    sidecar.directoryReady = task.directoryReady;
+
+    // 句柄上仍保留着续传上传的偏移量
+    curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)0);
+    FTP_Code res = prepareUpload(curl, sidecar);
+    if (res != FTP_OK) {
+        return res;
     }
+    CURLcode result = curl_easy_perform(curl);
+    return finishUpload(curl, sidecar, result);
+}
 
-    // 定位到文件末尾，准备追加数据
-    file.seekp(0, std::ios::end);
+void FTPClient::scheduleUploadVerification(std::shared_ptr<UploadTask> task, std::function<void(FTP_Code)> onFinished)
+{
+    std::shared_ptr<ChecksumQuery> query = std::make_shared<ChecksumQuery>();
+    initChecksumQuery(*query, task->remotePath, false);
 
-    curl_easy_setopt(curl_download, CURLOPT_URL, ("ftp://" + host_ + replaceSpacesWithPercent20(sanitizedRemotePath)).c_str());
-    curl_easy_setopt(curl_download, CURLOPT_FTP_CREATE_MISSING_DIRS, 1L);
-    curl_easy_setopt(curl_download, CURLOPT_WRITEFUNCTION, writeCallback);
-    curl_easy_setopt(curl_download, CURLOPT_WRITEDATA, &file);
-    curl_easy_setopt(curl_download, CURLOPT_RESUME_FROM, getLocalFileSize(sanitizedLocalPath));
+    scheduleChecksumQuery(query, [this, task, query, onFinished]() {
+        if (!query->value.empty() || checksumSuffix_.empty()) {
+            onFinished(checkUploadChecksum(*task, query->value));
+            return;
+        }
 
-    // 设置CURLOPT_NOPROGRESS为0，以启用进度回调函数
-    // 设置CURLOPT_PROGRESSFUNCTION为progressCallback函数指针，用于获取上传进度
+        std::shared_ptr<std::string> content = std::make_shared<std::string>(sidecarContent(*task));
+        std::shared_ptr<UploadTask> sidecar = std::make_shared<UploadTask>();
+        initUploadTask(*sidecar, std::string(), task->remotePath + checksumSuffix_);
+        sidecar->file.reset(new FTPMemorySource(content->data(), content->size()));
+        sidecar->inMemory = true;
+        sidecar->sidecar = true;
+        sidecar->directoryReady = task->directoryReady;
+
+        // 内容须保持到校验文件上传结束
+        submitUploadTask(sidecar, [content, onFinished](FTP_Code res) {
+            onFinished(res);
+        });
+    });
+}
 
-    long proKey = taskProgress.size();
-    do{
-        std::lock_guard<std::mutex> lock(mutex);
-        proKey = taskProgress.size();
-        taskProgress[proKey] = FileTransferInfo();
-    }while(false);
+bool FTPClient::needsRemoteChecksum(const UploadTask& task)
+{
+    // 大小不同时由大小即可决定，只有大小相同时才需要比较内容
+    return checksumAlgorithm_ != FTPChecksum::None && !task.inMemory && !task.sidecar &&
+           task.remoteSize > 0 && task.remoteSize == getLocalFileSize(task.localPath);
+}
 
-    taskProgress[proKey].filename = sanitizedRemotePath;
-    taskProgress[proKey].transferType = Download;
+bool FTPClient::createLocalFolder(const std::string& localFolderPath)
+{
+#if defined(_WIN32)
+    std::wstring wFolderPath = std::wstring(localFolderPath.begin(), localFolderPath.end());
+    if (CreateDirectoryW(wFolderPath.c_str(), NULL) || GetLastError() == ERROR_ALREADY_EXISTS) {
+        return true;
+    } else {
+        std::cerr << "Failed to create local folder: " << localFolderPath << std::endl;
+        return false;
+    }
+#elif defined(__linux__) || defined(__APPLE__)
+    if (mkdir(localFolderPath.c_str(), 0777) == 0 || errno == EEXIST) {
+        return true;
+    } else if (errno == ENOENT) {
+        std::string command = "mkdir -p " + localFolderPath;
+        if (system(command.c_str()) == 0) {
+            return true;
+        }
+    }
+    std::cerr << "Failed to create local folder: " << localFolderPath << std::endl;
+    return false;
+#else
+    // Unsupported platform
+    std::cerr << "Platform not supported." << std::endl;
+    return false;
+#endif
+}
+
+bool FTPClient::createRemoteDirectory(const std::string &remoteDirectoryPath)
+{
+    std::string directory = remoteDirectoryPath;
+    sanitizePath(directory);
+    if (directory.empty() || directory[0] != '/') {
+        directory.insert(0, "/");
+    }
+    invalidateListing(directory);
+
+    FTPConnectionPool::Lease lease = connectionPool_->acquire();
+    if (!lease) {
+        return false;
+    }
+    CURL* curl = lease.get();
+
+    // 显式创建时不信任已知目录，每一级都发送MKD，最后进入目录确认其存在
+    std::vector<std::string> directories = planRemoteDirectories(std::set<std::string>{directory}, false);
+    curl_slist* commands = prepareCreateRemoteDirectories(curl, directories, directory);
+    CURLcode result = curl_easy_perform(curl);
+
+    curl_easy_setopt(curl, CURLOPT_QUOTE, NULL);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+    curl_slist_free_all(commands);
+
+    if (result != CURLE_OK) {
+        std::cerr << "Failed to create remote directory: " << remoteDirectoryPath << std::endl;
+        return false;
+    }
+
+    markRemoteDirectories(directories);
+    return true;
+}
+
+std::string FTPClient::remoteParentDirectory(const std::string& remotePath)
+{
+    size_t slash = remotePath.rfind('/');
+    if (slash == std::string::npos || slash == 0) {
+        return std::string();
+    }
+
+    std::string directory = remotePath.substr(0, slash);
+    if (directory[0] != '/') {
+        directory.insert(0, "/");
+    }
+    return directory;
+}
+
+std::vector<std::string> FTPClient::planRemoteDirectories(const std::set<std::string>& directories, bool skipKnown)
+{
+    std::set<std::string> expanded;
+    do{
+        std::lock_guard<std::mutex> lock(directoryMutex_);
+        for (const std::string& directory : directories) {
+            // 从自身向上展开，遇到已知存在的目录即可停止
+            std::string path = directory;
+            while (path.length() > 1) {
+                if (skipKnown && remoteDirectories_.count(path)) {
+                    break;
+                }
+                if (!expanded.insert(path).second) {
+                    break;
+                }
+                size_t slash = path.rfind('/');
+                path.erase(slash == std::string::npos ? 0 : slash);
+            }
+        }
+    }while(false);
+
+    // 按层级广度优先，上级目录总在下级之前
+    std::vector<std::string> ordered(expanded.begin(), expanded.end());
+    std::stable_sort(ordered.begin(), ordered.end(), [](const std::string& a, const std::string& b) {
+        return std::count(a.begin(), a.end(), '/') < std::count(b.begin(), b.end(), '/');
+    });
+    return ordered;
+}
+
+curl_slist* FTPClient::prepareCreateRemoteDirectories(CURL* curl, const std::vector<std::string>& directories, const std::string& checkPath)
+{
+    // *前缀使libcurl忽略该命令的失败，已存在的目录回复550后继续创建下一个
+    curl_slist* commands = NULL;
+    for (const std::string& directory : directories) {
+        commands = curl_slist_append(commands, ("*MKD " + directory).c_str());
+    }
+
+    // 以/结尾的URL使libcurl在命令之后进入该目录，目录不存在时执行失败
+    std::string url = "ftp://" + host_ + "/";
+    if (!checkPath.empty()) {
+        url += replaceSpacesWithPercent20(checkPath) + "/";
+    }
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_QUOTE, commands);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_UPLOAD, 0L);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+
+    return commands;
+}
+
+bool FTPClient::createRemoteDirectories(const std::set<std::string>& directories)
+{
+    std::vector<std::string> planned = planRemoteDirectories(directories, true);
+    if (planned.empty()) {
+        return true;
+    }
+
+    FTPConnectionPool::Lease lease = connectionPool_->acquire();
+    if (!lease) {
+        return false;
+    }
+    CURL* curl = lease.get();
+
+    curl_slist* commands = prepareCreateRemoteDirectories(curl, planned, std::string());
+    CURLcode result = curl_easy_perform(curl);
+
+    curl_easy_setopt(curl, CURLOPT_QUOTE, NULL);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+    curl_slist_free_all(commands);
+
+    if (result != CURLE_OK) {
+        std::cerr << "Failed to create remote directories" << std::endl;
+        return false;
+    }
+
+    markRemoteDirectories(planned);
+    return true;
+}
+
+void FTPClient::ensureRemoteDirectory(const std::string& directory, std::function<void(bool)> onReady)
+{
+    do{
+        std::lock_guard<std::mutex> lock(directoryMutex_);
+        if (directory.empty() || remoteDirectories_.count(directory)) {
+            break;
+        }
+        pendingDirectories_[directory].push_back(std::move(onReady));
+        if (creatingDirectories_) {
+            // 进行中的任务结束后与其他等待的目录一起创建
+            return;
+        }
+        creatingDirectories_ = true;
+        onReady = nullptr;
+    }while(false);
+
+    if (onReady) {
+        onReady(true);
+    } else {
+        dispatchDirectoryCreation();
+    }
+}
+
+void FTPClient::dispatchDirectoryCreation()
+{
+    std::shared_ptr<std::map<std::string, std::vector<std::function<void(bool)>>>> waiting =
+        std::make_shared<std::map<std::string, std::vector<std::function<void(bool)>>>>();
+    do{
+        std::lock_guard<std::mutex> lock(directoryMutex_);
+        waiting->swap(pendingDirectories_);
+    }while(false);
+
+    std::set<std::string> directories;
+    for (const auto& item : *waiting) {
+        directories.insert(item.first);
+    }
+    std::shared_ptr<std::vector<std::string>> planned = std::make_shared<std::vector<std::string>>(planRemoteDirectories(directories, true));
+    std::function<void(bool)> finish = [this, waiting](bool created) {
+        // 任务进行期间又有目录在等待时，继续提交下一批
+        bool more = false;
+        do{
+            std::lock_guard<std::mutex> lock(directoryMutex_);
+            more = !pendingDirectories_.empty();
+            creatingDirectories_ = more;
+        }while(false);
+        if (more) {
+            dispatchDirectoryCreation();
+        }
+
+        for (auto& item : *waiting) {
+            for (std::function<void(bool)>& onReady : item.second) {
+                onReady(created);
+            }
+        }
+    };
+
+    if (planned->empty()) {
+        // 等待期间已由其他批次创建
+        finish(true);
+        return;
+    }
+
+    std::shared_ptr<curl_slist*> commands = std::make_shared<curl_slist*>((curl_slist*)NULL);
+
+    FTPTransferEngine::Job job;
+    job.prepare = [this, planned, commands](CURL* curl) {
+        *commands = prepareCreateRemoteDirectories(curl, *planned, std::string());
+        return true;
+    };
+    job.complete = [this, planned, commands, finish](CURL* curl, CURLcode result) {
+        curl_slist_free_all(*commands);
+        bool created = curl != NULL && result == CURLE_OK;
+        if (created) {
+            markRemoteDirectories(*planned);
+        } else {
+            std::cerr << "Failed to create remote directories" << std::endl;
+        }
+        finish(created);
+    };
+
+    // 目录创建与列表任务一样优先执行，等待它的上传才能尽早开始
+    transferEngine().submit(std::move(job), true);
+}
+
+void FTPClient::markRemoteDirectories(const std::vector<std::string>& directories)
+{
+    do{
+        std::lock_guard<std::mutex> lock(directoryMutex_);
+        remoteDirectories_.insert(directories.begin(), directories.end());
+    }while(false);
+
+    for (const std::string& directory : directories) {
+        invalidateListing(directory);
+    }
+}
+
+std::vector<FTPClient::FTPFileInfo> FTPClient::listRemoteFiles(const std::string& remoteFolderPath)
+{
+    std::vector<FTPFileInfo> fileList;
+    scanRemoteFolder(remoteFolderPath, [&fileList](const std::string& path, const FTPListParser::Entry& entry) {
+        fileList.push_back(makeFileInfo(path, entry));
+    });
+    return fileList;
+}
+
+bool FTPClient::listRemoteFiles(const std::string& remoteFolderPath, FTPFileCatalog& catalog)
+{
+    return scanRemoteFolder(remoteFolderPath, [&catalog](const std::string& path, const FTPListParser::Entry& entry) {
+        catalog.add(path, entry);
+    });
+}
+
+bool FTPClient::scanRemoteFolder(const std::string& remoteFolderPath,
+                                 const std::function<void(const std::string&, const FTPListParser::Entry&)>& onFile)
+{
+    // 以/结尾，libcurl才会把路径当作目录进入后再发送LIST
+    std::string folderPath = remoteFolderPath;
+    if (!folderPath.empty() && folderPath.back() != '/') {
+        folderPath += '/';
+    }
+
+    // 用栈代替递归，子目录逆序入栈，结果顺序与逐层递归相同
+    std::vector<RemoteDirectory> pending(1, RemoteDirectory{folderPath, -1, 0});
+    bool succeeded = true;
+    std::vector<RemoteDirectory> directories;
+
+    while (!pending.empty()) {
+        RemoteDirectory directory = std::move(pending.back());
+        pending.pop_back();
+        folderPath = directory.path;
+
+        std::shared_ptr<const std::string> response;
+        bool mlsd = !mlsdUnsupported_;
+        bool cached = lookupListing(directory, response, mlsd);
+        if (!cached) {
+            FTPConnectionPool::Lease lease = connectionPool_->acquire();
+            if (!lease) {
+                return false;
+            }
+            CURL* curl = lease.get();
+
+            std::shared_ptr<std::string> fetched = std::make_shared<std::string>();
+            prepareListing(curl, folderPath, fetched.get(), mlsd);
+            CURLcode result = curl_easy_perform(curl);
+
+            if (mlsd && listingCommandRejected(curl, result)) {
+                // 服务器不支持MLSD，之后都使用LIST
+                mlsdUnsupported_ = true;
+                mlsd = false;
+                fetched->clear();
+                prepareListing(curl, folderPath, fetched.get(), mlsd);
+                result = curl_easy_perform(curl);
+            }
+            metrics_.record(FTPTransferMetrics::Listing, curl, result);
+
+            // 解析前归还连接，回调中的操作可以使用该连接
+            lease.release();
+
+            if (result != CURLE_OK) {
+                std::cerr << "Failed to list remote files: " << folderPath << std::endl;
+                succeeded = false;
+                continue;
+            }
+
+            response = fetched;
+        }
+
+        std::string path = "/" + folderPath;
+        directories.clear();
+        parseListing(folderPath, *response, mlsd, [&](const FTPListParser::Entry& entry) {
+            onFile(path, entry);
+        }, directories);
+        if (!cached) {
+            storeListing(directory, response, mlsd, !directories.empty());
+        }
+        pending.insert(pending.end(), std::make_move_iterator(directories.rbegin()), std::make_move_iterator(directories.rend()));
+    }
+
+    return succeeded;
+}
+
+FTPClient::FTPFileInfo FTPClient::makeFileInfo(const std::string& path, const FTPListParser::Entry& entry)
+{
+    FTPFileInfo file;
+    file.permissions.assign(entry.permissions.data(), entry.permissions.size());
+    file.userName.assign(entry.owner.data(), entry.owner.size());
+    file.userGroup.assign(entry.group.data(), entry.group.size());
+    file.fileSize = entry.size > 0 ? entry.size : 0;
+    file.modifyTime = entry.modifyTime;
+    file.date.assign(entry.date.data(), entry.date.size());
+    file.path = path;
+    file.fileName.assign(entry.name.data(), entry.name.size());
+    return file;
+}
+
+void FTPClient::prepareListing(CURL* curl, const std::string& remoteFolderPath, std::string* sink, bool mlsd)
+{
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, mlsd ? "MLSD" : "LIST");
+    curl_easy_setopt(curl, CURLOPT_URL, ("ftp://" + host_ + "/" + replaceSpacesWithPercent20(remoteFolderPath)).c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeToStringCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, sink);
+}
+
+bool FTPClient::listingCommandRejected(CURL* curl, CURLcode result)
+{
+    if (result == CURLE_OK) {
+        return false;
+    }
+
+    // 50x表示命令不被识别或未实现，其他错误（如目录不存在）换用LIST也不会成功
+    long responseCode = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+    return responseCode == 500 || responseCode == 501 || responseCode == 502 || responseCode == 504;
+}
+
+void FTPClient::parseListing(const std::string& remoteFolderPath, std::string_view response, bool mlsd,
+                             const std::function<void(const FTPListParser::Entry&)>& onFile, std::vector<RemoteDirectory>& directories)
+{
+    time_t now = time(NULL);
+    FTPListParser::Entry entry;
+
+    FTPListParser::forEachLine(response, [&](std::string_view line) {
+        bool parsed = mlsd ? FTPListParser::parseMlsdLine(line, entry)
+                           : FTPListParser::parseListLine(line, entry, now);
+        if (!parsed) {
+            return;
+        }
+
+        if (entry.type == FTPListParser::Directory) {
+            directories.push_back(RemoteDirectory{remoteFolderPath, entry.modifyTime, 0});
+            directories.back().path.append(entry.name.data(), entry.name.size()).append("/");
+        } else if (entry.type == FTPListParser::File) {
+            onFile(entry);
+        }
+    });
+}
+
+void FTPClient::walkRemoteFolder(const std::vector<std::string>& remoteFolderPaths, std::function<void(const FTPFileInfo&)> onFile,
+                                 FTPTransferEngine::Batch& batch, std::shared_ptr<FTPTransferJournal> journal)
+{
+    std::shared_ptr<RemoteWalk> walk = std::make_shared<RemoteWalk>();
+    for (const std::string& remoteFolderPath : remoteFolderPaths) {
+        std::string folderPath = remoteFolderPath;
+        if (!folderPath.empty() && folderPath.back() != '/') {
+            folderPath += '/';
+        }
+        walk->directories.push_back(RemoteDirectory{folderPath, -1, 0});
+        if (journal) {
+            journal->directoryQueued(folderPath);
+        }
+    }
+    walk->activeListings = 0;
+    walk->onFile = onFile;
+    walk->batch = &batch;
+    walk->journal = journal;
+
+    dispatchListings(walk);
+}
+
+void FTPClient::dispatchListings(std::shared_ptr<RemoteWalk> walk)
+{
+    // 列表任务只占用少量连接，其余连接留给传输
+    const size_t maxListings = 4;
+
+    while (true) {
+        RemoteDirectory directory;
+        do{
+            std::lock_guard<std::mutex> lock(walk->mutex);
+            if (walk->directories.empty() || walk->activeListings >= maxListings) {
+                return;
+            }
+            directory = std::move(walk->directories.front());
+            walk->directories.pop_front();
+            ++walk->activeListings;
+        }while(false);
+
+        // 缓存中的列表直接在当前线程解析，不占用连接
+        std::shared_ptr<const std::string> cached;
+        bool cachedMlsd = false;
+        if (lookupListing(directory, cached, cachedMlsd)) {
+            handleListing(walk, directory.path, *cached, cachedMlsd);
+            std::lock_guard<std::mutex> lock(walk->mutex);
+            --walk->activeListings;
+            continue;
+        }
+
+        std::shared_ptr<std::string> response = std::make_shared<std::string>();
+        bool mlsd = !mlsdUnsupported_;
+
+        FTPTransferEngine::Job job;
+        job.prepare = [this, directory, response, mlsd](CURL* curl) {
+            prepareListing(curl, directory.path, response.get(), mlsd);
+            return true;
+        };
+        job.complete = [this, walk, directory, response, mlsd](CURL* curl, CURLcode result) {
+            if (curl && mlsd && listingCommandRejected(curl, result)) {
+                // 服务器不支持MLSD，用LIST重新列出该目录
+                mlsdUnsupported_ = true;
+                result = CURLE_OK;
+                std::lock_guard<std::mutex> lock(walk->mutex);
+                walk->directories.push_front(directory);
+            } else if (result == CURLE_OK) {
+                metrics_.record(FTPTransferMetrics::Listing, curl, result);
+                bool hasDirectories = handleListing(walk, directory.path, *response, mlsd);
+                storeListing(directory, response, mlsd, hasDirectories);
+            } else {
+                metrics_.record(FTPTransferMetrics::Listing, curl, result);
+                std::cerr << "Failed to list remote files: " << directory.path << std::endl;
+            }
+
+            do{
+                std::lock_guard<std::mutex> lock(walk->mutex);
+                --walk->activeListings;
+            }while(false);
+
+            // 先提交后续列表任务再结束本任务，避免批次提前结束
+            dispatchListings(walk);
+            walk->batch->done(result == CURLE_OK);
+        };
+
+        walk->batch->add();
+        transferEngine().submit(std::move(job), true);
+    }
+}
+
+bool FTPClient::handleListing(std::shared_ptr<RemoteWalk> walk, const std::string& folderPath, std::string_view response, bool mlsd)
+{
+    std::vector<FTPFileInfo> files;
+    std::vector<RemoteDirectory> directories;
+    std::string path = "/" + folderPath;
+    parseListing(folderPath, response, mlsd, [&](const FTPListParser::Entry& entry) {
+        files.push_back(makeFileInfo(path, entry));
+    }, directories);
+    bool hasDirectories = !directories.empty();
+
+    // 日志中子目录和文件先于本目录的列出记录写入，中断后未记录列出的目录会被重新列出
+    if (walk->journal) {
+        for (const RemoteDirectory& directory : directories) {
+            walk->journal->directoryQueued(directory.path);
+        }
+    }
+
+    do{
+        std::lock_guard<std::mutex> lock(walk->mutex);
+        walk->directories.insert(walk->directories.end(), std::make_move_iterator(directories.begin()),
+                                 std::make_move_iterator(directories.end()));
+    }while(false);
+
+    for (const FTPFileInfo& file : files) {
+        walk->onFile(file);
+    }
+    if (walk->journal) {
+        walk->journal->directoryListed(folderPath);
+    }
+    return hasDirectories;
+}
+
+std::string FTPClient::listingCacheKey(const std::string& folderPath)
+{
+    // 列表路径以/结尾，开头的/可有可无
+    size_t begin = folderPath.find_first_not_of('/');
+    std::string key = username_ + "@" + host_ + "/";
+    if (begin != std::string::npos) {
+        key.append(folderPath, begin, std::string::npos);
+    }
+    return key;
+}
+
+bool FTPClient::lookupListing(RemoteDirectory& directory, std::shared_ptr<const std::string>& response, bool& mlsd)
+{
+    if (!listingCache_) {
+        return false;
+    }
+    directory.generation = listingCache_->generation();
+    return listingCache_->lookup(listingCacheKey(directory.path), directory.modifyTime, response, mlsd);
+}
+
+void FTPClient::storeListing(const RemoteDirectory& directory, std::shared_ptr<const std::string> response, bool mlsd, bool hasDirectories)
+{
+    if (listingCache_) {
+        listingCache_->store(listingCacheKey(directory.path), std::move(response), mlsd, directory.modifyTime, hasDirectories,
+                             directory.generation);
+    }
+}
+
+void FTPClient::invalidateListing(const std::string& remotePath)
+{
+    if (!listingCache_) {
+        return;
+    }
+
+    // 路径本身（若为目录）及其所有上级目录的列表都可能变化
+    std::string path = remotePath;
+    while (!path.empty() && path.back() == '/') {
+        path.pop_back();
+    }
+    listingCache_->invalidate(listingCacheKey(path + "/"));
+    while (true) {
+        size_t slash = path.rfind('/');
+        if (slash == std::string::npos) {
+            listingCache_->invalidate(listingCacheKey(std::string()));
+            break;
+        }
+        path.erase(slash);
+        listingCache_->invalidate(listingCacheKey(path + "/"));
+        if (path.empty()) {
+            break;
+        }
+    }
+}
+
+std::vector<std::string> FTPClient::listLocalFiles(const std::string &localFolderPath)
+{
+    std::vector<std::string> fileList;
+    std::mutex mutex;
+    FTPLocalWalker walker;
+    walker.walk(localFolderPath, [&](const FTPLocalWalker::Entry& entry) {
+        std::lock_guard<std::mutex> lock(mutex);
+        fileList.emplace_back(entry.path);
+    });
+    return fileList;
+}
+
+std::vector<FTPClient::FileTransferInfo> FTPClient::getFileTransferInfo()
+{
+    std::vector<FileTransferInfo> infos;
+    for (const FTPProgressTracker::TransferSnapshot& snapshot : progress_.transfers()) {
+        FileTransferInfo info;
+        info.filename = snapshot.filename;
+        info.totalSize = snapshot.totalSize;
+        info.transferredSize = snapshot.transferredSize;
+        info.remainingSize = snapshot.totalSize > snapshot.transferredSize ? snapshot.totalSize - snapshot.transferredSize : 0;
+        info.transferProgress = snapshot.totalSize > 0 ? (double)snapshot.transferredSize / snapshot.totalSize * 100 : 0;
+        info.transferType = snapshot.direction == FTPProgressTracker::Upload ? Upload : Download;
+        infos.push_back(info);
+    }
+    return infos;
+}
+
+FTPClient::BatchProgress FTPClient::getBatchProgress()
+{
+    BatchProgress progress = progress_.batch();
+
+    std::lock_guard<std::mutex> lock(engineMutex_);
+    progress.concurrencyLevel = transferEngine_ ? transferEngine_->maxConcurrentTransfers() : maxConcurrentTransfers_;
+    return progress;
+}
+
+FTPClient::TransferMetrics FTPClient::getTransferMetrics()
+{
+    return metrics_.snapshot();
+}
+
+FTPClient::TransferMetrics FTPClient::getBatchMetrics()
+{
+    TransferMetrics metrics = metrics_.snapshot();
+
+    std::lock_guard<std::mutex> lock(metricsMutex_);
+    return metrics.since(batchMetricsBaseline_);
+}
+
+void FTPClient::beginBatch()
+{
+    if (!progress_.beginBatch()) {
+        return;
+    }
+
+    TransferMetrics baseline = metrics_.snapshot();
+    std::lock_guard<std::mutex> lock(metricsMutex_);
+    batchMetricsBaseline_ = baseline;
+}
+
+size_t FTPClient::writeToStringCallback(void* contents, size_t size, size_t nmemb, std::string* str)
+{
+    size_t dataSize = size * nmemb;
+    str->append((char*)contents, dataSize);
+    return dataSize;
+}
+
+void FTPClient::setDownloadLedger(const std::string& ledgerPath)
+{
+    if (ledgerPath.empty()) {
+        ledger_.reset();
+    } else {
+        ledger_ = FTPDownloadLedger::shared(ledgerPath);
+    }
+}
+
+void FTPClient::setListingCache(int ttlSeconds, bool revalidateByDirectoryTime)
+{
+    if (ttlSeconds <= 0) {
+        listingCache_.reset();
+    } else {
+        listingCache_ = std::make_shared<FTPListingCache>(ttlSeconds, revalidateByDirectoryTime);
+    }
+}
+
+void FTPClient::setPartialFileSuffix(const std::string& suffix)
+{
+    partialSuffix_ = suffix;
+}
+
+void FTPClient::setTransferJournal(const std::string& journalPath)
+{
+    journalPath_ = journalPath;
+}
+
+void FTPClient::setRetryPolicy(unsigned maxRetries, long baseDelayMs, long maxDelayMs)
+{
+    retryPolicy_ = FTPRetryPolicy(maxRetries, std::chrono::milliseconds(baseDelayMs), std::chrono::milliseconds(maxDelayMs));
+}
+
+bool FTPClient::retryAfterFailure(CURL* curl, CURLcode result, const std::string& path, unsigned& attempts, bool& freshConnect,
+                                  std::chrono::milliseconds& delay)
+{
+    long responseCode = 0;
+    if (curl) {
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+    }
+
+    FTPRetryPolicy::Verdict verdict = FTPRetryPolicy::classify(result, responseCode);
+    if (verdict == FTPRetryPolicy::Success || result == CURLE_ABORTED_BY_CALLBACK) {
+        // 调用方取消的传输不计入失败
+        return false;
+    }
+    if (verdict == FTPRetryPolicy::Fatal) {
+        progress_.recordRetry(FTPProgressTracker::Fatal);
+        return false;
+    }
+    if (!retryPolicy_.allows(attempts)) {
+        progress_.recordRetry(FTPProgressTracker::Exhausted);
+        return false;
+    }
+
+    freshConnect = FTPRetryPolicy::poisonsConnection(result, responseCode);
+    delay = retryPolicy_.backoff(attempts);
+    ++attempts;
+    progress_.recordRetry(FTPProgressTracker::Retried);
+    std::cerr << "Retrying " << path << " in " << delay.count() << " ms (attempt " << attempts << "/" << retryPolicy_.maxRetries()
+              << "): " << curl_easy_strerror(result) << (responseCode > 0 ? ", reply " + std::to_string(responseCode) : std::string()) << std::endl;
+    return true;
+}
+
+void FTPClient::recordDownloadedFile(const FTPFileInfo& file)
+{
+    if (ledger_) {
+        ledger_->record(file.path + file.fileName, file.fileSize, file.modifyTime);
+    }
+}
+
+bool FTPClient::isDownloaded(const FTPFileInfo& file)
+{
+    return ledger_ && ledger_->contains(file.path + file.fileName, file.fileSize, file.modifyTime);
+}
+
+bool FTPClient::fileExists(const std::string &filePath)
+{
+    std::ifstream file(filePath);
+    return file.good();
+}
+
+void FTPClient::sanitizePath(std::string &path)
+{
+    std::replace(path.begin(), path.end(), '\\', '/');
+    // 删除路径结尾的 /
+    if (!path.empty() && path.back() == '/') {
+        path.erase(path.length() - 1);
+    }
+}
+
+// 将URL中空格替换为%20，解决包含空格无法传输问题
+std::string FTPClient::replaceSpacesWithPercent20(const std::string &str)
+{
+    std::string result = str;
+    size_t pos = 0;
+    while ((pos = result.find(' ', pos)) != std::string::npos) {
+        result.replace(pos, 1, "%20");
+        pos += 3; // 移过替换的字符
+    }
 
-    curl_easy_setopt(curl_download,CURLOPT_PROGRESSDATA, &taskProgress[proKey]);
-    curl_easy_setopt(curl_download,CURLOPT_PROGRESSFUNCTION, progressCallback);
-    curl_easy_setopt(curl_download,CURLOPT_NOPROGRESS, 0L);
+    return result;
+}
 
-    CURLcode result = curl_easy_perform(curl_download);
-    file.close();
+// 实现下载文件的函数
+FTPClient::FTP_Code FTPClient::downloadFile(const std::string &remoteFilePath, const std::string &localFilePath,
+                                            const std::vector<std::string> &filterKeywords)
+{
+    DownloadTask task;
+    FTP_Code res = initDownloadTask(task, remoteFilePath, localFilePath, filterKeywords);
+    if (res != FTP_OK) {
+        return res;
+    }
+
+    return performDownload(task);
+}
+
+FTPClient::FTP_Code FTPClient::downloadFile(const std::string &remoteFilePath, FTPCallbackSink::WriteFunction sink)
+{
+    return downloadToSink(remoteFilePath, std::unique_ptr<FTPFileSink>(new FTPCallbackSink(sink)));
+}
+
+FTPClient::FTP_Code FTPClient::downloadFile(const std::string &remoteFilePath, std::string& buffer)
+{
+    return downloadToSink(remoteFilePath, std::unique_ptr<FTPFileSink>(new FTPStringSink(&buffer)));
+}
+
+FTPClient::FTP_Code FTPClient::downloadToSink(const std::string& remoteFilePath, std::unique_ptr<FTPFileSink> sink)
+{
+    DownloadTask task;
+    task.remotePath = remoteFilePath;
+    task.file = std::move(sink);
+    task.inMemory = true;
+    task.curl = NULL;
+    task.reserved = false;
+    task.progressKey = -1;
+    task.restart = false;
+    task.comparing = false;
+    task.upToDate = false;
+    task.expectedSize = -1;
+    task.priority = 0;
+    task.attempts = 0;
+    task.freshConnect = false;
+
+    sanitizePath(task.remotePath);
+    if (!task.remotePath.empty() && task.remotePath[0] != '/') {
+        task.remotePath.insert(0, "/");
+    }
+
+    return performDownload(task);
+}
+
+FTPClient::FTP_Code FTPClient::performDownload(DownloadTask& task, FTPTransferEngine::Batch* deletes)
+{
+    FTPConnectionPool::Lease lease;
+    CURL* curl_download = NULL;
 
     FTP_Code res = FTP_FAILED;
-    if (result == CURLE_OK) {
+    while (true) {
+        lease = connectionPool_->acquire();
+        if (!lease) {
+            return INITIALIZATION_FAILED;
+        }
+        curl_download = lease.get();
+
+        CURLcode result = CURLE_OK;
+        do{
+            res = prepareDownload(curl_download, task);
+            if (res != FTP_OK) {
+                return res;
+            }
+
+            result = curl_easy_perform(curl_download);
+            res = finishDownload(curl_download, task, result);
+        }while(task.restart);
+
+        bool freshConnect = false;
+        std::chrono::milliseconds delay(0);
+        if (res == FTP_OK || task.inMemory || !retryAfterFailure(curl_download, result, task.remotePath, task.attempts, freshConnect, delay)) {
+            break;
+        }
+        // 可能已损坏的连接不放回连接池，等待后从临时文件末尾续传
+        if (freshConnect) {
+            lease.discard();
+        }
+        lease.release();
+        std::this_thread::sleep_for(delay);
+    }
+
+    // 校验通过后才删除远程文件
+    if (res == FTP_OK && task.checksum) {
+        ChecksumQuery query;
+        initChecksumQuery(query, task.remotePath, true);
+        fetchRemoteChecksum(curl_download, query);
+        res = checkDownloadChecksum(task, query.value);
+    }
+    lease.release();
+
+    if (res == FTP_OK) {
+        res = finalizeDownload(task);
+    }
+
+    if (res == FTP_OK && enableDeleteAfterDownload_) {
+        if (deletes) {
+            deletes->add();
+            scheduleDelete(task.remotePath, [deletes](FTP_Code res) {
+                deletes->done(res == FTP_OK);
+            });
+        } else {
+            res = deleteDownloadedFile(task.remotePath);
+        }
+    }
+
+    return res;
+}
+
+FTPClient::FTP_Code FTPClient::initDownloadTask(DownloadTask& task, const std::string& remoteFilePath, const std::string& localFilePath,
+                                                const std::vector<std::string>& filterKeywords)
+{
+    task.remotePath = remoteFilePath;
+    task.localPath = localFilePath;
+    task.inMemory = false;
+    task.curl = NULL;
+    task.reserved = false;
+    task.progressKey = -1;
+    task.restart = false;
+    task.comparing = false;
+    task.upToDate = false;
+    task.expectedSize = -1;
+    task.priority = 0;
+    task.attempts = 0;
+    task.freshConnect = false;
+
+    sanitizePath(task.remotePath);
+    sanitizePath(task.localPath);
+
+    //  在目标文件开头插入 /
+    if (!task.remotePath.empty() && task.remotePath[0] != '/') {
+        task.remotePath.insert(0, "/");
+    }
+    task.writePath = task.localPath + partialSuffix_;
+
+    // 将本地路径拆分为目录和文件名
+    size_t separatorIndex = task.localPath.find_last_of('/');
+    std::string loacalDirectoryPath = task.localPath.substr(0, separatorIndex);
+    std::string loacalFileName = task.localPath.substr(separatorIndex + 1);
+
+    // 过滤关键词
+    for (const std::string& keyword : filterKeywords) {
+        if (loacalFileName.find(keyword) != std::string::npos) {
+            return FILENAME_CONTAINS_KEYWORD;
+        }
+    }
+
+    if (!createLocalFolder(loacalDirectoryPath)) {
+        return CREATE_FOLDER_FAILED;
+    }
+
+    return FTP_OK;
+}
+
+FTPClient::FTP_Code FTPClient::prepareDownload(CURL* curl, DownloadTask& task)
+{
+    // 临时文件已存在时从其末尾续传，libcurl会先发送SIZE确认偏移量有效；否则重新创建文件
+    bool resume = false;
+    if (!task.inMemory && !task.restart) {
+        resume = fileExists(task.writePath);
+        if (!resume && task.writePath != task.localPath && fileExists(task.localPath)) {
+            // 本地路径上只会是完整的文件，传输期间不能改动它；先查询远程文件，一致时不下载，否则重新下载到临时文件
+            task.comparing = true;
+            task.checksum.reset();
+            prepareRemoteFileStat(curl, task.remotePath, &task.remoteStat);
+            if (task.freshConnect) {
+                curl_easy_setopt(curl, CURLOPT_FRESH_CONNECT, 1L);
+                task.freshConnect = false;
+            }
+            return FTP_OK;
+        }
+    }
+    task.restart = false;
+
+    if (!task.inMemory) {
+        // 下载后删除远程文件时，本地文件须先落盘
+        FTPFileSink::Options options = sinkOptions_;
+        options.syncOnClose = enableDeleteAfterDownload_;
+        task.file = FTPFileSink::create(options);
+    }
+    if (!task.file->open(task.writePath, resume)) {
+        if (!task.inMemory)
+            task.file.reset();
+        std::cerr << "Failed to open local file: " << task.localPath << std::endl;
+        return LOCAL_FILE_OPEN_FAILED;
+    }
+    task.curl = curl;
+    task.reserved = false;
+
+    curl_off_t resumeFrom = task.file->position();
+
+    task.checksum.reset();
+    if (checksumAlgorithm_ != FTPChecksum::None) {
+        task.checksum.reset(new FTPChecksum(checksumAlgorithm_));
+        // 续传时本地已有的部分需要读一遍，其余部分在写回调中累计
+        if (resumeFrom > 0 && !task.checksum->updateFromFile(task.writePath, resumeFrom)) {
+            task.checksum.reset();
+        }
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, ("ftp://" + host_ + replaceSpacesWithPercent20(task.remotePath)).c_str());
+    curl_easy_setopt(curl, CURLOPT_FTP_CREATE_MISSING_DIRS, 1L);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &task);
+    if (receiveBufferSize_ > 0) {
+        curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, receiveBufferSize_);
+    }
+    // 偏移量为0时也要设置：重新开始下载时句柄上仍保留着上一次续传的偏移量
+    curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, resumeFrom);
+    if (task.freshConnect) {
+        // 上次失败的连接可能仍在引擎的连接缓存中，重试时不复用
+        curl_easy_setopt(curl, CURLOPT_FRESH_CONNECT, 1L);
+        task.freshConnect = false;
+    }
+
+    task.progressKey = beginProgress(curl, task.remotePath, Download, 0);
+
+    return FTP_OK;
+}
+
+FTPClient::FTP_Code FTPClient::finalizeDownload(DownloadTask& task)
+{
+    if (task.inMemory || task.upToDate || task.writePath == task.localPath) {
+        return FTP_OK;
+    }
+
+    // 同一文件系统内的改名是原子的，本地路径上的文件要么是旧文件，要么是完整的新文件
+#if defined(_WIN32)
+    remove(task.localPath.c_str());
+#endif
+    if (rename(task.writePath.c_str(), task.localPath.c_str()) != 0) {
+        std::cerr << "Failed to rename downloaded file: " << task.writePath << std::endl;
+        return FTP_FAILED;
+    }
+    return FTP_OK;
+}
+
+FTPClient::FTP_Code FTPClient::finishDownload(CURL* curl, DownloadTask& task, CURLcode result)
+{
+    if (task.comparing) {
+        task.comparing = false;
+        clearRemoteFileStat(curl);
+        bool found = remoteFileStatResult(curl, result, task.remotePath, task.remoteStat);
+        if (found && localFileUpToDate(task.localPath, task.remoteStat)) {
+            task.upToDate = true;
+            std::cout << "Local file is the same as remote file. No need to download." << std::endl;
+            if (checksumAlgorithm_ != FTPChecksum::None) {
+                // 校验本地已有的文件，不一致时只报告，不删除本地文件
+                task.checksum.reset(new FTPChecksum(checksumAlgorithm_));
+                if (!task.checksum->updateFromFile(task.localPath, -1)) {
+                    task.checksum.reset();
+                }
+            }
+            return FTP_OK;
+        }
+        if (!found && result != CURLE_OK && result != CURLE_REMOTE_FILE_NOT_FOUND && result != CURLE_REMOTE_ACCESS_DENIED) {
+            // 查询失败，按传输失败处理，重试时重新比较
+            return FTP_FAILED;
+        }
+        // 远程文件已变化，从头下载到临时文件
+        task.restart = true;
+        return FTP_FAILED;
+    }
+
+    metrics_.record(FTPTransferMetrics::Download, curl, result);
+
+    bool written = task.file->close();
+    if (!task.inMemory) {
+        task.file.reset();
+    }
+    task.curl = NULL;
+    endProgress(task.progressKey);
+    task.progressKey = -1;
+
+    FTP_Code res = FTP_FAILED;
+    if (result == CURLE_OK && !written) {
+        res = FTP_FAILED;
+        std::cerr << "Failed to write local file: " << task.localPath << std::endl;
+    } else if (result == CURLE_WRITE_ERROR && task.inMemory) {
+        // 回调返回false，由调用方中止
+        res = FTP_FAILED;
+        std::cerr << "Download aborted by sink: " << task.remotePath << std::endl;
+    } else if (result == CURLE_OK) {
         res = FTP_OK;
         std::cout << "File downloaded successfully!" << std::endl;
-        if (enableDeleteAfterDownload_) {
-            if(!deleteRemoteFile(curl_download, sanitizedRemotePath))
-                res = REMOTE_FILE_DELE_FAILED;
+        if (task.attempts > 0) {
+            progress_.recordRetry(FTPProgressTracker::Recovered);
         }
+    } else if (result == CURLE_FTP_COULDNT_USE_REST || result == CURLE_BAD_DOWNLOAD_RESUME) {
+        // 服务器不支持续传或本地文件比远程文件大，重新下载整个文件
+        task.restart = true;
+        res = FTP_FAILED;
     } else {
         res = FTP_FAILED;
-        std::cerr << "Failed to download file: " << sanitizedRemotePath << std::endl;
+        std::cerr << "Failed to download file: " << task.remotePath << std::endl;
+    }
+
+    return res;
+}
+
+void FTPClient::scheduleDownload(const std::string& remoteFilePath, const std::string& localFilePath,
+                                 const std::vector<std::string>& filterKeywords, curl_off_t expectedSize, std::function<void(FTP_Code)> onFinished)
+{
+    std::shared_ptr<DownloadTask> task = std::make_shared<DownloadTask>();
+    FTP_Code res = initDownloadTask(*task, remoteFilePath, localFilePath, filterKeywords);
+    if (res != FTP_OK) {
+        onFinished(res);
+        return;
     }
+    task->expectedSize = expectedSize;
+    task->priority = transferPriority(task->remotePath, expectedSize);
 
-    curl_easy_cleanup(curl_download);
+    submitDownloadTask(task, onFinished);
+}
+
+void FTPClient::submitDownloadTask(std::shared_ptr<DownloadTask> task, std::function<void(FTP_Code)> onFinished,
+                                   std::chrono::milliseconds delay)
+{
+    std::shared_ptr<FTP_Code> prepared = std::make_shared<FTP_Code>(FTP_FAILED);
+
+    FTPTransferEngine::Job job;
+    job.control = task->control;
+    job.size = task->expectedSize;
+    job.priority = task->priority;
+    job.prepare = [this, task, prepared](CURL* curl) {
+        *prepared = prepareDownload(curl, *task);
+        return *prepared == FTP_OK;
+    };
+    job.complete = [this, task, prepared, onFinished](CURL* curl, CURLcode result) {
+        if (*prepared != FTP_OK) {
+            onFinished(*prepared);
+            return;
+        }
+
+        FTP_Code res = finishDownload(curl, *task, result);
+        if (task->restart) {
+            submitDownloadTask(task, onFinished);
+            return;
+        }
+        std::chrono::milliseconds delay(0);
+        if (res != FTP_OK && !task->inMemory &&
+            retryAfterFailure(curl, result, task->remotePath, task->attempts, task->freshConnect, delay)) {
+            submitDownloadTask(task, onFinished, delay);
+            return;
+        }
+
+        // 校验通过后才删除远程文件
+        if (res == FTP_OK && task->checksum) {
+            std::shared_ptr<ChecksumQuery> query = std::make_shared<ChecksumQuery>();
+            initChecksumQuery(*query, task->remotePath, true);
+            scheduleChecksumQuery(query, [this, task, query, onFinished]() {
+                FTP_Code res = checkDownloadChecksum(*task, query->value);
+                if (res == FTP_OK) {
+                    res = finalizeDownload(*task);
+                }
+                if (res == FTP_OK && enableDeleteAfterDownload_) {
+                    scheduleDelete(task->remotePath, onFinished);
+                    return;
+                }
+                onFinished(res);
+            });
+            return;
+        }
+
+        if (res == FTP_OK) {
+            res = finalizeDownload(*task);
+        }
+        if (res == FTP_OK && enableDeleteAfterDownload_) {
+            scheduleDelete(task->remotePath, onFinished);
+            return;
+        }
+        onFinished(res);
+    };
+
+    if (delay.count() > 0) {
+        transferEngine().submitAfter(std::move(job), delay);
+    } else {
+        transferEngine().submit(std::move(job));
+    }
+}
+
+void FTPClient::scheduleDelete(const std::string& remoteFilePath, std::function<void(FTP_Code)> onFinished)
+{
+    deleteQueue().enqueue(remoteFilePath, [this, remoteFilePath, onFinished](bool deleted, const std::string& reply) {
+        invalidateListing(remoteFilePath);
+        if (!deleted) {
+            std::cerr << "Failed to delete remote file: " << remoteFilePath << " " << reply << std::endl;
+        }
+        if (deleteCallback_) {
+            deleteCallback_(remoteFilePath, deleted, reply);
+        }
+        onFinished(deleted ? FTP_OK : REMOTE_FILE_DELE_FAILED);
+    });
+}
+
+FTPClient::FTP_Code FTPClient::deleteDownloadedFile(const std::string& remoteFilePath)
+{
+    std::promise<FTP_Code> deleted;
+    scheduleDelete(remoteFilePath, [&deleted](FTP_Code res) {
+        deleted.set_value(res);
+    });
+    return deleted.get_future().get();
+}
+
+FTPClient::Transfer::Transfer(FTPTransferEngine* engine)
+    : engine_(engine),
+      control_(std::make_shared<FTPTransferEngine::Control>()),
+      future_(promise_.get_future().share()),
+      finished_(false),
+      result_(FTP_FAILED)
+{
+}
+
+bool FTPClient::Transfer::finished()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return finished_;
+}
 
+void FTPClient::Transfer::then(std::function<void(FTP_Code)> callback)
+{
     do{
-        std::lock_guard<std::mutex> lock(mutex);
-        auto it = taskProgress.find(proKey);
-        if(it != taskProgress.end())
-            taskProgress.erase(it);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!finished_) {
+            callbacks_.push_back(callback);
+            return;
+        }
+    }while(false);
+    callback(result_);
+}
+
+void FTPClient::Transfer::cancel()
+{
+    if (finished()) {
+        return;
+    }
+    control_->cancelled = true;
+    engine_->wake();
+}
+
+void FTPClient::Transfer::pause()
+{
+    if (finished()) {
+        return;
+    }
+    control_->paused = true;
+    engine_->wake();
+}
+
+void FTPClient::Transfer::resume()
+{
+    if (finished()) {
+        return;
+    }
+    control_->paused = false;
+    engine_->wake();
+}
+
+void FTPClient::Transfer::finish(FTP_Code res)
+{
+    // 中止的传输在各处被报告为普通失败，这里统一改为取消
+    if (res != FTP_OK && control_->cancelled) {
+        res = TRANSFER_CANCELLED;
+    }
+
+    std::vector<std::function<void(FTP_Code)>> callbacks;
+    do{
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_ = true;
+        result_ = res;
+        callbacks.swap(callbacks_);
     }while(false);
 
-    return res;
+    promise_.set_value(res);
+    for (auto& callback : callbacks) {
+        callback(res);
+    }
+}
+
+FTPClient::TransferHandle FTPClient::submitDownload(const std::string& remoteFilePath, const std::string& localFilePath,
+                                                    const std::vector<std::string>& filterKeywords, std::function<void(FTP_Code)> onFinished,
+                                                    int priority)
+{
+    TransferHandle transfer(new Transfer(&transferEngine()));
+    if (onFinished) {
+        transfer->then(onFinished);
+    }
+
+    std::shared_ptr<DownloadTask> task = std::make_shared<DownloadTask>();
+    FTP_Code res = initDownloadTask(*task, remoteFilePath, localFilePath, filterKeywords);
+    if (res != FTP_OK) {
+        transfer->finish(res);
+        return transfer;
+    }
+
+    task->control = transfer->control_;
+    task->priority = priority;
+    submitDownloadTask(task, [transfer](FTP_Code res) {
+        transfer->finish(res);
+    });
+    return transfer;
+}
+
+FTPClient::TransferHandle FTPClient::submitUpload(const std::string& localFilePath, const std::string& remoteFilePath,
+                                                  std::function<void(FTP_Code)> onFinished, int priority)
+{
+    TransferHandle transfer(new Transfer(&transferEngine()));
+    if (onFinished) {
+        transfer->then(onFinished);
+    }
+
+    std::shared_ptr<UploadTask> task = std::make_shared<UploadTask>();
+    initUploadTask(*task, localFilePath, remoteFilePath);
+    task->expectedSize = getLocalFileSize(task->localPath);
+    task->control = transfer->control_;
+    task->priority = priority;
+    scheduleUpload(task, [transfer](FTP_Code res) {
+        transfer->finish(res);
+    });
+    return transfer;
+}
+
+size_t FTPClient::segmentWriteCallback(void* contents, size_t size, size_t nmemb, DownloadSegment* segment)
+{
+    size_t dataSize = size * nmemb;
+#if defined(__linux__) || defined(__APPLE__)
+    // 服务器忽略范围时多出的数据不能覆盖后一个分段
+    if (segment->begin + segment->written + (curl_off_t)dataSize > segment->end + 1) {
+        return 0;
+    }
+
+    if (!segment->sink->write((const char*)contents, dataSize)) {
+        return 0;
+    }
+    segment->written += dataSize;
+    return dataSize;
+#else
+    return 0;
+#endif
+}
+
+FTPClient::FTP_Code FTPClient::segmentedDownloadFile(const std::string &remoteFilePath, const std::string &localFilePath,
+                                                     const std::vector<std::string> &filterKeywords, size_t segmentCount)
+{
+    // 每段至少8MB，更小的文件分段带来的连接开销大于收益
+    const curl_off_t minSegmentSize = 8 * 1024 * 1024;
+
+    DownloadTask task;
+    FTP_Code res = initDownloadTask(task, remoteFilePath, localFilePath, filterKeywords);
+    if (res != FTP_OK) {
+        return res;
+    }
+
+#if defined(__linux__) || defined(__APPLE__)
+    RemoteFileStat stat;
+    if (!getRemoteFileStat(task.remotePath, stat) || !stat.resumable) {
+        return downloadFile(remoteFilePath, localFilePath, filterKeywords);
+    }
+    curl_off_t remoteSize = stat.fileSize;
+
+    if (segmentCount > (size_t)(remoteSize / minSegmentSize)) {
+        segmentCount = (size_t)(remoteSize / minSegmentSize);
+    }
+    if (remoteSize <= 0 || segmentCount < 2) {
+        return downloadFile(remoteFilePath, localFilePath, filterKeywords);
+    }
+
+    int fd = open(task.writePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to open local file: " << task.localPath << std::endl;
+        return LOCAL_FILE_OPEN_FAILED;
+    }
+
+    // 预分配整个文件，各分段直接写入各自的位置
+#if defined(__linux__)
+    int allocated = posix_fallocate(fd, 0, (off_t)remoteSize);
+#else
+    int allocated = ftruncate(fd, (off_t)remoteSize);
+#endif
+    if (allocated != 0) {
+        std::cerr << "Failed to allocate local file: " << task.localPath << std::endl;
+        close(fd);
+        remove(task.writePath.c_str());
+        return LOCAL_FILE_OPEN_FAILED;
+    }
+
+    std::vector<DownloadSegment> segments(segmentCount);
+    curl_off_t segmentSize = remoteSize / (curl_off_t)segmentCount;
+    for (size_t i = 0; i < segmentCount; ++i) {
+        DownloadSegment& segment = segments[i];
+        segment.fd = fd;
+        segment.begin = (curl_off_t)i * segmentSize;
+        segment.end = (i + 1 == segmentCount) ? remoteSize - 1 : segment.begin + segmentSize - 1;
+        segment.written = 0;
+        segment.flushed = false;
+        segment.result = CURLE_FAILED_INIT;
+        segment.progressKey = -1;
+        segment.sink.reset(new FTPBufferedFileSink(sinkOptions_));
+        segment.sink->attach(fd, segment.begin);
+    }
+
+    FTPTransferEngine::Batch batch;
+    std::string url = "ftp://" + host_ + replaceSpacesWithPercent20(task.remotePath);
+    for (size_t i = 0; i < segmentCount; ++i) {
+        DownloadSegment* segment = &segments[i];
+
+        FTPTransferEngine::Job job;
+        job.prepare = [this, segment, url, &task](CURL* curl) {
+            std::string range = std::to_string(segment->begin) + "-" + std::to_string(segment->end);
+            curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+            curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, segmentWriteCallback);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, segment);
+            if (receiveBufferSize_ > 0) {
+                curl_easy_setopt(curl, CURLOPT_BUFFERSIZE, receiveBufferSize_);
+            }
+            segment->progressKey = beginProgress(curl, task.remotePath, Download, segment->end - segment->begin + 1);
+            return true;
+        };
+        job.complete = [this, segment, &batch](CURL*, CURLcode result) {
+            if (segment->progressKey >= 0) {
+                endProgress(segment->progressKey);
+                segment->progressKey = -1;
+            }
+            segment->result = result;
+            segment->flushed = segment->sink->close();
+            batch.done(result == CURLE_OK && segment->flushed && segment->written == segment->end - segment->begin + 1);
+        };
+
+        batch.add();
+        transferEngine().submit(std::move(job));
+    }
+
+    bool succeeded = batch.wait();
+    bool synced = fsync(fd) == 0;
+    close(fd);
+
+    if (!succeeded || !synced) {
+        for (const DownloadSegment& segment : segments) {
+            if (segment.result == CURLE_FTP_COULDNT_USE_REST || segment.result == CURLE_RANGE_ERROR) {
+                // 服务器拒绝REST，删除预分配的文件后单连接重新下载
+                remove(task.writePath.c_str());
+                return downloadFile(remoteFilePath, localFilePath, filterKeywords);
+            }
+        }
+
+        // 预分配的文件长度等于远程大小，续传会把它当作已下载完成；只保留从开头起连续写完的数据，
+        // 同步失败时无法确定哪些数据已落盘，整个删除
+        curl_off_t completed = 0;
+        for (const DownloadSegment& segment : segments) {
+            if (!synced || !segment.flushed) {
+                break;
+            }
+            completed += segment.written;
+            if (segment.written != segment.end - segment.begin + 1) {
+                break;
+            }
+        }
+        if (completed <= 0 || truncate(task.writePath.c_str(), (off_t)completed) != 0) {
+            remove(task.writePath.c_str());
+        }
+
+        std::cerr << "Failed to download file: " << task.remotePath << std::endl;
+        return FTP_FAILED;
+    }
+
+    std::cout << "File downloaded successfully!" << std::endl;
+
+    if (checksumAlgorithm_ != FTPChecksum::None) {
+        // 各分段同时写入不同位置，无法随写回调按顺序累计，取得远程校验和后再读一遍完成的文件
+        ChecksumQuery query;
+        initChecksumQuery(query, task.remotePath, true);
+        FTPConnectionPool::Lease lease = connectionPool_->acquire();
+        if (lease) {
+            fetchRemoteChecksum(lease.get(), query);
+        }
+
+        task.checksum.reset(new FTPChecksum(checksumAlgorithm_));
+        if (!query.value.empty() && !task.checksum->updateFromFile(task.writePath, -1)) {
+            std::cerr << "Failed to read local file: " << task.localPath << std::endl;
+            return FTP_FAILED;
+        }
+        FTP_Code verified = checkDownloadChecksum(task, query.value);
+        if (verified != FTP_OK) {
+            return verified;
+        }
+    }
+
+    res = finalizeDownload(task);
+    if (res != FTP_OK) {
+        return res;
+    }
+
+    if (enableDeleteAfterDownload_) {
+        return deleteDownloadedFile(task.remotePath);
+    }
+
+    return FTP_OK;
+#else
+    // 其他平台没有按偏移量写入的接口，使用单连接下载
+    return downloadFile(remoteFilePath, localFilePath, filterKeywords);
+#endif
 }
 
 // 实现下载整个文件夹的函数-单线程
@@ -521,18 +2104,35 @@ bool FTPClient::downloadFolder(const std::string& remoteFolderPath, const std::s
         return false;
     }
 
+    beginBatch();
+
+    // 删除在删除队列的连接上进行，与后续文件的下载重叠
+    FTPTransferEngine::Batch deletes;
     std::vector<FTPFileInfo> files = listRemoteFiles(sanitizedRemotePath);
     for (const FTPFileInfo& file : files) {
         std::string remoteFilePath = file.path + file.fileName;
         std::string localFilePath = sanitizedLocalPath + "/" + file.fileName;
 
-        downloadFile(remoteFilePath, localFilePath, filterKeywords);
+        if (isDownloaded(file)) {
+            continue;
+        }
+
+        DownloadTask task;
+        FTP_Code res = initDownloadTask(task, remoteFilePath, localFilePath, filterKeywords);
+        if (res == FTP_OK) {
+            res = performDownload(task, &deletes);
+        }
+        if (res == FTP_OK) {
+            recordDownloadedFile(file);
+        }
     }
+    deletes.wait();
 
+    progress_.endBatch();
     return true;
 }
 
-// 实现并发下载文件夹的函数
+// 实现并发下载文件夹的函数，由传输引擎在固定数量的连接上并发列出目录和下载
 bool FTPClient::concurrentDownloadFolder(const std::string& remoteFolderPath, const std::string& localFolderPath, const std::vector<std::string> &filterKeywords)
 {
 
@@ -542,112 +2142,427 @@ bool FTPClient::concurrentDownloadFolder(const std::string& remoteFolderPath, co
     sanitizePath(sanitizedRemotePath);
     sanitizePath(sanitizedLocalPath);
 
-    std::vector<FTPFileInfo> files = listRemoteFiles(sanitizedRemotePath);
-    std::vector<std::future<FTP_Code>> futures;
-    std::vector<std::thread> threads;
-    for (const FTPFileInfo& file : files) {
-        std::string remoteFilePath = file.path + file.fileName;
-        std::string localFilePath = sanitizedLocalPath + file.path + file.fileName;
+    std::shared_ptr<FTPTransferJournal> journal;
+    if (!journalPath_.empty()) {
+        journal = std::make_shared<FTPTransferJournal>(journalPath_);
+        if (!journal->begin(sanitizedRemotePath, sanitizedLocalPath, filterKeywords)) {
+            journal.reset();
+        }
+    }
+
+    return downloadBatch({sanitizedRemotePath}, {}, sanitizedLocalPath, filterKeywords, journal);
+}
 
-        futures.emplace_back(std::async(std::launch::async, [=](){
-            return downloadFile(remoteFilePath, localFilePath, filterKeywords);
-        }));
+bool FTPClient::resumeBatch(const std::string& journalPath)
+{
+    std::shared_ptr<FTPTransferJournal> journal = std::make_shared<FTPTransferJournal>(journalPath);
+    if (!journal->load()) {
+        return false;
     }
 
-    bool allSucceeded = true;
-    for (auto& future : futures) {
-        if(future.get() != FTP_OK)
-            allSucceeded = false;
+    return downloadBatch(journal->pendingDirectories(), journal->pendingFiles(), journal->localRoot(), journal->filterKeywords(), journal);
+}
+
+bool FTPClient::downloadBatch(const std::vector<std::string>& remoteFolderPaths, const std::vector<FTPTransferJournal::File>& files,
+                              const std::string& localFolderPath, const std::vector<std::string>& filterKeywords,
+                              std::shared_ptr<FTPTransferJournal> journal)
+{
+    beginBatch();
+    FTPTransferEngine::Batch batch;
+
+    auto download = [&](const FTPFileInfo& file, const std::string& localFilePath) {
+        std::string remoteFilePath = file.path + file.fileName;
+        batch.add();
+        scheduleDownload(remoteFilePath, localFilePath, filterKeywords, file.fileSize, [this, file, localFilePath, journal, &batch](FTP_Code res) {
+            if (res == FTP_OK || res == REMOTE_FILE_DELE_FAILED) {
+                recordDownloadedFile(file);
+            }
+            if (journal) {
+                if (res == FTP_OK || res == REMOTE_FILE_DELE_FAILED || res == FILENAME_CONTAINS_KEYWORD) {
+                    journal->fileCompleted(file.path + file.fileName);
+                } else {
+                    journal->fileFailed(file.path + file.fileName, getLocalFileSize(localFilePath + partialSuffix_));
+                }
+            }
+            batch.done(res == FTP_OK);
+        });
+    };
+
+    // 日志中未完成的文件直接下载，从临时文件的末尾续传
+    for (const FTPTransferJournal::File& entry : files) {
+        FTPFileInfo file;
+        size_t separator = entry.remotePath.find_last_of('/');
+        file.path = entry.remotePath.substr(0, separator + 1);
+        file.fileName = entry.remotePath.substr(separator + 1);
+        file.fileSize = entry.size;
+        file.modifyTime = entry.modifyTime;
+        download(file, entry.localPath);
     }
 
-    return allSucceeded;
+    // 目录列表与下载在引擎上重叠进行，每列出一个目录就立即开始下载其中的文件
+    walkRemoteFolder(remoteFolderPaths, [&](const FTPFileInfo& file) {
+        std::string localFilePath = localFolderPath + file.path + file.fileName;
+
+        if (isDownloaded(file)) {
+            return;
+        }
+        // 恢复时重新列出的目录中已在日志中的文件不再重复下载
+        if (journal && !journal->fileQueued(FTPTransferJournal::File{file.path + file.fileName, localFilePath, file.fileSize, file.modifyTime, 0})) {
+            return;
+        }
+        download(file, localFilePath);
+    }, batch, journal);
+
+    bool succeeded = batch.wait();
+    if (journal) {
+        journal->finish();
+    }
+    progress_.endBatch();
+    return succeeded;
 }
 
 // 实现上传文件的函数
 FTPClient::FTP_Code FTPClient::uploadFile(const std::string& localFilePath, const std::string& remoteFilePath)
 {
+    UploadTask task;
+    initUploadTask(task, localFilePath, remoteFilePath);
+    return performUpload(task);
+}
+
+FTPClient::FTP_Code FTPClient::performUpload(UploadTask& task)
+{
+    FTPConnectionPool::Lease lease;
+    CURL* curlUpload = NULL;
 
-    std::string sanitizedRemotePath = remoteFilePath;
-    std::string sanitizedLocalPath = localFilePath;
+    FTP_Code res = FTP_FAILED;
+    while (true) {
+        lease = connectionPool_->acquire();
+        if (!lease) {
+            return INITIALIZATION_FAILED;
+        }
+        curlUpload = lease.get();
 
-    sanitizePath(sanitizedRemotePath);
-    sanitizePath(sanitizedLocalPath);
+        // 重试时重新查询远程文件大小，从上次中断的位置续传
+        if (task.directoryReady) {
+            curl_easy_setopt(curlUpload, CURLOPT_FTP_FILEMETHOD, (long)CURLFTPMETHOD_NOCWD);
+        }
+        task.remoteSize = getRemoteFileSize(curlUpload, task.remotePath);
+        task.remoteChecksum.clear();
+        if (needsRemoteChecksum(task)) {
+            ChecksumQuery query;
+            initChecksumQuery(query, task.remotePath, true);
+            fetchRemoteChecksum(curlUpload, query);
+            task.remoteChecksum = query.value;
+        }
 
-    // 在开头添加 /
-    if (sanitizedRemotePath.empty() || sanitizedRemotePath[0] != '/') {
-        sanitizedRemotePath.insert(0, "/");
+        res = prepareUpload(curlUpload, task);
+        if (res != FTP_OK) {
+            return res;
+        }
+
+        CURLcode result = curl_easy_perform(curlUpload);
+        res = finishUpload(curlUpload, task, result);
+
+        bool freshConnect = false;
+        std::chrono::milliseconds delay(0);
+        if (res == FTP_OK || !retryAfterFailure(curlUpload, result, task.localPath, task.attempts, freshConnect, delay)) {
+            break;
+        }
+        if (freshConnect) {
+            lease.discard();
+        }
+        lease.release();
+        std::this_thread::sleep_for(delay);
     }
 
-    std::ifstream file(sanitizedLocalPath, std::ios::in | std::ios::binary);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open local file: " << sanitizedLocalPath << std::endl;
-        return LOCAL_FILE_OPEN_FAILED;
+    if (res == FTP_OK && task.checksum) {
+        res = verifyUpload(curlUpload, task);
     }
+    return res;
+}
+
+FTPClient::FTP_Code FTPClient::uploadFile(const void* data, size_t size, const std::string& remoteFilePath)
+{
+    return uploadFromSource(std::unique_ptr<FTPFileSource>(new FTPMemorySource(static_cast<const char*>(data), size)), remoteFilePath);
+}
+
+FTPClient::FTP_Code FTPClient::uploadFile(FTPCallbackSource::ReadFunction source, const std::string& remoteFilePath, curl_off_t size)
+{
+    return uploadFromSource(std::unique_ptr<FTPFileSource>(new FTPCallbackSource(source, size)), remoteFilePath);
+}
+
+FTPClient::FTP_Code FTPClient::uploadFromSource(std::unique_ptr<FTPFileSource> source, const std::string& remoteFilePath)
+{
+    UploadTask task;
+    initUploadTask(task, std::string(), remoteFilePath);
+    task.file = std::move(source);
+    task.inMemory = true;
 
-    CURL* curlUpload = curl_easy_init();
-    if (!curlUpload) {
+    FTPConnectionPool::Lease lease = connectionPool_->acquire();
+    if (!lease) {
         return INITIALIZATION_FAILED;
     }
+    CURL* curlUpload = lease.get();
+
+    FTP_Code res = prepareUpload(curlUpload, task);
+    if (res != FTP_OK) {
+        return res;
+    }
+
+    CURLcode result = curl_easy_perform(curlUpload);
+
+    res = finishUpload(curlUpload, task, result);
+    if (res == FTP_OK && task.checksum) {
+        res = verifyUpload(curlUpload, task);
+    }
+    return res;
+}
+
+void FTPClient::initUploadTask(UploadTask& task, const std::string& localFilePath, const std::string& remoteFilePath)
+{
+    task.localPath = localFilePath;
+    task.remotePath = remoteFilePath;
+    task.localSize = 0;
+    task.remoteSize = 0;
+    task.progressKey = -1;
+    task.inMemory = false;
+    task.overwrite = false;
+    task.sidecar = false;
+    task.position = 0;
+    task.hashed = 0;
+    task.directoryReady = false;
+    task.expectedSize = -1;
+    task.priority = 0;
+    task.attempts = 0;
+    task.freshConnect = false;
+
+    sanitizePath(task.remotePath);
+    sanitizePath(task.localPath);
+
+    // 在开头添加 /
+    if (task.remotePath.empty() || task.remotePath[0] != '/') {
+        task.remotePath.insert(0, "/");
+    }
+}
+
+FTPClient::FTP_Code FTPClient::prepareUpload(CURL* curl, UploadTask& task)
+{
+    if (!task.inMemory) {
+        task.file = FTPFileSource::create();
+    }
+    if (!task.file->open(task.localPath)) {
+        task.file.reset();
+        std::cerr << "Failed to open local file: " << task.localPath << std::endl;
+        return LOCAL_FILE_OPEN_FAILED;
+    }
 
-    curl_easy_setopt(curlUpload, CURLOPT_USERNAME, username_.c_str());
-    curl_easy_setopt(curlUpload, CURLOPT_PASSWORD, password_.c_str());
+    task.localSize = static_cast<off_t>(task.file->size());
 
-    size_t remoteFileSize = getRemoteFileSize(curlUpload, sanitizedRemotePath);
-    size_t localFileSize = getLocalFileSize(sanitizedLocalPath);
+    bool verify = checksumAlgorithm_ != FTPChecksum::None && !task.sidecar;
 
-    if (localFileSize <= remoteFileSize) {
-        std::cout << "Local file size is the same as remote file size. No need to upload." << std::endl;
-        curl_easy_cleanup(curlUpload);
-        return REMOTE_AND_LOCAL_FILE_IDENTICAL;
+    if (!task.inMemory && !task.overwrite && task.localSize <= task.remoteSize) {
+        bool identical = true;
+        if (verify && task.localSize < task.remoteSize) {
+            // 远程文件比本地文件大，内容不可能相同
+            identical = false;
+        } else if (verify && !task.remoteChecksum.empty()) {
+            // 大小相同时比较本地文件的校验和，需要额外读一遍本地文件
+            FTPChecksum local(checksumAlgorithm_);
+            identical = !local.updateFromFile(task.localPath, -1) || FTPChecksum::equals(local.hex(), task.remoteChecksum);
+        }
+
+        if (identical) {
+            std::cout << "Local file size is the same as remote file size. No need to upload." << std::endl;
+            task.file.reset();
+            return REMOTE_AND_LOCAL_FILE_IDENTICAL;
+        }
+        std::cout << "Remote file differs from local file, uploading again: " << task.remotePath << std::endl;
+        task.remoteSize = 0;
     }
 
     // 设置偏移量，断点续传
-    curl_easy_setopt(curlUpload, CURLOPT_RESUME_FROM, remoteFileSize);
+    if (task.remoteSize > 0) {
+        curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)task.remoteSize);
+    }
 
-    curl_easy_setopt(curlUpload, CURLOPT_URL, ("ftp://" + host_ + "/" + replaceSpacesWithPercent20(sanitizedRemotePath)).c_str());
-    curl_easy_setopt(curlUpload, CURLOPT_UPLOAD, 1L);
-    curl_easy_setopt(curlUpload, CURLOPT_FTP_CREATE_MISSING_DIRS, 1L);      // 如果不存在则自动创建该目录
-    curl_easy_setopt(curlUpload, CURLOPT_READFUNCTION, readCallback);
-    curl_easy_setopt(curlUpload, CURLOPT_READDATA, &file);
+    task.checksum.reset();
+    task.position = 0;
+    task.hashed = 0;
+    if (verify) {
+        task.checksum.reset(new FTPChecksum(checksumAlgorithm_));
+        // 续传时远程已有的部分需要从本地文件读一遍，其余部分在读回调中累计
+        if (task.remoteSize > 0 && !task.checksum->updateFromFile(task.localPath, task.remoteSize)) {
+            task.checksum.reset();
+        }
+        task.hashed = task.remoteSize;
+    }
 
-    // 设置CURLOPT_NOPROGRESS为0，以启用进度回调函数
-    // 设置CURLOPT_PROGRESSFUNCTION为progressCallback函数指针，用于获取上传进度
-    long proKey = taskProgress.size();
-    do{
-        std::lock_guard<std::mutex> lock(mutex);
-        taskProgress[proKey] = FileTransferInfo();
-    }while(false);
-    taskProgress[proKey].filename = sanitizedLocalPath;
-    taskProgress[proKey].totalSize = localFileSize;
-    taskProgress[proKey].transferType = Upload;
+    curl_easy_setopt(curl, CURLOPT_URL, ("ftp://" + host_ + "/" + replaceSpacesWithPercent20(task.remotePath)).c_str());
+    curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+    if (task.directoryReady) {
+        // 目录已预先创建，以完整路径STOR，省去每个文件的CWD
+        curl_easy_setopt(curl, CURLOPT_FTP_FILEMETHOD, (long)CURLFTPMETHOD_NOCWD);
+        curl_easy_setopt(curl, CURLOPT_FTP_CREATE_MISSING_DIRS, 0L);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_FTP_FILEMETHOD, (long)CURLFTPMETHOD_SINGLECWD);
+        curl_easy_setopt(curl, CURLOPT_FTP_CREATE_MISSING_DIRS, 1L);      // 如果不存在则自动创建该目录
+    }
+    if (task.checksum) {
+        curl_easy_setopt(curl, CURLOPT_READFUNCTION, uploadReadCallback);
+        curl_easy_setopt(curl, CURLOPT_READDATA, &task);
+        curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, uploadSeekCallback);
+        curl_easy_setopt(curl, CURLOPT_SEEKDATA, &task);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_READFUNCTION, FTPFileSource::readCallback);
+        curl_easy_setopt(curl, CURLOPT_READDATA, task.file.get());
+        curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, FTPFileSource::seekCallback);
+        curl_easy_setopt(curl, CURLOPT_SEEKDATA, task.file.get());
+    }
+    if (task.localSize >= 0) {
+        curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)task.localSize);
+    }
+    if (sendBufferSize_ > 0) {
+        curl_easy_setopt(curl, CURLOPT_UPLOAD_BUFFERSIZE, sendBufferSize_);
+    }
+    if (task.freshConnect) {
+        curl_easy_setopt(curl, CURLOPT_FRESH_CONNECT, 1L);
+        task.freshConnect = false;
+    }
 
-    curl_easy_setopt(curlUpload, CURLOPT_PROGRESSDATA, &taskProgress[proKey]);
-    curl_easy_setopt(curlUpload,CURLOPT_PROGRESSFUNCTION , progressCallback);
-    curl_easy_setopt(curlUpload,CURLOPT_NOPROGRESS , 0L);
+    const std::string& name = task.inMemory ? task.remotePath : task.localPath;
+    curl_off_t totalSize = task.localSize >= 0 ? (curl_off_t)(task.localSize - task.remoteSize) : 0;
+    task.progressKey = beginProgress(curl, name, Upload, totalSize);
 
-    CURLcode result = curl_easy_perform(curlUpload);
+    return FTP_OK;
+}
 
-    file.close();
+FTPClient::FTP_Code FTPClient::finishUpload(CURL* curl, UploadTask& task, CURLcode result)
+{
+    metrics_.record(FTPTransferMetrics::Upload, curl, result);
+
+    task.file.reset();
+    endProgress(task.progressKey);
+    task.progressKey = -1;
+    invalidateListing(task.remotePath);
+
+    if (result != CURLE_OK && task.directoryReady) {
+        // 目录可能已被删除或没有创建成功，下次重新创建
+        std::lock_guard<std::mutex> lock(directoryMutex_);
+        remoteDirectories_.erase(remoteParentDirectory(task.remotePath));
+    }
 
     FTP_Code res = FTP_OK;
     if (result == CURLE_OK) {
         std::cout << "File uploaded successfully!" << std::endl;
         res = FTP_OK;
+        if (task.attempts > 0) {
+            progress_.recordRetry(FTPProgressTracker::Recovered);
+        }
     } else {
         res = FTP_FAILED;
-        std::cerr << "Failed to upload file: " << sanitizedLocalPath << std::endl;
+        std::cerr << "Failed to upload file: " << (task.inMemory ? task.remotePath : task.localPath) << std::endl;
     }
 
-    curl_easy_cleanup(curlUpload);
+    return res;
+}
 
-    do{
-        std::lock_guard<std::mutex> lock(mutex);
-        auto it = taskProgress.find(proKey);
-        if(it != taskProgress.end())
-            taskProgress.erase(it);
-    }while(false);
+void FTPClient::scheduleUpload(std::shared_ptr<UploadTask> task, std::function<void(FTP_Code)> onFinished,
+                               std::chrono::milliseconds delay)
+{
+    // 先在控制连接上查询远程文件大小，查询结束后再提交上传任务
+    std::shared_ptr<RemoteFileStat> stat = std::make_shared<RemoteFileStat>();
+
+    // 查询只在控制连接上进行，按不传输数据的小任务排队
+    FTPTransferEngine::Job probe;
+    probe.control = task->control;
+    probe.size = 0;
+    probe.priority = task->priority;
+    probe.prepare = [this, task, stat](CURL* curl) {
+        prepareRemoteFileStat(curl, task->remotePath, stat.get());
+        if (task->directoryReady) {
+            curl_easy_setopt(curl, CURLOPT_FTP_FILEMETHOD, (long)CURLFTPMETHOD_NOCWD);
+        }
+        if (task->freshConnect) {
+            // 查询时建立的新连接留在缓存中供随后的上传复用
+            curl_easy_setopt(curl, CURLOPT_FRESH_CONNECT, 1L);
+            task->freshConnect = false;
+        }
+        return true;
+    };
+    probe.complete = [this, task, stat, onFinished](CURL* curl, CURLcode result) {
+        if (curl == NULL) {
+            onFinished(FTP_FAILED);
+            return;
+        }
+        task->remoteSize = 0;
+        task->remoteChecksum.clear();
+        if (remoteFileStatResult(curl, result, task->remotePath, *stat) && stat->fileSize > 0) {
+            task->remoteSize = static_cast<off_t>(stat->fileSize);
+        }
 
-    return res;
+        // 大小相同且开启校验时，先取得远程校验和再决定是否上传
+        if (needsRemoteChecksum(*task)) {
+            std::shared_ptr<ChecksumQuery> query = std::make_shared<ChecksumQuery>();
+            initChecksumQuery(*query, task->remotePath, true);
+            scheduleChecksumQuery(query, [this, task, query, onFinished]() {
+                task->remoteChecksum = query->value;
+                submitUploadTask(task, onFinished);
+            });
+            return;
+        }
+        submitUploadTask(task, onFinished);
+    };
+
+    if (delay.count() > 0) {
+        transferEngine().submitAfter(std::move(probe), delay);
+    } else {
+        transferEngine().submit(std::move(probe));
+    }
+}
+
+void FTPClient::submitUploadTask(std::shared_ptr<UploadTask> task, std::function<void(FTP_Code)> onFinished,
+                                 std::chrono::milliseconds delay)
+{
+    std::shared_ptr<FTP_Code> prepared = std::make_shared<FTP_Code>(FTP_FAILED);
+
+    FTPTransferEngine::Job upload;
+    upload.control = task->control;
+    upload.size = task->expectedSize;
+    upload.priority = task->priority;
+    upload.prepare = [this, task, prepared](CURL* curl) {
+        *prepared = prepareUpload(curl, *task);
+        return *prepared == FTP_OK;
+    };
+    upload.complete = [this, task, prepared, onFinished](CURL* curl, CURLcode result) {
+        if (*prepared != FTP_OK) {
+            onFinished(*prepared);
+            return;
+        }
+
+        FTP_Code res = finishUpload(curl, *task, result);
+        std::chrono::milliseconds delay(0);
+        if (res != FTP_OK && !task->inMemory &&
+            retryAfterFailure(curl, result, task->localPath, task->attempts, task->freshConnect, delay)) {
+            if (task->overwrite) {
+                // 失败时远程可能仍是旧文件，不能从其末尾续传
+                submitUploadTask(task, onFinished, delay);
+            } else {
+                scheduleUpload(task, onFinished, delay);
+            }
+            return;
+        }
+        if (res == FTP_OK && task->checksum) {
+            scheduleUploadVerification(task, onFinished);
+            return;
+        }
+        onFinished(res);
+    };
+
+    if (delay.count() > 0) {
+        transferEngine().submitAfter(std::move(upload), delay);
+    } else {
+        transferEngine().submit(std::move(upload));
+    }
 }
 
 bool FTPClient::uploadFolder(const std::string &localFolderPath, const std::string &remoteFolderPath)
@@ -659,16 +2574,31 @@ bool FTPClient::uploadFolder(const std::string &localFolderPath, const std::stri
     sanitizePath(sanitizedRemotePath);
     sanitizePath(sanitizedLocalPath);
 
+    beginBatch();
+
     std::vector<std::string> fileNames = listLocalFiles(sanitizedLocalPath);
-    for (std::string fileName : fileNames) {
+    std::vector<std::string> remoteFileNames;
+    std::set<std::string> directories;
+    for (std::string& fileName : fileNames) {
         sanitizePath(fileName);
-        std::string localFilePath = fileName;
         std::string remoteFilePath = fileName;
         remoteFilePath = sanitizedRemotePath + remoteFilePath.replace(0, sanitizedLocalPath.length(), "");
+        directories.insert(remoteParentDirectory(remoteFilePath));
+        remoteFileNames.push_back(remoteFilePath);
+    }
+
+    // 先一次创建所有目录，上传时不再逐个文件检查目录
+    directories.erase(std::string());
+    bool directoryReady = createRemoteDirectories(directories);
 
-        uploadFile(localFilePath, remoteFilePath);
+    for (size_t i = 0; i < fileNames.size(); ++i) {
+        UploadTask task;
+        initUploadTask(task, fileNames[i], remoteFileNames[i]);
+        task.directoryReady = directoryReady;
+        performUpload(task);
     }
 
+    progress_.endBatch();
     return true;
 }
 
@@ -681,24 +2611,456 @@ bool FTPClient::concurrentUploadFolder(const std::string &localFolderPath, const
     sanitizePath(sanitizedRemotePath);
     sanitizePath(sanitizedLocalPath);
 
-    std::vector<std::future<FTP_Code>> futures;
-    std::vector<std::string> fileNames = listLocalFiles(sanitizedLocalPath);
-    for (std::string fileName : fileNames) {
+    beginBatch();
+    FTPTransferEngine::Batch batch;
+
+    // 遍历线程每发现一个文件就提交上传，不必等整个目录树列完；文件大小在遍历线程中获取，用于排序
+    FTPLocalWalker walker(0, true);
+    bool listed = walker.walk(sanitizedLocalPath, [&](const FTPLocalWalker::Entry& entry) {
+        std::string localFilePath(entry.path);
+        sanitizePath(localFilePath);
+        std::string remoteFilePath = sanitizedRemotePath + localFilePath.substr(sanitizedLocalPath.length());
+
+        std::shared_ptr<UploadTask> task = std::make_shared<UploadTask>();
+        initUploadTask(*task, localFilePath, remoteFilePath);
+        task->expectedSize = entry.size;
+        task->priority = transferPriority(task->remotePath, entry.size);
+
+        // 目录未知时先与同时发现的其他目录一起创建，之后的上传不再检查目录
+        batch.add();
+        ensureRemoteDirectory(remoteParentDirectory(task->remotePath), [this, task, &batch](bool directoryReady) {
+            task->directoryReady = directoryReady;
+            scheduleUpload(task, [&batch](FTP_Code res) {
+                batch.done(res == FTP_OK);
+            });
+        });
+    });
+
+    bool succeeded = batch.wait() && listed;
+    progress_.endBatch();
+    return succeeded;
+}
+
+bool FTPClient::syncFolder(const std::string& localFolderPath, const std::string& remoteFolderPath, const SyncOptions& options,
+                           std::vector<SyncAction>* plan)
+{
+    std::string sanitizedRemotePath = remoteFolderPath;
+    std::string sanitizedLocalPath = localFolderPath;
+
+    sanitizePath(sanitizedRemotePath);
+    sanitizePath(sanitizedLocalPath);
+
+    bool toLocal = options.direction == SyncToLocal;
+    if (toLocal && !options.dryRun && !createLocalFolder(sanitizedLocalPath)) {
+        return false;
+    }
+
+    // 任一端列出不完整时不能判断哪些文件多余，直接放弃
+    std::map<std::string, SyncFile> localFiles;
+    std::map<std::string, SyncFile> remoteFiles;
+    if (!listLocalTree(sanitizedLocalPath, localFiles) || !listRemoteTree(sanitizedRemotePath, remoteFiles)) {
+        std::cerr << "Failed to list folders for sync: " << sanitizedLocalPath << " <-> " << sanitizedRemotePath << std::endl;
+        return false;
+    }
+
+    std::unique_ptr<FTPSyncState> state;
+    if (!options.statePath.empty()) {
+        state.reset(new FTPSyncState(options.statePath));
+    }
+
+    std::vector<SyncAction> actions;
+    std::vector<size_t> checksumCandidates;
+    planSync(localFiles, remoteFiles, options, state.get(), actions, checksumCandidates);
+
+    // 远程路径前缀与walkRemoteFolder生成的FTPFileInfo::path一致
+    std::string remotePrefix = "/" + (sanitizedRemotePath.empty() ? std::string() : sanitizedRemotePath + "/");
+    if (!checksumCandidates.empty()) {
+        compareSyncChecksums(sanitizedLocalPath, remotePrefix, actions, checksumCandidates);
+    }
+
+    if (options.dryRun) {
+        for (const SyncAction& action : actions) {
+            if (action.type == SyncTransfer) {
+                std::cout << (toLocal ? "download " : "upload ") << action.path << " (" << action.reason << ")" << std::endl;
+            } else if (action.type == SyncDelete) {
+                std::cout << (toLocal ? "delete local " : "delete remote ") << action.path << " (" << action.reason << ")" << std::endl;
+            }
+        }
+        if (plan) {
+            plan->swap(actions);
+        }
+        return true;
+    }
+
+    beginBatch();
+    FTPTransferEngine::Batch batch;
+    std::vector<std::string> noKeywords;
+    std::mutex resultMutex;
+
+    // 上传前一次创建计划中用到的所有远程目录
+    bool directoryReady = false;
+    if (!toLocal) {
+        std::set<std::string> directories;
+        for (const SyncAction& action : actions) {
+            if (action.type == SyncTransfer) {
+                directories.insert(remoteParentDirectory(sanitizedRemotePath + "/" + action.path));
+            }
+        }
+        directories.erase(std::string());
+        directoryReady = createRemoteDirectories(directories);
+    }
+
+    for (size_t i = 0; i < actions.size(); ++i) {
+        SyncAction* action = &actions[i];
+        std::string localPath = sanitizedLocalPath + "/" + action->path;
+        std::string remotePath = remotePrefix + action->path;
+
+        auto localIt = localFiles.find(action->path);
+        auto remoteIt = remoteFiles.find(action->path);
+        SyncFile local = localIt != localFiles.end() ? localIt->second : SyncFile{-1, -1};
+        SyncFile remote = remoteIt != remoteFiles.end() ? remoteIt->second : SyncFile{-1, -1};
+
+        auto finish = [this, action, &batch, &resultMutex](FTP_Code res) {
+            do{
+                std::lock_guard<std::mutex> lock(resultMutex);
+                action->result = res;
+            }while(false);
+            batch.done(res == FTP_OK);
+        };
+
+        if (action->type == SyncSkip) {
+            // 刷新记录，上传后尚未观测到的远程修改时间在这里补上
+            if (state) {
+                state->record(action->path, FTPSyncState::Entry{local.size, local.modifyTime, remote.size, remote.modifyTime});
+            }
+        } else if (action->type == SyncDelete) {
+            if (state) {
+                state->erase(action->path);
+            }
+            batch.add();
+            if (toLocal) {
+                if (remove(localPath.c_str()) == 0) {
+                    finish(FTP_OK);
+                } else {
+                    std::cerr << "Failed to delete local file: " << localPath << std::endl;
+                    finish(FTP_FAILED);
+                }
+            } else {
+                scheduleDelete(remotePath, finish);
+            }
+        } else if (toLocal) {
+            std::shared_ptr<DownloadTask> task = std::make_shared<DownloadTask>();
+            FTP_Code res = initDownloadTask(*task, remotePath, localPath, noKeywords);
+            batch.add();
+            if (res != FTP_OK) {
+                finish(res);
+                continue;
+            }
+            // 本地已有的是旧内容，不能从其末尾续传
+            task->restart = true;
+            task->expectedSize = remote.size;
+            task->priority = transferPriority(task->remotePath, remote.size);
+            FTPSyncState* syncState = state.get();
+            std::string path = action->path;
+            submitDownloadTask(task, [this, syncState, path, localPath, remote, finish](FTP_Code res) {
+                SyncFile downloaded;
+                if (res == FTP_OK && syncState && statLocalFile(localPath, downloaded)) {
+                    syncState->record(path, FTPSyncState::Entry{downloaded.size, downloaded.modifyTime, remote.size, remote.modifyTime});
+                }
+                finish(res);
+            });
+        } else {
+            std::shared_ptr<UploadTask> task = std::make_shared<UploadTask>();
+            initUploadTask(*task, localPath, sanitizedRemotePath + "/" + action->path);
+            // 远程已有的是旧内容，从头覆盖
+            task->overwrite = true;
+            task->directoryReady = directoryReady;
+            task->expectedSize = local.size;
+            task->priority = transferPriority(task->remotePath, local.size);
+            FTPSyncState* syncState = state.get();
+            std::string path = action->path;
+            batch.add();
+            submitUploadTask(task, [syncState, path, local, finish](FTP_Code res) {
+                if (res == FTP_OK && syncState) {
+                    syncState->record(path, FTPSyncState::Entry{local.size, local.modifyTime, local.size, -1});
+                }
+                finish(res);
+            });
+        }
+    }
+
+    bool succeeded = batch.wait();
+    progress_.endBatch();
+
+    if (state) {
+        // 只保留源端仍存在的路径
+        const std::map<std::string, SyncFile>& source = toLocal ? remoteFiles : localFiles;
+        state->prune([&source](const std::string& path) {
+            return source.find(path) != source.end();
+        });
+        state->save();
+    }
+
+    if (plan) {
+        plan->swap(actions);
+    }
+    return succeeded;
+}
+
+bool FTPClient::listLocalTree(const std::string& localFolderPath, std::map<std::string, SyncFile>& files)
+{
+    struct stat st;
+    if (stat(localFolderPath.c_str(), &st) != 0) {
+        // 本地文件夹不存在时视为空，如预演同步到尚未创建的本地文件夹
+        return errno == ENOENT;
+    }
+
+    std::mutex mutex;
+    FTPLocalWalker walker(0, true);
+    return walker.walk(localFolderPath, [&](const FTPLocalWalker::Entry& entry) {
+        // 中断的下载留下的临时文件不参与同步
+        if (!partialSuffix_.empty() && entry.name.size() > partialSuffix_.size() &&
+            entry.name.compare(entry.name.size() - partialSuffix_.size(), partialSuffix_.size(), partialSuffix_) == 0) {
+            return;
+        }
+        std::string fileName(entry.path);
         sanitizePath(fileName);
-        std::string localFilePath = fileName;
-        std::string remoteFilePath = fileName;
-        remoteFilePath = sanitizedRemotePath + remoteFilePath.replace(0, sanitizedLocalPath.length(), "");
+        std::lock_guard<std::mutex> lock(mutex);
+        files[fileName.substr(localFolderPath.length() + 1)] = SyncFile{entry.size, entry.modifyTime};
+    });
+}
+
+bool FTPClient::listRemoteTree(const std::string& remoteFolderPath, std::map<std::string, SyncFile>& files)
+{
+    std::string prefix = "/" + (remoteFolderPath.empty() ? std::string() : remoteFolderPath + "/");
+    std::mutex mutex;
+
+    FTPTransferEngine::Batch batch;
+    walkRemoteFolder({remoteFolderPath}, [&](const FTPFileInfo& file) {
+        std::string path = file.path + file.fileName;
+        if (path.compare(0, prefix.length(), prefix) != 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        files[path.substr(prefix.length())] = SyncFile{file.fileSize, file.modifyTime};
+    }, batch);
+
+    return batch.wait();
+}
+
+bool FTPClient::statLocalFile(const std::string& localFilePath, SyncFile& file)
+{
+    struct stat st;
+    if (stat(localFilePath.c_str(), &st) != 0) {
+        return false;
+    }
+    file.size = (curl_off_t)st.st_size;
+    file.modifyTime = st.st_mtime;
+    return true;
+}
+
+void FTPClient::planSync(const std::map<std::string, SyncFile>& local, const std::map<std::string, SyncFile>& remote,
+                         const SyncOptions& options, FTPSyncState* state, std::vector<SyncAction>& plan,
+                         std::vector<size_t>& checksumCandidates)
+{
+    bool toLocal = options.direction == SyncToLocal;
+    bool compareChecksum = options.compareChecksum && checksumAlgorithm_ != FTPChecksum::None;
+    const std::map<std::string, SyncFile>& source = toLocal ? remote : local;
+    const std::map<std::string, SyncFile>& target = toLocal ? local : remote;
+
+    for (const auto& item : source) {
+        SyncAction action;
+        action.path = item.first;
+        action.size = item.second.size;
+        action.result = FTP_OK;
+
+        auto it = target.find(item.first);
+        if (it == target.end()) {
+            action.type = SyncTransfer;
+            action.reason = "new";
+            plan.push_back(action);
+            continue;
+        }
+
+        const SyncFile& sourceFile = item.second;
+        const SyncFile& targetFile = it->second;
+        const SyncFile& localFile = toLocal ? targetFile : sourceFile;
+        const SyncFile& remoteFile = toLocal ? sourceFile : targetFile;
+        FTPSyncState::Entry entry;
+
+        if (state && state->matches(item.first, FTPSyncState::Entry{localFile.size, localFile.modifyTime, remoteFile.size, remoteFile.modifyTime})) {
+            // 两端都没有变化，不需要再比较
+            action.type = SyncSkip;
+            action.reason = "unchanged";
+        } else if (sourceFile.size != targetFile.size) {
+            action.type = SyncTransfer;
+            action.reason = "size changed";
+        } else {
+            // 大小相同：有记录说明至少一端在上次同步后被修改过；没有记录时目标端不比源端旧即视为一致
+            bool recorded = state && state->find(item.first, entry);
+            bool targetOlder = sourceFile.modifyTime >= 0 && targetFile.modifyTime >= 0 && targetFile.modifyTime < sourceFile.modifyTime;
+            if (recorded || targetOlder) {
+                action.type = SyncTransfer;
+                action.reason = "modified";
+            } else {
+                action.type = SyncSkip;
+                action.reason = "same size";
+            }
+            if (compareChecksum) {
+                checksumCandidates.push_back(plan.size());
+            }
+        }
+        plan.push_back(action);
+    }
+
+    if (options.deleteExtraneous) {
+        for (const auto& item : target) {
+            if (source.find(item.first) == source.end()) {
+                SyncAction action;
+                action.type = SyncDelete;
+                action.path = item.first;
+                action.size = item.second.size;
+                action.reason = "extraneous";
+                action.result = FTP_OK;
+                plan.push_back(action);
+            }
+        }
+    }
+}
+
+void FTPClient::compareSyncChecksums(const std::string& localRoot, const std::string& remotePrefix,
+                                     std::vector<SyncAction>& plan, const std::vector<size_t>& checksumCandidates)
+{
+    // 远程校验和在引擎上并发查询，本地文件在调用线程中读取，不占用传输线程
+    std::vector<std::shared_ptr<ChecksumQuery>> queries;
+    FTPTransferEngine::Batch batch;
+    for (size_t index : checksumCandidates) {
+        std::shared_ptr<ChecksumQuery> query = std::make_shared<ChecksumQuery>();
+        initChecksumQuery(*query, remotePrefix + plan[index].path, true);
+        queries.push_back(query);
+
+        batch.add();
+        scheduleChecksumQuery(query, [&batch]() {
+            batch.done(true);
+        });
+    }
+    batch.wait();
+
+    for (size_t i = 0; i < checksumCandidates.size(); ++i) {
+        const std::string& expected = queries[i]->value;
+        if (expected.empty()) {
+            // 取不到远程校验和，保留按修改时间做出的决定
+            continue;
+        }
+
+        SyncAction& action = plan[checksumCandidates[i]];
+        FTPChecksum local(checksumAlgorithm_);
+        if (!local.updateFromFile(localRoot + "/" + action.path, -1)) {
+            continue;
+        }
+        if (FTPChecksum::equals(local.hex(), expected)) {
+            action.type = SyncSkip;
+            action.reason = "checksum equal";
+        } else {
+            action.type = SyncTransfer;
+            action.reason = "checksum differs";
+        }
+    }
+}
+
+void FTPClient::setMaxConcurrentTransfers(size_t maxConcurrent)
+{
+    std::lock_guard<std::mutex> lock(engineMutex_);
+    maxConcurrentTransfers_ = maxConcurrent > 0 ? maxConcurrent : 1;
+    if (transferEngine_) {
+        transferEngine_->setMaxConcurrentTransfers(maxConcurrentTransfers_);
+    }
+}
 
-        futures.emplace_back(std::async(std::launch::async, [=](){
-            return uploadFile(localFilePath, remoteFilePath);
-        }));
+void FTPClient::setAdaptiveConcurrency(bool enabled, size_t minConcurrent, size_t maxConcurrent)
+{
+    std::lock_guard<std::mutex> lock(engineMutex_);
+    adaptiveConcurrency_ = enabled;
+    adaptiveMinTransfers_ = minConcurrent > 0 ? minConcurrent : 1;
+    adaptiveMaxTransfers_ = std::max(maxConcurrent, adaptiveMinTransfers_);
+    if (transferEngine_) {
+        transferEngine_->setAdaptiveConcurrency(adaptiveConcurrency_, adaptiveMinTransfers_, adaptiveMaxTransfers_);
+    }
+}
+
+void FTPClient::setSchedulingPolicy(SchedulingPolicy policy)
+{
+    std::lock_guard<std::mutex> lock(engineMutex_);
+    schedulingPolicy_ = policy;
+    if (transferEngine_) {
+        transferEngine_->setPolicy(schedulingPolicy_);
+    }
+}
+
+void FTPClient::setSmallFileLane(curl_off_t maxSize, size_t reservedSlots)
+{
+    std::lock_guard<std::mutex> lock(engineMutex_);
+    smallFileLimit_ = maxSize;
+    reservedSmallSlots_ = reservedSlots;
+    if (transferEngine_) {
+        transferEngine_->setSmallFileLane(smallFileLimit_, reservedSmallSlots_);
+    }
+}
+
+void FTPClient::setTransferPriority(PriorityFunction priority)
+{
+    std::lock_guard<std::mutex> lock(engineMutex_);
+    priorityFunction_ = priority;
+}
+
+int FTPClient::transferPriority(const std::string& remoteFilePath, curl_off_t size)
+{
+    PriorityFunction priority;
+    do{
+        std::lock_guard<std::mutex> lock(engineMutex_);
+        priority = priorityFunction_;
+    }while(false);
+    return priority ? priority(remoteFilePath, size) : 0;
+}
+
+FTPClient::QueueStats FTPClient::queueStats()
+{
+    return transferEngine().queueStats();
+}
+
+FTPDeleteQueue& FTPClient::deleteQueue()
+{
+    std::lock_guard<std::mutex> lock(engineMutex_);
+    if (!deleteQueue_) {
+        deleteQueue_.reset(new FTPDeleteQueue(connectionPool_));
     }
+    return *deleteQueue_;
+}
 
-    bool allSucceeded = true;
-    for (auto& future : futures) {
-        if(future.get() != FTP_OK)
-            allSucceeded = false;
+FTPTransferEngine& FTPClient::transferEngine()
+{
+    // 引擎线程在首次并发传输时才启动
+    std::lock_guard<std::mutex> lock(engineMutex_);
+    if (!transferEngine_) {
+        // 工作线程数按可能达到的最大并发数确定
+        size_t maxConcurrent = adaptiveConcurrency_ ? std::max(maxConcurrentTransfers_, adaptiveMaxTransfers_) : maxConcurrentTransfers_;
+        transferEngine_.reset(new FTPTransferEngine(connectionPool_, maxConcurrent));
+        transferEngine_->setMaxConcurrentTransfers(maxConcurrentTransfers_);
+        if (adaptiveConcurrency_) {
+            transferEngine_->setAdaptiveConcurrency(true, adaptiveMinTransfers_, adaptiveMaxTransfers_);
+        }
+        transferEngine_->setPolicy(schedulingPolicy_);
+        transferEngine_->setSmallFileLane(smallFileLimit_, reservedSmallSlots_);
     }
+    return *transferEngine_;
+}
 
-    return allSucceeded;
+long FTPClient::beginProgress(CURL* curl, const std::string& filename, TransferType type, curl_off_t totalSize)
+{
+    return progress_.begin(curl, filename, type == Upload ? FTPProgressTracker::Upload : FTPProgressTracker::Download, totalSize);
+}
+
+void FTPClient::endProgress(long proKey)
+{
+    progress_.end(proKey);
 }
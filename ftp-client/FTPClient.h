@@ -10,10 +10,42 @@
 #include <vector>
 #include <mutex>
 #include <map>
+#include <set>
+#include <unordered_set>
+#include <deque>
 #include <condition_variable>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <string_view>
+#include <future>
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define FTPCLIENT_COROUTINES 1
+#endif
+#endif
 
 #include <curl/curl.h>
 
+#include "FTPConnectionPool.h"
+#include "FTPTransferEngine.h"
+#include "FTPRetryPolicy.h"
+#include "FTPTransferMetrics.h"
+#include "FTPListParser.h"
+#include "FTPDownloadLedger.h"
+#include "FTPProgressTracker.h"
+#include "FTPFileSink.h"
+#include "FTPFileSource.h"
+#include "FTPChecksum.h"
+#include "FTPSyncState.h"
+#include "FTPLocalWalker.h"
+#include "FTPFileCatalog.h"
+#include "FTPListingCache.h"
+#include "FTPDeleteQueue.h"
+#include "FTPTransferJournal.h"
+
 /**
  * @brief FTP客户端类
  */
@@ -29,15 +61,18 @@ public:
         CREATE_FOLDER_FAILED,               /*  - 创建文件夹失败 */
         FILENAME_CONTAINS_KEYWORD,          /*  - 文件名中包含关键词，忽略下载此文件 */
         REMOTE_AND_LOCAL_FILE_IDENTICAL,    /* - 远程与本地文件大小一致，不传输。仅上传 */
-        REMOTE_FILE_DELE_FAILED             /* - 删除远端文件失败,文件已下载成功 */
+        REMOTE_FILE_DELE_FAILED,            /* - 删除远端文件失败,文件已下载成功 */
+        CHECKSUM_MISMATCH,                  /* - 传输完成但校验和与服务器或校验文件不一致，下载的本地文件已删除 */
+        TRANSFER_CANCELLED                  /* - 异步传输被调用方取消，已下载的部分保留在本地文件中 */
     };
 
     struct FTPFileInfo {
         std::string permissions;    // 文件权限
         std::string userGroup;      // 用户组
         std::string userName;       // 用户名
-        int fileSize;               // 文件大小
-        std::string date;           // 日期
+        curl_off_t fileSize;        // 文件大小
+        std::string date;           // 日期，服务器返回的原始文本
+        time_t modifyTime;          // 修改时间（UNIX时间），未知时为-1
         std::string fileName;       // 文件名
         std::string path;           // 路径
     };
@@ -49,13 +84,145 @@ public:
 
     struct FileTransferInfo {
         std::string filename;      // 文件名
-        long totalSize;            // 文件总大小
-        long transferredSize;      // 已传输大小
-        long remainingSize;        // 剩余大小
+        curl_off_t totalSize;      // 本次需要传输的大小，续传时不含已传输的部分
+        curl_off_t transferredSize;// 已传输大小
+        curl_off_t remainingSize;  // 剩余大小
         double transferProgress;   // 传输进度
         TransferType transferType; // 传输类型（上传或下载）
     };
 
+    typedef FTPProgressTracker::BatchSnapshot BatchProgress;
+
+    typedef FTPTransferMetrics::Snapshot TransferMetrics;
+
+    /**
+     * @brief 下载后删除远程文件的结果回调，在删除线程中调用
+     * @param remoteFilePath 远程文件路径
+     * @param deleted 是否删除成功
+     * @param reply 服务器对DELE的回复，连接失败时为空
+     */
+    typedef std::function<void(const std::string& remoteFilePath, bool deleted, const std::string& reply)> DeleteCallback;
+
+    /**
+     * @brief 并发文件夹传输中文件的优先级，大的先传输，在列出文件的线程中调用
+     * @param remoteFilePath 远程文件路径
+     * @param size 文件大小，未知时为-1
+     */
+    typedef std::function<int(const std::string& remoteFilePath, curl_off_t size)> PriorityFunction;
+
+    typedef FTPTransferEngine::Policy SchedulingPolicy;
+    typedef FTPTransferEngine::QueueStats QueueStats;
+
+    struct RemoteFileStat {
+        bool exists;               // 远程文件是否存在
+        bool resumable;            // 服务器是否接受REST，即是否支持断点续传
+        curl_off_t fileSize;       // 文件大小，服务器不支持SIZE时为-1
+        time_t modifyTime;         // 修改时间（UNIX时间），服务器不支持MDTM时为-1
+    };
+
+    enum SyncDirection {
+        SyncToLocal,               // 以远程文件夹为准更新本地文件夹
+        SyncToRemote               // 以本地文件夹为准更新远程文件夹
+    };
+
+    struct SyncOptions {
+        SyncDirection direction;   // 同步方向
+        bool deleteExtraneous;     // 删除目标端多出的文件
+        bool compareChecksum;      // 大小相同但无法由状态记录判断时比较校验和，须先调用setChecksumVerification，取不到远程校验和时退回比较修改时间
+        bool dryRun;               // 只生成计划，不传输也不删除
+        std::string statePath;     // 状态快照文件，为空时不使用
+
+        SyncOptions() : direction(SyncToLocal), deleteExtraneous(false), compareChecksum(false), dryRun(false) {}
+    };
+
+    enum SyncActionType {
+        SyncTransfer,              // 传输到目标端
+        SyncDelete,                // 删除目标端的文件
+        SyncSkip                   // 两端一致，跳过
+    };
+
+    struct SyncAction {
+        SyncActionType type;       // 操作
+        std::string path;          // 相对于同步根目录的路径
+        curl_off_t size;           // 源端文件大小，删除时为目标端文件大小
+        std::string reason;        // 原因：new, size changed, modified, checksum differs, unchanged, same size, checksum equal, extraneous
+        FTP_Code result;           // 执行结果，预演和跳过时为FTP_OK
+    };
+
+    /**
+     * @brief 异步传输的句柄，由submitDownload和submitUpload返回
+     *
+     * 传输在传输引擎上进行，提交后立即返回。完成回调在引擎线程中调用，不应执行阻塞操作。
+     * cancel、pause和resume可在任意线程调用，须在FTPClient析构之前；FTPClient析构时未完成的传输被中止。
+     */
+    class Transfer
+    {
+    public:
+        /**
+         * @brief 传输结果，可复制给多个等待者
+         */
+        std::shared_future<FTP_Code> future() const { return future_; }
+
+        /**
+         * @brief 阻塞等待传输结束
+         * @return 返回状态号
+         */
+        FTP_Code wait() const { return future_.get(); }
+
+        /**
+         * @brief 传输是否已结束
+         */
+        bool finished();
+
+        /**
+         * @brief 添加完成回调，传输已结束时立即在调用线程中调用
+         * @param callback 完成回调
+         */
+        void then(std::function<void(FTP_Code)> callback);
+
+        /**
+         * @brief 取消传输，等待中的传输不再执行，进行中的传输被中止，结果为TRANSFER_CANCELLED
+         */
+        void cancel();
+
+        /**
+         * @brief 暂停传输。等待中的传输暂不开始；进行中的传输停止收发，但保留连接并占用一个并发名额，
+         *        暂停过久时服务器可能关闭连接
+         */
+        void pause();
+
+        /**
+         * @brief 恢复暂停的传输
+         */
+        void resume();
+
+        bool paused() const { return control_->paused; }
+
+    private:
+        friend class FTPClient;
+
+        explicit Transfer(FTPTransferEngine* engine);
+
+        /**
+         * @brief 设置结果并调用完成回调
+         * @param res 状态号
+         */
+        void finish(FTP_Code res);
+
+    private:
+        FTPTransferEngine* engine_;                                 ///< 执行传输的引擎
+        std::shared_ptr<FTPTransferEngine::Control> control_;      ///< 取消和暂停标志
+        std::promise<FTP_Code> promise_;
+        std::shared_future<FTP_Code> future_;
+
+        std::mutex mutex_;
+        bool finished_;                                             ///< 是否已结束
+        FTP_Code result_;                                           ///< 传输结果
+        std::vector<std::function<void(FTP_Code)>> callbacks_;      ///< 完成回调
+    };
+
+    typedef std::shared_ptr<Transfer> TransferHandle;
+
 public:
     /**
      * @brief 构造函数
@@ -70,6 +237,14 @@ public:
      */
     ~FTPClient();
 
+    /**
+     * @brief 通过控制连接上的SIZE/MDTM/REST查询远程文件的大小和修改时间，不打开数据连接
+     * @param remoteFilePath 远程文件路径
+     * @param stat 查询结果
+     * @return 查询成功返回true，文件不存在或连接失败返回false
+     */
+    bool getRemoteFileStat(const std::string& remoteFilePath, RemoteFileStat& stat);
+
     /**
      * @brief 判断FTP服务器是否支持断点续传
      * @param curl CURL对象
@@ -108,9 +283,9 @@ public:
     bool createLocalFolder(const std::string& localFolderPath);
 
     /**
-     * @brief 创建远程文件夹
+     * @brief 创建远程文件夹，逐级发送MKD，已存在的上级目录不视为失败
      * @param remoteDirectoryPath 远程文件夹路径
-     * @return 如果创建成功，则返回true，否则返回false
+     * @return 文件夹创建成功或已存在时返回true，否则返回false
      */
     bool createRemoteDirectory(const std::string& remoteDirectoryPath);
 
@@ -121,6 +296,14 @@ public:
      */
     std::vector<FTPFileInfo> listRemoteFiles(const std::string& remoteFolderPath);
 
+    /**
+     * @brief 列出远程文件夹下的所有文件，直接添加到按列存储的文件目录中，适合数百万文件的目录树
+     * @param remoteFolderPath 远程文件夹路径
+     * @param catalog 文件目录，新文件追加到末尾
+     * @return 所有目录都列出成功时返回true
+     */
+    bool listRemoteFiles(const std::string& remoteFolderPath, FTPFileCatalog& catalog);
+
     /**
      * @brief 列出本地指定文件夹下的文件列表
      * @param localFolderPath 远程文件夹路径
@@ -129,10 +312,29 @@ public:
     std::vector<std::string> listLocalFiles(const std::string& localFolderPath);
 
     /**
-     * @brief 获取传输正在传输文件信息
+     * @brief 获取正在传输文件的进度快照，不会阻塞传输
      * @return 传输文件信息
      */
-    std::map<int, FileTransferInfo>* getFileTransferInfoAddr();
+    std::vector<FileTransferInfo> getFileTransferInfo();
+
+    /**
+     * @brief 获取当前批次（文件夹传输）的累计字节数、平均速率、滑动平均速率、预计剩余时间和当前并发数
+     * @return 批次进度
+     */
+    BatchProgress getBatchProgress();
+
+    /**
+     * @brief 获取本客户端创建以来所有传输的分阶段耗时统计（新建连接的连接和登录、复用连接的EPSV/PASV协商、传输命令、首字节、数据传输）和速率，
+     *        按下载、上传、目录列表和控制命令分别统计，可用toPrometheus或toJson导出，不会阻塞传输
+     * @return 统计快照
+     */
+    TransferMetrics getTransferMetrics();
+
+    /**
+     * @brief 获取当前批次（或最近一个批次）开始以来的分阶段耗时统计，summary()给出每种操作各阶段的中位数和P90
+     * @return 统计快照
+     */
+    TransferMetrics getBatchMetrics();
 
     /**
      * @brief 下载文件到本地
@@ -143,6 +345,35 @@ public:
      */
     FTP_Code downloadFile(const std::string &remoteFilePath, const std::string &localFilePath, const std::vector<std::string>& filterKeywords);
 
+    /**
+     * @brief 下载文件，内容交给回调函数，不写入本地文件
+     * @param remoteFilePath 远程文件路径
+     * @param sink 数据回调，在传输线程中按顺序调用，返回false中止下载
+     * @return 返回状态号
+     */
+    FTP_Code downloadFile(const std::string &remoteFilePath, FTPCallbackSink::WriteFunction sink);
+
+    /**
+     * @brief 下载文件到内存
+     * @param remoteFilePath 远程文件路径
+     * @param buffer 接收文件内容的字符串，下载前清空，按远程文件大小预留空间
+     * @return 返回状态号
+     */
+    FTP_Code downloadFile(const std::string &remoteFilePath, std::string& buffer);
+
+    /**
+     * @brief 分段并发下载单个大文件，按字节范围拆分后在多个连接上同时下载，直接写入预分配的本地文件
+     *
+     * 服务器不支持REST、文件大小未知或文件过小时退回单连接下载。分段下载总是重新下载整个文件。
+     * @param remoteFilePath 远程文件路径
+     * @param localFilePath 本地文件路径
+     * @param filterKeywords 过滤条件列表，当下载文件名包含关键词时不下载
+     * @param segmentCount 分段数量
+     * @return 返回状态号
+     */
+    FTP_Code segmentedDownloadFile(const std::string &remoteFilePath, const std::string &localFilePath,
+                                   const std::vector<std::string>& filterKeywords, size_t segmentCount = 4);
+
     /**
      * @brief 下载整个FTP服务器文件夹到本地
      * @param remoteFolderPath 远程文件夹路径
@@ -161,6 +392,16 @@ public:
      */
     bool concurrentDownloadFolder(const std::string& remoteFolderPath, const std::string& localFolderPath, const std::vector<std::string>& filterKeywords);
 
+    /**
+     * @brief 继续被中断的并发文件夹下载，只下载日志中未完成的文件、只列出日志中未列出的目录
+     *
+     * 日志由setTransferJournal设置后的concurrentDownloadFolder写入，其中记录了路径和过滤关键词，
+     * 未完成的文件从其临时文件的末尾续传。全部完成后删除日志文件，仍有失败的文件时保留日志，可再次调用。
+     * @param journalPath 日志文件路径
+     * @return 全部完成返回true，日志无法读取或仍有失败的文件时返回false
+     */
+    bool resumeBatch(const std::string& journalPath);
+
     /**
      * @brief 上传文件到FTP服务器
      * @param localFilePath 本地文件路径
@@ -169,6 +410,24 @@ public:
      */
     FTP_Code uploadFile(const std::string& localFilePath, const std::string& remoteFilePath);
 
+    /**
+     * @brief 上传内存中的数据到FTP服务器，覆盖远程文件
+     * @param data 数据
+     * @param size 字节数
+     * @param remoteFilePath 远程文件路径
+     * @return 返回状态号
+     */
+    FTP_Code uploadFile(const void* data, size_t size, const std::string& remoteFilePath);
+
+    /**
+     * @brief 上传由回调函数逐块生成的数据到FTP服务器，覆盖远程文件
+     * @param source 数据回调，在传输线程中调用，每次最多写入缓冲区大小的数据，返回0表示数据结束
+     * @param remoteFilePath 远程文件路径
+     * @param size 数据总大小，未知时为-1，仅用于进度显示
+     * @return 返回状态号
+     */
+    FTP_Code uploadFile(FTPCallbackSource::ReadFunction source, const std::string& remoteFilePath, curl_off_t size = -1);
+
     /**
      * @brief 下载整个FTP服务器文件夹到本地
      * @param localFolderPath 本地文件夹路径
@@ -185,83 +444,947 @@ public:
      */
     bool concurrentUploadFolder(const std::string& localFolderPath, const std::string& remoteFolderPath);
 
+    /**
+     * @brief 增量同步文件夹。两端各列出一次（远程目录在传输引擎上并行列出），按大小和修改时间比较，
+     *        只传输新增和变化的文件，可选删除目标端多出的文件。设置状态文件后，两端都与上次同步结果一致的文件
+     *        直接跳过；没有记录时大小相同且目标端不比源端旧的文件视为一致。任一端列出失败时不做任何修改
+     * @param localFolderPath 本地文件夹路径
+     * @param remoteFolderPath 远程文件夹路径
+     * @param options 同步选项
+     * @param plan 不为NULL时接收同步计划和每项的执行结果
+     * @return 所有操作都成功时返回true
+     */
+    bool syncFolder(const std::string& localFolderPath, const std::string& remoteFolderPath, const SyncOptions& options,
+                    std::vector<SyncAction>* plan = NULL);
+
+    /**
+     * @brief 异步下载文件，在传输引擎上执行，立即返回
+     * @param remoteFilePath 远程文件路径
+     * @param localFilePath 本地文件路径
+     * @param filterKeywords 过滤条件列表，当下载文件名包含关键词时不下载
+     * @param onFinished 完成回调，在引擎线程中调用，可以为空
+     * @param priority 优先级，大的先于等待中的其他传输执行
+     * @return 传输句柄
+     */
+    TransferHandle submitDownload(const std::string& remoteFilePath, const std::string& localFilePath,
+                                  const std::vector<std::string>& filterKeywords, std::function<void(FTP_Code)> onFinished = nullptr,
+                                  int priority = 0);
+
+    /**
+     * @brief 异步上传文件，在传输引擎上执行，立即返回
+     * @param localFilePath 本地文件路径
+     * @param remoteFilePath 远程文件路径
+     * @param onFinished 完成回调，在引擎线程中调用，可以为空
+     * @param priority 优先级，大的先于等待中的其他传输执行
+     * @return 传输句柄
+     */
+    TransferHandle submitUpload(const std::string& localFilePath, const std::string& remoteFilePath,
+                                std::function<void(FTP_Code)> onFinished = nullptr, int priority = 0);
+
+    /**
+     * @brief 设置连接池参数，连接池由相同主机和账号的FTPClient共享
+     * @param maxSize 最多保留的空闲连接数
+     * @param idleTimeoutSeconds 空闲超过该秒数的连接不再复用
+     */
+    void setConnectionPoolOptions(size_t maxSize, int idleTimeoutSeconds);
+
+    /**
+     * @brief 设置下载记录文件，文件夹下载时跳过记录中大小和修改时间都未变化的文件，下载成功后登记
+     *
+     * 记录文件在同一进程内由使用相同路径的FTPClient共享。须在传输开始前设置。
+     * @param ledgerPath 记录文件路径，为空时不使用下载记录
+     */
+    void setDownloadLedger(const std::string& ledgerPath);
+
+    /**
+     * @brief 设置下载临时文件的后缀，默认为".part"。下载先写入"本地路径+后缀"，完成并校验后改名为本地路径，
+     *        中断的下载从临时文件末尾续传，其他程序不会读到不完整的文件。须在传输开始前设置
+     * @param suffix 后缀，为空时直接写入本地路径
+     */
+    void setPartialFileSuffix(const std::string& suffix);
+
+    /**
+     * @brief 设置传输日志文件，之后的concurrentDownloadFolder在其中记录目录和文件的进度，
+     *        进程中断后可用resumeBatch继续。全部完成后日志文件被删除。须在传输开始前设置
+     * @param journalPath 日志文件路径，为空时不记录
+     */
+    void setTransferJournal(const std::string& journalPath);
+
+    /**
+     * @brief 设置文件传输失败后的重试，默认重试3次，间隔从1秒开始加倍，最长30秒。须在传输开始前设置
+     *
+     * 网络中断、超时和服务器的4xx回复（如421）视为暂时性错误，等待后重试；文件不存在、权限不足等5xx回复
+     * 和本地文件读写失败不重试。下载从临时文件末尾续传，上传重新查询远程文件大小后续传，
+     * 同步中覆盖远程旧文件的上传从头重传。连接中断或服务器关闭控制连接时，重试使用新的连接。
+     * 只重试本地文件的传输，下载到内存或从内存上传时不重试。重试统计见getBatchProgress。
+     * @param maxRetries 单个文件最多重试的次数，为0时不重试
+     * @param baseDelayMs 第一次重试前的等待时间（毫秒），实际等待时间在其一半到全部之间随机
+     * @param maxDelayMs 等待时间上限（毫秒）
+     */
+    void setRetryPolicy(unsigned maxRetries, long baseDelayMs = 1000, long maxDelayMs = 30000);
+
+    /**
+     * @brief 开启目录列表缓存，轮询文件夹时不再重复列出没有变化的子目录
+     *
+     * 列表按 主机+路径 缓存，本客户端上传、删除文件和创建目录时使相关目录失效。须在传输开始前设置。
+     * @param ttlSeconds 列表有效期（秒），为0时关闭缓存
+     * @param revalidateByDirectoryTime 超过有效期后，上级目录中该目录的修改时间未变时继续使用缓存的列表
+     */
+    void setListingCache(int ttlSeconds, bool revalidateByDirectoryTime = true);
+
+    /**
+     * @brief 设置进程内所有传输共享的总带宽上限，可在传输过程中修改
+     * @param bytesPerSecond 每秒字节数，为0时不限速
+     */
+    static void setGlobalBandwidthLimit(curl_off_t bytesPerSecond);
+
+    /**
+     * @brief 设置本主机的带宽上限，由进程内连接同一主机的所有FTPClient共享，可在传输过程中修改
+     * @param bytesPerSecond 每秒字节数，为0时不限速
+     */
+    void setHostBandwidthLimit(curl_off_t bytesPerSecond);
+
+    /**
+     * @brief 设置本主机同时使用的连接数上限，由进程内连接同一主机的所有FTPClient共享，可在传输过程中修改；
+     *        连接池和传输引擎中缓存的空闲连接也计入上限，名额不足时先关闭空闲连接
+     * @param maxConnections 连接数上限，为0时不限制
+     */
+    void setHostConnectionLimit(size_t maxConnections);
+
+    /**
+     * @brief 设置并发文件夹传输时同时进行的传输数量上限，默认为8；传输进行中也可修改，提高上限时补足传输引擎的工作线程
+     * @param maxConcurrent 并发上限
+     */
+    void setMaxConcurrentTransfers(size_t maxConcurrent);
+
+    /**
+     * @brief 开启或关闭自适应并发。开启后并发文件夹传输的并发数在[minConcurrent, maxConcurrent]内
+     *        按吞吐量逐个增加，遇到服务器拒绝（421/530）时减半，当前值可通过getBatchProgress获取
+     * @param enabled 是否开启
+     * @param minConcurrent 并发数下限
+     * @param maxConcurrent 并发数上限
+     */
+    void setAdaptiveConcurrency(bool enabled, size_t minConcurrent = 1, size_t maxConcurrent = 64);
+
+    /**
+     * @brief 设置等待传输的排序策略，默认按提交顺序。已知大小来自目录列表或本地文件，
+     *        LargestFirst适合缩短整批完成时间，ShortestFirst适合尽早完成更多文件
+     * @param policy 排序策略
+     */
+    void setSchedulingPolicy(SchedulingPolicy policy);
+
+    /**
+     * @brief 设置小文件通道，大文件最多占用并发上限减去reservedSlots个位置，
+     *        保留的位置只传输不超过maxSize的文件，大文件较多时小文件不必排在其后
+     * @param maxSize 小文件大小上限，为负数时关闭
+     * @param reservedSlots 为小文件保留的传输位置数
+     */
+    void setSmallFileLane(curl_off_t maxSize, size_t reservedSlots = 1);
+
+    /**
+     * @brief 设置并发文件夹传输中文件的优先级，优先级高的先于排序策略执行
+     * @param priority 优先级函数，为空时所有文件优先级为0
+     */
+    void setTransferPriority(PriorityFunction priority);
+
+    /**
+     * @brief 获取传输引擎的排队统计，从首次并发传输开始累计，两次获取的差即为期间的排队时间
+     */
+    QueueStats queueStats();
+
+    /**
+     * @brief 设置下载时写入本地文件的方式，须在传输开始前设置
+     * @param bufferSize 写缓冲大小（字节），写满后一次写入文件，0表示每次回调直接写入
+     * @param preallocate 是否按远程文件大小预分配磁盘空间，减少大文件的碎片
+     * @param directIO 是否使用O_DIRECT绕过页缓存，文件系统不支持时自动退回普通写入
+     */
+    void setLocalWriteOptions(size_t bufferSize, bool preallocate = true, bool directIO = false);
+
+    /**
+     * @brief 设置libcurl的接收缓冲区大小（CURLOPT_BUFFERSIZE），即每次写回调最多交付的字节数
+     * @param bytes 缓冲区大小，0表示使用libcurl的默认值（16KB），libcurl允许的最大值为10MB
+     */
+    void setReceiveBufferSize(long bytes);
+
+    /**
+     * @brief 设置libcurl的上传缓冲区大小（CURLOPT_UPLOAD_BUFFERSIZE），即每次读回调最多读取的字节数
+     * @param bytes 缓冲区大小，0表示使用libcurl的默认值（64KB），libcurl允许的最大值为2MB
+     */
+    void setSendBufferSize(long bytes);
+
+    /**
+     * @brief 开启传输校验。校验和在读写回调中随数据计算，传输结束后与服务器HASH/XCRC/XMD5命令的结果比较，
+     *        服务器不支持时与远程校验文件（远程路径+后缀，内容为"校验和  文件名"）比较，都无法取得时视为未校验。
+     *        上传时服务器不支持校验命令则上传校验文件。须在传输开始前设置
+     * @param algorithm 校验算法，None表示关闭校验。服务器命令只支持CRC32、MD5和SHA256，CRC32C和XXH64只能使用校验文件
+     * @param sidecarSuffix 校验文件后缀，如 ".sha256"，为空时不使用校验文件
+     */
+    void setChecksumVerification(FTPChecksum::Algorithm algorithm, const std::string& sidecarSuffix = std::string());
+
+    /**
+     * @brief 设置下载后删除远程文件的结果回调，每个文件调用一次。须在传输开始前设置
+     * @param callback 结果回调，为空时不通知
+     */
+    void setDeleteCallback(DeleteCallback callback);
+
 
     bool enableDeleteAfterDownload_;
 
 private:
+    struct DownloadTask;
+
     /**
-     * @brief 写回调函数，用于将文件内容写入本地文件
+     * @brief 写回调函数，用于将文件内容写入本地文件，第一次回调时按远程文件大小预分配空间
      * @param contents 文件内容
      * @param size 文件块大小
      * @param nmemb 文件块数量
-     * @param file 本地文件流
-     * @return 返回写入的字节数
+     * @param task 下载状态
+     * @return 返回写入的字节数，失败时返回0中止传输
      */
-    static size_t writeCallback(void* contents, size_t size, size_t nmemb, std::ofstream* file=NULL);
+    static size_t writeCallback(void* contents, size_t size, size_t nmemb, DownloadTask* task);
+
+    struct UploadTask;
 
     /**
-     * @brief 读回调函数，用于从本地文件读取内容
+     * @brief 开启校验时的上传读回调函数，读取的同时累计校验和
      * @param buffer 缓冲区
+     * @param size 块大小
+     * @param nitems 块数量
+     * @param task 上传状态
+     * @return 读取的字节数
+     */
+    static size_t uploadReadCallback(char* buffer, size_t size, size_t nitems, UploadTask* task);
+
+    /**
+     * @brief 开启校验时的上传定位回调函数，记录读取位置，libcurl回退重发时已累计的数据不重复计算
+     * @param task 上传状态
+     * @param offset 偏移量
+     * @param origin 定位方式
+     * @return CURL_SEEKFUNC_OK等
+     */
+    static int uploadSeekCallback(UploadTask* task, curl_off_t offset, int origin);
+
+    /**
+     * @brief 分段下载中的一段
+     */
+    struct DownloadSegment {
+        int fd;                     // 本地文件描述符，多个分段共享
+        std::unique_ptr<FTPBufferedFileSink> sink;  // 从begin开始写入fd的缓冲
+        curl_off_t begin;           // 分段起始偏移量
+        curl_off_t end;             // 分段结束偏移量（含）
+        curl_off_t written;         // 已写入的字节数
+        bool flushed;               // 结束时缓冲是否已全部写入文件
+        CURLcode result;            // 传输结果
+        long progressKey;           // 传输进度记录的键
+    };
+
+    /**
+     * @brief 分段下载的写回调函数，按偏移量写入本地文件
+     * @param contents 文件内容
      * @param size 文件块大小
      * @param nmemb 文件块数量
-     * @param file 本地文件流
-     * @return 返回读取的字节数
+     * @param segment 所属分段
+     * @return 返回写入的字节数，失败时返回0中止传输
      */
-    static size_t readCallback(void* buffer, size_t size, size_t nmemb, std::ifstream* file);
+    static size_t segmentWriteCallback(void* contents, size_t size, size_t nmemb, DownloadSegment* segment);
 
     /**
-     * @brief 将返回内容写入字符串流的回调函数
+     * @brief 将返回内容追加到字符串的回调函数
      * @param contents 文件内容
      * @param size 文件块大小
      * @param nmemb 文件块数量
-     * @param stream 字符串流
+     * @param str 字符串
      * @return 返回写入的字节数
      */
-    static size_t writeToStringStreamCallback(void* contents, size_t size, size_t nmemb, std::stringstream* stream);
+    static size_t writeToStringCallback(void* contents, size_t size, size_t nmemb, std::string* str);
 
     /**
-     * @brief 返回数据大小回调函数
-     * @param contents  文件内容
-     * @param size      文件块大小
-     * @param nmemb     文件块数量
-     * @param data      指向要复制数据的目标内存区域的指针
-     * @return          返回成功复制的总字节数
+     * @brief 限速回调函数，由进度跟踪在传输开始、进行中和结束时调用，登记传输并按主机和全局带宽上限计算可用速率
+     * @param context 主机的流量控制对象
+     * @param event 调用时机
+     * @return 传输当前可用的速率，为0时不限速
      */
-    static size_t copyDataSizeCallback(void* contents, size_t size, size_t nmemb, void *data);
+    static curl_off_t throttleCallback(void* context, FTPProgressTracker::ThrottleEvent event);
 
     /**
-     * @brief 进度回调函数
-     * @param clientp  用户定义的指针，可以在回调函数中访问
-     * @param dltotal  下载的总字节数
-     * @param dlnow    已经下载的字节数
-     * @param ultotal  上传的总字节数,经测试无法直接传入该参数
-     * @param ulnow    已经上传的字节数
-     * @return         返回零以继续传输，非零值将中止传输
+     * @brief 查询远程文件信息时的头回调和写回调函数，记录服务器是否接受REST
+     * @param buffer    libcurl生成的头信息
+     * @param size      块大小
+     * @param nitems    块数量
+     * @param stat      查询结果
+     * @return          返回处理的总字节数
      */
-    static int progressCallback(void *p, double dltotal, double dlnow, double ultotal, double ulnow);
+    static size_t statHeaderCallback(char* buffer, size_t size, size_t nitems, RemoteFileStat* stat);
+
+    /**
+     * @brief 单个文件的下载状态
+     */
+    struct DownloadTask {
+        std::string remotePath;     // 规范化后的远程路径
+        std::string localPath;      // 规范化后的本地路径
+        std::string writePath;      // 下载时写入的临时文件，完成后改名为localPath；不使用临时文件时与localPath相同
+        std::unique_ptr<FTPFileSink> file;  // 本地文件，下载到内存时为调用方提供的写入对象
+        bool inMemory;              // 下载到内存，不创建本地文件
+        CURL* curl;                 // 进行下载的句柄，写回调中用于获取远程文件大小
+        bool reserved;              // 是否已按远程文件大小预分配
+        long progressKey;           // 传输进度记录的键
+        bool restart;               // 服务器拒绝续传，或本地已有的文件与远程不一致，需要从头下载
+        bool comparing;             // 本次执行只查询远程文件信息，与已有的本地文件比较
+        bool upToDate;              // 已有的本地文件与远程文件一致，不必下载
+        RemoteFileStat remoteStat;  // 比较已有的本地文件时查询到的远程文件信息
+        std::unique_ptr<FTPChecksum> checksum;  // 随写回调累计的校验和，未开启校验时为空
+        std::shared_ptr<FTPTransferEngine::Control> control;    // 异步传输的取消和暂停标志，为空时不可控制
+        curl_off_t expectedSize;    // 目录列表中的文件大小，用于排序，未知时为-1
+        int priority;               // 在传输引擎中的优先级
+        unsigned attempts;          // 已重试的次数
+        bool freshConnect;          // 上次失败的连接可能已损坏，下次传输须建立新连接
+    };
 
+    /**
+     * @brief 单个文件的上传状态
+     */
+    struct UploadTask {
+        std::string localPath;      // 规范化后的本地路径
+        std::string remotePath;     // 规范化后的远程路径
+        std::unique_ptr<FTPFileSource> file;    // 本地文件，上传内存数据时为调用方提供的读取对象
+        bool inMemory;              // 上传内存数据，不检查远程文件大小，总是完整上传
+        off_t localSize;            // 本地文件大小
+        off_t remoteSize;           // 远程文件大小，即续传偏移量
+        long progressKey;           // 传输进度记录的键
+        bool overwrite;             // 总是从头上传，不比较远程文件大小
+        bool sidecar;               // 上传的是校验文件，本身不再校验
+        std::string remoteChecksum; // 远程文件与本地文件大小相同时查询到的远程校验和，用于判断是否需要上传
+        std::unique_ptr<FTPChecksum> checksum;  // 随读回调累计的校验和，未开启校验时为空
+        curl_off_t position;        // 读取位置
+        curl_off_t hashed;          // 已累计到校验和的位置
+        bool directoryReady;        // 远程目录已确认存在，直接以完整路径STOR，不再CWD或创建目录
+        std::shared_ptr<FTPTransferEngine::Control> control;    // 异步传输的取消和暂停标志，为空时不可控制
+        curl_off_t expectedSize;    // 提交时已知的本地文件大小，用于排序，未知时为-1
+        int priority;               // 在传输引擎中的优先级
+        unsigned attempts;          // 已重试的次数
+        bool freshConnect;          // 上次失败的连接可能已损坏，下次传输须建立新连接
+    };
+
+    /**
+     * @brief 远程校验和的来源，按顺序尝试
+     */
+    enum ChecksumSource {
+        HashCommand,                // OPTS HASH + HASH
+        LegacyCommand,              // XCRC 或 XMD5
+        SidecarFile,                // 远程校验文件
+        NoChecksumSource
+    };
 
     /**
-     * @brief 记录已下载文件的路径
+     * @brief 远程校验和查询状态
+     */
+    struct ChecksumQuery {
+        std::string remotePath;     // 远程文件路径
+        bool allowSidecar;          // 是否读取校验文件，上传时校验文件尚未生成
+        ChecksumSource source;      // 当前尝试的来源
+        curl_slist* commands;       // 当前发送的命令
+        std::string response;       // 服务器回复或校验文件内容
+        std::string value;          // 查询到的校验和，为空时未取得
+    };
+
+    /**
+     * @brief 规范化下载路径，过滤关键词并创建本地文件夹
+     * @param task 下载状态
+     * @param remoteFilePath 远程文件路径
      * @param localFilePath 本地文件路径
-     * @param keyword 匹配关键字，如果文件内容中包含该关键字，则记录为已下载
+     * @param filterKeywords 过滤条件列表
+     * @return 可以下载时返回FTP_OK，否则返回状态号
      */
-    void recordDownloadedFile(const std::string& localFilePath);
+    FTP_Code initDownloadTask(DownloadTask& task, const std::string& remoteFilePath, const std::string& localFilePath,
+                              const std::vector<std::string>& filterKeywords);
 
     /**
-     * @brief 判断文件是否已下载
-     * @param keyword 记录为关键字
-     * @return 如果已下载，则返回true，否则返回false
+     * @brief 在一个连接上执行下载，服务器拒绝续传时重新下载，成功后按设置删除远程文件
+     * @param task 已初始化的下载状态
+     * @param deletes 不为NULL时删除放入删除队列后立即返回，完成时标记到deletes；否则等待删除完成
+     * @return 返回状态号
      */
-    bool isDownloaded(const std::string& keyword);
+    FTP_Code performDownload(DownloadTask& task, FTPTransferEngine::Batch* deletes = NULL);
 
     /**
-     * @brief 判断文件内容是否匹配关键字
-     * @param filePath 文件路径
-     * @param keyword 匹配关键字
-     * @return 如果文件内容中包含该关键字，则返回true，否则返回false
+     * @brief 下载到调用方提供的写入对象
+     * @param remoteFilePath 远程文件路径
+     * @param sink 写入对象
+     * @return 返回状态号
+     */
+    FTP_Code downloadToSink(const std::string& remoteFilePath, std::unique_ptr<FTPFileSink> sink);
+
+    /**
+     * @brief 从调用方提供的读取对象上传
+     * @param source 读取对象
+     * @param remoteFilePath 远程文件路径
+     * @return 返回状态号
      */
-    bool isKeywordMatched(const std::string& filePath, const std::string& keyword);
+    FTP_Code uploadFromSource(std::unique_ptr<FTPFileSource> source, const std::string& remoteFilePath);
+
+    /**
+     * @brief 打开本地文件并在句柄上设置下载选项，临时文件已存在时从末尾续传；
+     *        只有完整的本地文件时不改动它，改为在句柄上设置查询远程文件信息的选项，由finishDownload比较
+     * @param curl CURL对象
+     * @param task 下载状态
+     * @return 返回状态号
+     */
+    FTP_Code prepareDownload(CURL* curl, DownloadTask& task);
+
+    /**
+     * @brief 下载结束后关闭本地文件并给出结果，服务器拒绝续传或已有的本地文件需要重新下载时设置task.restart
+     * @param curl CURL对象
+     * @param task 下载状态
+     * @param result 传输结果
+     * @return 返回状态号
+     */
+    FTP_Code finishDownload(CURL* curl, DownloadTask& task, CURLcode result);
+
+    /**
+     * @brief 下载成功并通过校验后将临时文件改名为本地路径，本地文件已是最新时不做改动
+     * @param task 下载状态
+     * @return 成功返回FTP_OK，否则返回FTP_FAILED
+     */
+    FTP_Code finalizeDownload(DownloadTask& task);
+
+    /**
+     * @brief 将下载提交到传输引擎，完成（含下载后删除）时调用onFinished
+     * @param remoteFilePath 远程文件路径
+     * @param localFilePath 本地文件路径
+     * @param filterKeywords 过滤条件列表
+     * @param expectedSize 目录列表中的文件大小，未知时为-1
+     * @param onFinished 完成回调，在引擎线程中调用，开启下载后删除时在删除线程中调用
+     */
+    void scheduleDownload(const std::string& remoteFilePath, const std::string& localFilePath,
+                          const std::vector<std::string>& filterKeywords, curl_off_t expectedSize, std::function<void(FTP_Code)> onFinished);
+
+    /**
+     * @brief 将已初始化的下载状态提交到传输引擎，服务器拒绝续传时重新提交，可重试的失败在等待后重新提交
+     * @param task 下载状态
+     * @param onFinished 完成回调
+     * @param delay 提交前的等待时间，重试时使用
+     */
+    void submitDownloadTask(std::shared_ptr<DownloadTask> task, std::function<void(FTP_Code)> onFinished,
+                            std::chrono::milliseconds delay = std::chrono::milliseconds(0));
+
+    /**
+     * @brief 文件传输失败后按重试策略决定是否重试，并记入批次的重试统计
+     * @param curl 失败的句柄
+     * @param result 传输结果
+     * @param path 用于输出的文件路径
+     * @param attempts 已重试的次数，决定重试时加1
+     * @param freshConnect 决定重试时设置为连接是否可能已损坏
+     * @param delay 决定重试时设置为重试前的等待时间
+     * @return 需要重试返回true
+     */
+    bool retryAfterFailure(CURL* curl, CURLcode result, const std::string& path, unsigned& attempts, bool& freshConnect,
+                           std::chrono::milliseconds& delay);
+
+    /**
+     * @brief 将删除远程文件放入删除队列，与其他文件的DELE合并在一个连接上连续发送
+     * @param remoteFilePath 远程文件路径
+     * @param onFinished 完成回调，在删除线程中调用，删除失败时为REMOTE_FILE_DELE_FAILED
+     */
+    void scheduleDelete(const std::string& remoteFilePath, std::function<void(FTP_Code)> onFinished);
+
+    /**
+     * @brief 删除已下载的远程文件并等待结果
+     * @param remoteFilePath 远程文件路径
+     * @return 成功返回FTP_OK，否则返回REMOTE_FILE_DELE_FAILED
+     */
+    FTP_Code deleteDownloadedFile(const std::string& remoteFilePath);
+
+    /**
+     * @brief 规范化上传路径
+     * @param task 上传状态
+     * @param localFilePath 本地文件路径
+     * @param remoteFilePath 远程文件路径
+     */
+    void initUploadTask(UploadTask& task, const std::string& localFilePath, const std::string& remoteFilePath);
+
+    /**
+     * @brief 打开本地文件并在句柄上设置上传选项，须先填写task.remoteSize
+     * @param curl CURL对象
+     * @param task 上传状态
+     * @return 返回状态号
+     */
+    FTP_Code prepareUpload(CURL* curl, UploadTask& task);
+
+    /**
+     * @brief 上传结束后关闭本地文件并给出结果
+     * @param curl CURL对象
+     * @param task 上传状态
+     * @param result 传输结果
+     * @return 返回状态号
+     */
+    FTP_Code finishUpload(CURL* curl, UploadTask& task, CURLcode result);
+
+    /**
+     * @brief 将已查询远程文件大小的上传状态提交到传输引擎，开启校验时上传成功后继续校验，
+     *        可重试的失败在等待后重新提交
+     * @param task 上传状态
+     * @param onFinished 完成回调
+     * @param delay 提交前的等待时间，重试时使用
+     */
+    void submitUploadTask(std::shared_ptr<UploadTask> task, std::function<void(FTP_Code)> onFinished,
+                          std::chrono::milliseconds delay = std::chrono::milliseconds(0));
+
+    /**
+     * @brief 将已初始化的上传提交到传输引擎，先查询远程文件大小再上传
+     * @param task 上传状态
+     * @param onFinished 完成回调，在引擎线程中调用
+     * @param delay 提交前的等待时间，重试时使用
+     */
+    void scheduleUpload(std::shared_ptr<UploadTask> task, std::function<void(FTP_Code)> onFinished,
+                        std::chrono::milliseconds delay = std::chrono::milliseconds(0));
+
+    /**
+     * @brief 按setTransferPriority设置的函数计算文件的优先级
+     * @param remoteFilePath 远程文件路径
+     * @param size 文件大小，未知时为-1
+     * @return 优先级，未设置时为0
+     */
+    int transferPriority(const std::string& remoteFilePath, curl_off_t size);
+
+    /**
+     * @brief 在当前线程中完成一个已初始化的上传：查询远程文件大小、上传并校验
+     * @param task 上传状态
+     * @return 返回状态号
+     */
+    FTP_Code performUpload(UploadTask& task);
+
+    /**
+     * @brief 远程文件所在的目录
+     * @param remotePath 远程文件路径，开头的/可有可无
+     * @return 以/开头、不以/结尾的目录路径，位于根目录时为空
+     */
+    static std::string remoteParentDirectory(const std::string& remotePath);
+
+    /**
+     * @brief 展开目录及其所有上级目录，按层级从浅到深排序，即逐层创建的顺序
+     * @param directories 以/开头的目录路径
+     * @param skipKnown 是否跳过已知存在的目录
+     * @return 需要创建的目录
+     */
+    std::vector<std::string> planRemoteDirectories(const std::set<std::string>& directories, bool skipKnown);
+
+    /**
+     * @brief 设置一次执行中逐个发送的MKD，失败的MKD（通常是目录已存在）不中断后续命令
+     * @param curl CURL对象
+     * @param directories 按创建顺序排列的目录
+     * @param checkPath 发送MKD后进入该目录以确认其存在，为空时不确认
+     * @return 命令列表，执行后释放
+     */
+    curl_slist* prepareCreateRemoteDirectories(CURL* curl, const std::vector<std::string>& directories, const std::string& checkPath);
+
+    /**
+     * @brief 在一个连接上一次创建多个远程目录及其上级目录，已知存在的目录不再发送MKD
+     * @param directories 以/开头的目录路径
+     * @return 命令执行成功返回true
+     */
+    bool createRemoteDirectories(const std::set<std::string>& directories);
+
+    /**
+     * @brief 确保远程目录存在后调用onReady。未知的目录先等待，与其他同时等待的目录合并为一个MKD任务提交到传输引擎
+     * @param directory 以/开头的目录路径，为空表示根目录
+     * @param onReady 参数为目录是否已确认创建；为false时上传应退回逐级创建目录的方式
+     */
+    void ensureRemoteDirectory(const std::string& directory, std::function<void(bool)> onReady);
+
+    /**
+     * @brief 没有进行中的目录创建任务时，把所有等待的目录合并提交
+     */
+    void dispatchDirectoryCreation();
+
+    /**
+     * @brief 记录已创建或已存在的远程目录
+     * @param directories 目录路径
+     */
+    void markRemoteDirectories(const std::vector<std::string>& directories);
+
+    /**
+     * @brief 在句柄上设置查询远程文件信息的选项，NOBODY使libcurl只在控制连接上发送SIZE/MDTM/REST
+     * @param curl CURL对象
+     * @param remoteFilePath 远程文件路径
+     * @param stat 接收查询结果
+     */
+    void prepareRemoteFileStat(CURL* curl, const std::string& remoteFilePath, RemoteFileStat* stat);
+
+    /**
+     * @brief 从执行结束的句柄中读取远程文件信息
+     * @param curl CURL对象
+     * @param result 执行结果
+     * @param remoteFilePath 远程文件路径
+     * @param stat 查询结果
+     * @return 查询成功返回true，文件不存在或连接失败返回false
+     */
+    bool remoteFileStatResult(CURL* curl, CURLcode result, const std::string& remoteFilePath, RemoteFileStat& stat);
+
+    /**
+     * @brief 在已借出的句柄上查询远程文件信息，结束后清除查询选项
+     * @param curl CURL对象
+     * @param remoteFilePath 远程文件路径
+     * @param stat 查询结果
+     * @return 查询成功返回true，否则返回false
+     */
+    bool probeRemoteFile(CURL* curl, const std::string& remoteFilePath, RemoteFileStat& stat);
+
+    /**
+     * @brief 清除prepareRemoteFileStat设置的查询选项，句柄接下来可以用于传输
+     * @param curl CURL对象
+     */
+    void clearRemoteFileStat(CURL* curl);
+
+    /**
+     * @brief 判断已有的本地文件与远程文件是否一致：大小相同，且本地文件不早于远程文件的修改时间
+     * @param localFilePath 本地文件路径
+     * @param stat 远程文件信息
+     */
+    bool localFileUpToDate(const std::string& localFilePath, const RemoteFileStat& stat);
+
+    /**
+     * @brief 在句柄上设置删除远程文件的选项
+     * @param curl CURL对象
+     * @param remoteFilePath 远程文件路径
+     * @return 返回命令列表，执行结束后由调用方释放
+     */
+    curl_slist* prepareDeleteRemoteFile(CURL* curl, const std::string& remoteFilePath);
+
+    /**
+     * @brief 初始化远程校验和查询，选择第一个可用的来源
+     * @param query 查询状态
+     * @param remoteFilePath 远程文件路径
+     * @param allowSidecar 是否读取校验文件
+     */
+    void initChecksumQuery(ChecksumQuery& query, const std::string& remoteFilePath, bool allowSidecar);
+
+    /**
+     * @brief 从from开始查找下一个可用的校验和来源
+     * @param query 查询状态
+     * @param from 起始来源
+     * @return 可用的来源，没有时为NoChecksumSource
+     */
+    ChecksumSource nextChecksumSource(const ChecksumQuery& query, ChecksumSource from);
+
+    /**
+     * @brief 从服务器回复或校验文件内容中取出校验和
+     * @param response 服务器回复或校验文件内容
+     * @param algorithm 校验算法
+     * @param source 内容的来源
+     * @return 校验和，未找到时为空
+     */
+    static std::string parseChecksumReply(std::string_view response, FTPChecksum::Algorithm algorithm, ChecksumSource source);
+
+    /**
+     * @brief 在句柄上设置查询当前来源的选项。校验命令通过QUOTE在控制连接上发送，不打开数据连接
+     * @param curl CURL对象
+     * @param query 查询状态
+     */
+    void prepareChecksumQuery(CURL* curl, ChecksumQuery& query);
+
+    /**
+     * @brief 解析当前来源的查询结果并清除查询选项，未取得时切换到下一个来源
+     * @param curl CURL对象
+     * @param query 查询状态
+     * @param result 执行结果
+     * @return 已取得校验和或没有其他来源时返回true
+     */
+    bool checksumQueryResult(CURL* curl, ChecksumQuery& query, CURLcode result);
+
+    /**
+     * @brief 在已借出的句柄上依次尝试各来源查询远程校验和
+     * @param curl CURL对象
+     * @param query 已初始化的查询状态，结果在query.value中
+     */
+    void fetchRemoteChecksum(CURL* curl, ChecksumQuery& query);
+
+    /**
+     * @brief 将远程校验和查询提交到传输引擎，每个来源一个任务
+     * @param query 已初始化的查询状态
+     * @param onFinished 查询结束时调用，结果在query->value中
+     */
+    void scheduleChecksumQuery(std::shared_ptr<ChecksumQuery> query, std::function<void()> onFinished);
+
+    /**
+     * @brief 比较下载的校验和与远程校验和，不一致时删除本地文件
+     * @param task 下载状态
+     * @param expected 远程校验和，为空时视为未校验
+     * @return 一致或无法校验时返回FTP_OK，否则返回CHECKSUM_MISMATCH
+     */
+    FTP_Code checkDownloadChecksum(DownloadTask& task, const std::string& expected);
+
+    /**
+     * @brief 比较上传的校验和与远程校验和
+     * @param task 上传状态
+     * @param expected 远程校验和，为空时视为未校验
+     * @return 一致或无法校验时返回FTP_OK，否则返回CHECKSUM_MISMATCH
+     */
+    FTP_Code checkUploadChecksum(UploadTask& task, const std::string& expected);
+
+    /**
+     * @brief 生成上传任务的校验文件内容，格式与sha256sum等工具相同
+     * @param task 上传状态
+     * @return 校验文件内容
+     */
+    std::string sidecarContent(const UploadTask& task);
+
+    /**
+     * @brief 在已借出的句柄上完成上传后的校验：比较服务器计算的校验和，服务器不支持时上传校验文件
+     * @param curl CURL对象
+     * @param task 上传成功的上传状态
+     * @return 返回状态号
+     */
+    FTP_Code verifyUpload(CURL* curl, UploadTask& task);
+
+    /**
+     * @brief 将上传后的校验提交到传输引擎
+     * @param task 上传成功的上传状态
+     * @param onFinished 完成回调
+     */
+    void scheduleUploadVerification(std::shared_ptr<UploadTask> task, std::function<void(FTP_Code)> onFinished);
+
+    /**
+     * @brief 远程文件与本地文件大小相同且开启校验时，先查询远程校验和再决定是否上传
+     * @param task 上传状态，已填写remoteSize
+     * @return 需要查询时返回true
+     */
+    bool needsRemoteChecksum(const UploadTask& task);
+
+    /**
+     * @brief 在句柄上设置列出目录的选项
+     * @param curl CURL对象
+     * @param remoteFolderPath 远程文件夹路径，以/结尾或为空
+     * @param sink 接收列表内容
+     * @param mlsd 为true时使用MLSD，否则使用LIST
+     */
+    void prepareListing(CURL* curl, const std::string& remoteFolderPath, std::string* sink, bool mlsd);
+
+    /**
+     * @brief 判断列表命令是否因服务器不支持而失败，此时应换用LIST
+     * @param curl CURL对象
+     * @param result 执行结果
+     * @return 服务器回复50x时返回true
+     */
+    static bool listingCommandRejected(CURL* curl, CURLcode result);
+
+    /**
+     * @brief 等待列出的远程目录
+     */
+    struct RemoteDirectory {
+        std::string path;           // 目录路径，以/结尾或为空
+        time_t modifyTime;          // 上级目录列表中该目录的修改时间，未知时为-1
+        uint64_t generation;        // 开始列出时列表缓存的失效计数
+    };
+
+    /**
+     * @brief 解析MLSD或LIST返回的内容
+     * @param remoteFolderPath 远程文件夹路径，以/结尾或为空
+     * @param response 列表内容
+     * @param mlsd 内容是否为MLSD格式
+     * @param onFile 对每个文件调用，条目中的切片指向response
+     * @param directories 解析出的子文件夹，路径以/结尾
+     */
+    void parseListing(const std::string& remoteFolderPath, std::string_view response, bool mlsd,
+                      const std::function<void(const FTPListParser::Entry& entry)>& onFile, std::vector<RemoteDirectory>& directories);
+
+    /**
+     * @brief 由列表条目生成FTPFileInfo
+     * @param path 所在目录，以/开头和结尾
+     * @param entry 列表条目
+     * @return 文件信息
+     */
+    static FTPFileInfo makeFileInfo(const std::string& path, const FTPListParser::Entry& entry);
+
+    /**
+     * @brief 逐个列出远程目录树中的目录，按深度优先顺序对每个文件调用onFile
+     * @param remoteFolderPath 远程文件夹路径
+     * @param onFile 参数为所在目录（以/开头和结尾）和列表条目
+     * @return 所有目录都列出成功时返回true
+     */
+    bool scanRemoteFolder(const std::string& remoteFolderPath,
+                          const std::function<void(const std::string& path, const FTPListParser::Entry& entry)>& onFile);
+
+    /**
+     * @brief 远程目录遍历状态，由列表任务共享
+     */
+    struct RemoteWalk {
+        std::mutex mutex;
+        std::deque<RemoteDirectory> directories;            // 等待列出的目录
+        size_t activeListings;                              // 进行中的列表任务数量
+        std::function<void(const FTPFileInfo&)> onFile;     // 发现文件时调用
+        FTPTransferEngine::Batch* batch;                    // 列表任务计入该批次
+        std::shared_ptr<FTPTransferJournal> journal;        // 记录目录的发现和列出，为空时不记录
+    };
+
+    /**
+     * @brief 在传输引擎上并行遍历远程目录，每发现一个文件立即调用onFile，不等待整个目录树列出
+     *
+     * 列表任务优先于传输任务执行，同时进行的列表任务数量有上限。
+     * onFile在引擎线程中调用，其中提交的任务须先计入batch，batch.wait()返回时遍历和传输都已结束。
+     * @param remoteFolderPaths 要遍历的远程文件夹路径
+     * @param onFile 发现文件时的回调
+     * @param batch 批次
+     * @param journal 传输日志，为空时不记录
+     */
+    void walkRemoteFolder(const std::vector<std::string>& remoteFolderPaths, std::function<void(const FTPFileInfo&)> onFile,
+                          FTPTransferEngine::Batch& batch, std::shared_ptr<FTPTransferJournal> journal = nullptr);
+
+    /**
+     * @brief 在传输引擎上下载日志中未完成的文件并遍历目录下载其中的文件，并发文件夹下载和恢复共用
+     * @param remoteFolderPaths 要遍历的远程文件夹路径
+     * @param files 直接下载的文件
+     * @param localFolderPath 本地根路径
+     * @param filterKeywords 过滤条件列表
+     * @param journal 传输日志，为空时不记录
+     * @return 全部成功返回true
+     */
+    bool downloadBatch(const std::vector<std::string>& remoteFolderPaths, const std::vector<FTPTransferJournal::File>& files,
+                       const std::string& localFolderPath, const std::vector<std::string>& filterKeywords,
+                       std::shared_ptr<FTPTransferJournal> journal);
+
+    /**
+     * @brief 在并发上限内提交等待中的目录列表任务
+     * @param walk 遍历状态
+     */
+    void dispatchListings(std::shared_ptr<RemoteWalk> walk);
+
+    /**
+     * @brief 解析一个目录的列表，子目录加入等待队列，对每个文件调用onFile
+     * @param walk 遍历状态
+     * @param folderPath 目录路径
+     * @param response 列表内容
+     * @param mlsd 列表内容是否为MLSD格式
+     * @return 列表中有子目录时返回true
+     */
+    bool handleListing(std::shared_ptr<RemoteWalk> walk, const std::string& folderPath, std::string_view response, bool mlsd);
+
+    /**
+     * @brief 目录列表缓存的键
+     * @param folderPath 目录路径，以/结尾或为空
+     * @return 用户名@主机/路径
+     */
+    std::string listingCacheKey(const std::string& folderPath);
+
+    /**
+     * @brief 从缓存中取出目录列表
+     * @param directory 目录
+     * @param response 列表内容
+     * @param mlsd 列表内容是否为MLSD格式
+     * @return 未开启缓存或没有可用的列表时返回false，此时记下缓存的失效计数供storeListing使用
+     */
+    bool lookupListing(RemoteDirectory& directory, std::shared_ptr<const std::string>& response, bool& mlsd);
+
+    /**
+     * @brief 将新列出的目录保存到缓存
+     * @param hasDirectories 列表中是否有子目录
+     */
+    void storeListing(const RemoteDirectory& directory, std::shared_ptr<const std::string> response, bool mlsd, bool hasDirectories);
+
+    /**
+     * @brief 远程路径变化后，使该路径及其上级目录的缓存列表失效
+     * @param remotePath 变化的远程文件或目录路径
+     */
+    void invalidateListing(const std::string& remotePath);
+
+    /**
+     * @brief 同步时一端的文件状态
+     */
+    struct SyncFile {
+        curl_off_t size;            // 文件大小
+        time_t modifyTime;          // 修改时间，未知时为-1
+    };
+
+    /**
+     * @brief 列出本地文件夹下的所有文件及其大小和修改时间
+     * @param localFolderPath 本地文件夹路径
+     * @param files 相对路径到文件状态
+     * @return 成功返回true
+     */
+    bool listLocalTree(const std::string& localFolderPath, std::map<std::string, SyncFile>& files);
+
+    /**
+     * @brief 在传输引擎上并行列出远程文件夹下的所有文件
+     * @param remoteFolderPath 远程文件夹路径
+     * @param files 相对路径到文件状态
+     * @return 所有目录都列出成功时返回true
+     */
+    bool listRemoteTree(const std::string& remoteFolderPath, std::map<std::string, SyncFile>& files);
+
+    /**
+     * @brief 比较两端生成同步计划
+     * @param local 本地文件
+     * @param remote 远程文件
+     * @param options 同步选项
+     * @param state 状态快照，可为NULL
+     * @param plan 同步计划
+     * @param checksumCandidates 需要比较校验和的计划项下标，计划项中已填入取不到校验和时的决定
+     */
+    void planSync(const std::map<std::string, SyncFile>& local, const std::map<std::string, SyncFile>& remote,
+                  const SyncOptions& options, FTPSyncState* state, std::vector<SyncAction>& plan,
+                  std::vector<size_t>& checksumCandidates);
+
+    /**
+     * @brief 查询远程校验和并与本地文件比较，按结果修改计划项
+     * @param localRoot 本地根目录
+     * @param remotePrefix 远程根目录前缀，以/结尾
+     * @param plan 同步计划
+     * @param checksumCandidates 需要比较校验和的计划项下标
+     */
+    void compareSyncChecksums(const std::string& localRoot, const std::string& remotePrefix,
+                              std::vector<SyncAction>& plan, const std::vector<size_t>& checksumCandidates);
+
+    /**
+     * @brief 获取本地文件的大小和修改时间
+     * @param localFilePath 本地文件路径
+     * @param file 文件状态
+     * @return 文件存在时返回true
+     */
+    bool statLocalFile(const std::string& localFilePath, SyncFile& file);
+
+    /**
+     * @brief 获取传输引擎，首次调用时启动引擎线程
+     */
+    FTPTransferEngine& transferEngine();
+
+    /**
+     * @brief 获取删除队列，删除线程在首次删除时启动
+     */
+    FTPDeleteQueue& deleteQueue();
+
+    /**
+     * @brief 登记传输进度并在句柄上设置进度回调
+     * @param curl CURL对象
+     * @param filename 文件名
+     * @param type 传输类型
+     * @param totalSize 本次需要传输的大小，未知时为0
+     * @return 进度记录的键，无法跟踪时为-1
+     */
+    long beginProgress(CURL* curl, const std::string& filename, TransferType type, curl_off_t totalSize);
+
+    /**
+     * @brief 删除传输进度记录
+     * @param proKey 进度记录的键
+     */
+    void endProgress(long proKey);
+
+    /**
+     * @brief 开始一个批次，开始新的批次时记录耗时统计的基准，批次的耗时统计从此时开始计算
+     */
+    void beginBatch();
+
+
+    /**
+     * @brief 在下载记录中登记已下载的文件
+     * @param file 远程文件信息
+     */
+    void recordDownloadedFile(const FTPFileInfo& file);
+
+    /**
+     * @brief 判断文件是否已下载，按 远程路径+大小+修改时间 在下载记录中精确查找
+     * @param file 远程文件信息
+     * @return 如果已下载，则返回true，否则返回false；未设置下载记录时总是返回false
+     */
+    bool isDownloaded(const FTPFileInfo& file);
 
     /**
      * @brief 判断文件是否存在
@@ -288,9 +1411,63 @@ private:
     std::string username_;  ///< FTP登录用户名
     std::string password_;  ///< FTP登录密码
 
+    std::shared_ptr<FTPConnectionPool> connectionPool_;  ///< 已登录连接池
+
+    std::mutex engineMutex_;
+    std::unique_ptr<FTPTransferEngine> transferEngine_;  ///< 并发传输引擎
+    std::unique_ptr<FTPDeleteQueue> deleteQueue_;       ///< 下载后删除远程文件的队列
+    DeleteCallback deleteCallback_;                     ///< 删除结果回调
+    size_t maxConcurrentTransfers_;                     ///< 并发传输数量上限
+    bool adaptiveConcurrency_;                          ///< 是否开启自适应并发
+    size_t adaptiveMinTransfers_;                       ///< 自适应并发的下限
+    size_t adaptiveMaxTransfers_;                       ///< 自适应并发的上限
+    SchedulingPolicy schedulingPolicy_;                 ///< 等待传输的排序策略
+    curl_off_t smallFileLimit_;                         ///< 小文件通道的大小上限，为负数时关闭
+    size_t reservedSmallSlots_;                         ///< 为小文件保留的传输位置数
+    PriorityFunction priorityFunction_;                 ///< 文件夹传输中文件的优先级
+    FTPFileSink::Options sinkOptions_;                  ///< 下载写入本地文件的选项
+    long receiveBufferSize_;                            ///< CURLOPT_BUFFERSIZE，0表示默认值
+    long sendBufferSize_;                               ///< CURLOPT_UPLOAD_BUFFERSIZE，0表示默认值
+    std::atomic<bool> mlsdUnsupported_;                 ///< 服务器不支持MLSD，列目录时使用LIST
+    FTPChecksum::Algorithm checksumAlgorithm_;          ///< 传输校验算法，None表示不校验
+    std::string checksumSuffix_;                        ///< 校验文件后缀，为空时不使用校验文件
+    std::atomic<bool> hashCommandUnsupported_;          ///< 服务器不支持HASH或不支持该算法
+    std::atomic<bool> legacyChecksumUnsupported_;       ///< 服务器不支持XCRC/XMD5
+
+    std::shared_ptr<FTPDownloadLedger> ledger_;         ///< 下载记录
+    std::string partialSuffix_;                         ///< 下载临时文件后缀，为空时直接写入本地路径
+    std::string journalPath_;                           ///< 并发文件夹下载的日志文件，为空时不记录
+    FTPRetryPolicy retryPolicy_;                        ///< 文件传输失败后的重试策略
+    std::shared_ptr<FTPListingCache> listingCache_;     ///< 目录列表缓存，未开启时为空
+
+    std::mutex directoryMutex_;
+    std::unordered_set<std::string> remoteDirectories_; ///< 已创建或已存在的远程目录，上传失败时移除其所在目录
+    std::map<std::string, std::vector<std::function<void(bool)>>> pendingDirectories_;    ///< 等待创建的目录及其后续操作
+    bool creatingDirectories_;                          ///< 是否有目录创建任务在进行
 
-    std::mutex mutex;
-    std::map<int, FileTransferInfo> taskProgress;
+    FTPProgressTracker progress_;                       ///< 传输进度
+    FTPTransferMetrics metrics_;                        ///< 分阶段耗时统计
+
+    std::mutex metricsMutex_;                           ///< 保护批次耗时统计的基准
+    TransferMetrics batchMetricsBaseline_;              ///< 当前批次开始时的耗时统计
 };
 
+#ifdef FTPCLIENT_COROUTINES
+/**
+ * @brief 在C++20协程中等待异步传输，例如 FTPClient::FTP_Code res = co_await client.submitDownload(...);
+ *        协程在引擎线程中恢复
+ */
+inline auto operator co_await(FTPClient::TransferHandle transfer)
+{
+    struct Awaiter {
+        FTPClient::TransferHandle transfer;
+
+        bool await_ready() { return transfer->finished(); }
+        void await_suspend(std::coroutine_handle<> handle) { transfer->then([handle](FTPClient::FTP_Code) { handle.resume(); }); }
+        FTPClient::FTP_Code await_resume() { return transfer->wait(); }
+    };
+    return Awaiter{transfer};
+}
+#endif
+
 #endif  // FTPCLIENT_H
@@ -0,0 +1,62 @@
+#include "FTPConcurrencyController.h"
+
+#include <algorithm>
+
+FTPConcurrencyController::FTPConcurrencyController(size_t minLevel, size_t maxLevel, size_t initialLevel)
+    : minLevel_(minLevel > 0 ? minLevel : 1),
+      maxLevel_(std::max(maxLevel, minLevel > 0 ? minLevel : 1)),
+      level_(std::min(std::max(initialLevel, minLevel_), maxLevel_)),
+      lastRate_(0),
+      lastChange_(0),
+      holdPeriods_(0)
+{
+}
+
+size_t FTPConcurrencyController::update(double seconds, curl_off_t bytes, size_t refusals, bool saturated)
+{
+    // 保持该周期数后重新尝试增加
+    const int probePeriods = 5;
+
+    if (refusals > 0) {
+        // 乘性减少，之后重新建立吞吐量基准
+        level_ = std::max(minLevel_, level_ / 2);
+        lastRate_ = 0;
+        lastChange_ = -1;
+        holdPeriods_ = 0;
+        return level_;
+    }
+
+    if (seconds <= 0 || !saturated) {
+        return level_;
+    }
+
+    double rate = bytes / seconds;
+    int change = 0;
+    if (lastRate_ == 0) {
+        change = 1;
+    } else if (lastChange_ == 1) {
+        if (rate < lastRate_ * 0.9) {
+            change = -1;    // 增加后吞吐量明显下降，退回
+        } else if (rate < lastRate_ * 1.05) {
+            change = 0;     // 增加没有带来提升，保持
+        } else {
+            change = 1;
+        }
+    } else if (++holdPeriods_ >= probePeriods) {
+        change = 1;
+    }
+
+    if (change == 1 && level_ < maxLevel_) {
+        ++level_;
+        holdPeriods_ = 0;
+    } else if (change == -1 && level_ > minLevel_) {
+        --level_;
+        holdPeriods_ = 0;
+    } else {
+        change = 0;
+    }
+
+    lastRate_ = rate;
+    lastChange_ = change;
+    return level_;
+}
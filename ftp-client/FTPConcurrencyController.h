@@ -0,0 +1,48 @@
+#ifndef FTPCONCURRENCYCONTROLLER_H
+#define FTPCONCURRENCYCONTROLLER_H
+
+#include <stddef.h>
+
+#include <curl/curl.h>
+
+/**
+ * @brief 按观测到的吞吐量和拒绝次数调整并发传输数量（AIMD）
+ *
+ * 每个测量周期调用一次update：
+ * - 周期内出现连接被拒绝（421/530、连接失败等）时并发数减半；
+ * - 否则在并发数已被用满的前提下逐个增加，增加后吞吐量没有提升则保持，明显下降则退回；
+ * - 保持若干周期后再次尝试增加，以适应服务器和网络的变化。
+ */
+class FTPConcurrencyController
+{
+public:
+    /**
+     * @brief 构造函数
+     * @param minLevel 并发数下限
+     * @param maxLevel 并发数上限
+     * @param initialLevel 初始并发数
+     */
+    FTPConcurrencyController(size_t minLevel, size_t maxLevel, size_t initialLevel);
+
+    /**
+     * @brief 根据一个测量周期的数据计算新的并发数
+     * @param seconds 周期长度
+     * @param bytes 周期内传输的字节数
+     * @param refusals 周期内被服务器拒绝或连接失败的次数
+     * @param saturated 周期内是否有任务因并发数已满而等待，未用满时吞吐量不受并发数限制，不做增加
+     * @return 新的并发数
+     */
+    size_t update(double seconds, curl_off_t bytes, size_t refusals, bool saturated);
+
+    size_t level() const { return level_; }
+
+private:
+    size_t minLevel_;
+    size_t maxLevel_;
+    size_t level_;
+    double lastRate_;       ///< 上一周期的吞吐量，0表示需要重新建立基准
+    int lastChange_;        ///< 上一周期的调整方向：1增加，-1减少，0保持
+    int holdPeriods_;       ///< 已保持的周期数
+};
+
+#endif  // FTPCONCURRENCYCONTROLLER_H
@@ -0,0 +1,256 @@
+#include "FTPConnectionPool.h"
+
+#include <iostream>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <poll.h>
+#endif
+
+std::mutex FTPConnectionPool::registryMutex_;
+std::map<std::string, std::weak_ptr<FTPConnectionPool>> FTPConnectionPool::registry_;
+
+FTPConnectionPool::Lease::Lease()
+    : pool_(NULL),
+      curl_(NULL),
+      reusable_(true)
+{
+}
+
+FTPConnectionPool::Lease::Lease(FTPConnectionPool* pool, CURL* curl)
+    : pool_(pool),
+      curl_(curl),
+      reusable_(true)
+{
+}
+
+FTPConnectionPool::Lease::Lease(Lease&& other)
+    : pool_(other.pool_),
+      curl_(other.curl_),
+      reusable_(other.reusable_)
+{
+    other.curl_ = NULL;
+}
+
+FTPConnectionPool::Lease& FTPConnectionPool::Lease::operator=(Lease&& other)
+{
+    if (this != &other) {
+        release();
+        pool_ = other.pool_;
+        curl_ = other.curl_;
+        reusable_ = other.reusable_;
+        other.curl_ = NULL;
+    }
+    return *this;
+}
+
+FTPConnectionPool::Lease::~Lease()
+{
+    release();
+}
+
+void FTPConnectionPool::Lease::release()
+{
+    if (curl_) {
+        pool_->release(curl_, reusable_);
+        curl_ = NULL;
+    }
+}
+
+std::shared_ptr<FTPConnectionPool> FTPConnectionPool::shared(const std::string& host, const std::string& username, const std::string& password)
+{
+    std::string key = host + '\n' + username + '\n' + password;
+
+    std::lock_guard<std::mutex> lock(registryMutex_);
+    std::shared_ptr<FTPConnectionPool> pool = registry_[key].lock();
+    if (!pool) {
+        pool.reset(new FTPConnectionPool(host, username, password));
+        registry_[key] = pool;
+    }
+
+    // 顺带清理已失效的条目
+    for (auto it = registry_.begin(); it != registry_.end();) {
+        if (it->second.expired())
+            it = registry_.erase(it);
+        else
+            ++it;
+    }
+
+    return pool;
+}
+
+FTPConnectionPool::FTPConnectionPool(const std::string& host, const std::string& username, const std::string& password)
+    : host_(host),
+      username_(username),
+      password_(password),
+      trafficHost_(FTPTrafficControl::host(host)),
+      maxSize_(8),
+      idleTimeout_(60)
+{
+    trafficHost_->addIdleConnections(this);
+}
+
+FTPConnectionPool::~FTPConnectionPool()
+{
+    trafficHost_->removeIdleConnections(this);
+    clear();
+}
+
+FTPConnectionPool::Lease FTPConnectionPool::acquire()
+{
+    CURL* curl = NULL;
+    std::vector<CURL*> expired;
+
+    // 空闲句柄的名额随句柄一起借出
+    do{
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        while (!idle_.empty()) {
+            IdleHandle handle = idle_.back();
+            idle_.pop_back();
+            if (now - handle.since > idleTimeout_) {
+                expired.push_back(handle.curl);
+                continue;
+            }
+            curl = handle.curl;
+            break;
+        }
+    }while(false);
+
+    // 在锁外关闭连接，避免QUIT阻塞其他线程
+    for (CURL* handle : expired) {
+        curl_easy_cleanup(handle);
+        trafficHost_->releaseConnection();
+    }
+
+    bool hasPermit = (curl != NULL);
+    if (curl && !isHealthy(curl)) {
+        // 名额留给新建的连接
+        curl_easy_cleanup(curl);
+        curl = NULL;
+    }
+
+    if (!curl) {
+        if (!hasPermit) {
+            trafficHost_->acquireConnection(this);
+        }
+
+        curl = curl_easy_init();
+        if (!curl) {
+            std::cerr << "Failed to initialize curl handle for: " << host_ << std::endl;
+            trafficHost_->releaseConnection();
+            return Lease();
+        }
+    }
+
+    applyDefaults(curl);
+    return Lease(this, curl);
+}
+
+void FTPConnectionPool::setMaxSize(size_t maxSize)
+{
+    std::vector<CURL*> surplus;
+    do{
+        std::lock_guard<std::mutex> lock(mutex_);
+        maxSize_ = maxSize;
+        while (idle_.size() > maxSize_) {
+            surplus.push_back(idle_.front().curl);
+            idle_.erase(idle_.begin());
+        }
+    }while(false);
+
+    for (CURL* curl : surplus) {
+        curl_easy_cleanup(curl);
+        trafficHost_->releaseConnection();
+    }
+}
+
+void FTPConnectionPool::setIdleTimeout(std::chrono::seconds idleTimeout)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    idleTimeout_ = idleTimeout;
+}
+
+void FTPConnectionPool::clear()
+{
+    std::vector<IdleHandle> handles;
+    do{
+        std::lock_guard<std::mutex> lock(mutex_);
+        handles.swap(idle_);
+    }while(false);
+
+    for (const IdleHandle& handle : handles) {
+        curl_easy_cleanup(handle.curl);
+        trafficHost_->releaseConnection();
+    }
+}
+
+bool FTPConnectionPool::closeIdleConnection()
+{
+    CURL* curl = NULL;
+    do{
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (idle_.empty()) {
+            break;
+        }
+        curl = idle_.front().curl;
+        idle_.erase(idle_.begin());
+    }while(false);
+
+    if (!curl) {
+        return false;
+    }
+    curl_easy_cleanup(curl);
+    trafficHost_->releaseConnection();
+    return true;
+}
+
+void FTPConnectionPool::release(CURL* curl, bool reusable)
+{
+    if (reusable) {
+        // 清除指向调用方栈上对象的回调和数据指针，空闲期间关闭连接时不会再访问它们
+        curl_easy_reset(curl);
+
+        // 放回池中的句柄保留连接，也保留名额
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (idle_.size() < maxSize_) {
+            idle_.push_back({curl, std::chrono::steady_clock::now()});
+            return;
+        }
+    }
+
+    curl_easy_cleanup(curl);
+    trafficHost_->releaseConnection();
+}
+
+bool FTPConnectionPool::isHealthy(CURL* curl)
+{
+    curl_socket_t sockfd = CURL_SOCKET_BAD;
+    if (curl_easy_getinfo(curl, CURLINFO_ACTIVESOCKET, &sockfd) != CURLE_OK || sockfd == CURL_SOCKET_BAD) {
+        // 没有缓存的连接，句柄本身仍可使用，执行时会重新建立连接
+        return true;
+    }
+
+#if defined(__linux__) || defined(__APPLE__)
+    // 空闲的控制连接上不应有任何可读数据，可读说明对端已关闭或发来了421超时通知
+    struct pollfd pfd;
+    pfd.fd = sockfd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) != 0) {
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+void FTPConnectionPool::applyDefaults(CURL* curl)
+{
+    // curl_easy_reset 不会关闭句柄中缓存的连接
+    curl_easy_reset(curl);
+
+    curl_easy_setopt(curl, CURLOPT_USERNAME, username_.c_str());
+    curl_easy_setopt(curl, CURLOPT_PASSWORD, password_.c_str());
+    curl_easy_setopt(curl, CURLOPT_FTP_FILEMETHOD, (long)CURLFTPMETHOD_SINGLECWD);   // 每个文件只发送一次CWD
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+}
@@ -0,0 +1,151 @@
+#ifndef FTPCONNECTIONPOOL_H
+#define FTPCONNECTIONPOOL_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+
+#include <curl/curl.h>
+
+#include "FTPTrafficControl.h"
+
+/**
+ * @brief 已登录FTP控制连接的CURL句柄池
+ *
+ * 连接池按 主机+用户名+密码 在进程内共享，同一账号的多个FTPClient使用同一个池。
+ * 归还的句柄保留libcurl内部缓存的控制连接，再次借出时只重置选项，
+ * 省去TCP连接、USER/PASS登录和PWD的往返。
+ * 借出新句柄时占用主机的一个连接名额，空闲句柄保留其连接和名额，再次借出时沿用，关闭时才归还；
+ * 达到主机连接数上限时请求其他连接池和传输引擎关闭空闲连接，并等待名额归还。
+ */
+class FTPConnectionPool : public FTPTrafficControl::IdleConnections
+{
+public:
+    /**
+     * @brief 借出的CURL句柄，析构时自动归还连接池
+     */
+    class Lease
+    {
+    public:
+        Lease();
+        Lease(FTPConnectionPool* pool, CURL* curl);
+        Lease(Lease&& other);
+        Lease& operator=(Lease&& other);
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease();
+
+        CURL* get() const { return curl_; }
+        explicit operator bool() const { return curl_ != NULL; }
+
+        /**
+         * @brief 标记连接已不可用，归还时直接销毁而不放回池中
+         */
+        void discard() { reusable_ = false; }
+
+        /**
+         * @brief 提前归还句柄
+         */
+        void release();
+
+    private:
+        FTPConnectionPool* pool_;
+        CURL* curl_;
+        bool reusable_;
+    };
+
+    /**
+     * @brief 获取指定账号共享的连接池，不存在则创建
+     * @param host FTP服务器主机名:端口
+     * @param username FTP登录用户名
+     * @param password FTP登录密码
+     * @return 连接池，最后一个持有者释放后池内连接全部关闭
+     */
+    static std::shared_ptr<FTPConnectionPool> shared(const std::string& host, const std::string& username, const std::string& password);
+
+    ~FTPConnectionPool();
+
+    /**
+     * @brief 借出一个已设置登录信息的句柄，优先复用空闲连接，达到主机连接数上限时阻塞等待
+     * @return 借出的句柄，初始化失败时为空
+     */
+    Lease acquire();
+
+    /**
+     * @brief 设置池中最多保留的空闲句柄数量
+     * @param maxSize 空闲句柄数量上限，超出时归还的句柄直接关闭
+     */
+    void setMaxSize(size_t maxSize);
+
+    /**
+     * @brief 设置空闲超时，空闲超过该时间的连接不再复用
+     * @param idleTimeout 空闲超时时间
+     */
+    void setIdleTimeout(std::chrono::seconds idleTimeout);
+
+    /**
+     * @brief 关闭池中所有空闲连接
+     */
+    void clear();
+
+    /**
+     * @brief 关闭空闲时间最长的一个连接并归还其名额，供等待主机连接名额的调用方使用
+     * @return 有空闲连接被关闭返回true
+     */
+    bool closeIdleConnection() override;
+
+    /**
+     * @brief 重置句柄选项并设置登录信息等公共选项
+     * @param curl CURL对象
+     */
+    void applyDefaults(CURL* curl);
+
+    const std::string& host() const { return host_; }
+
+    /**
+     * @brief 主机的带宽和连接数限制，由连接同一主机的所有连接池共享
+     */
+    const std::shared_ptr<FTPTrafficControl::Host>& trafficHost() const { return trafficHost_; }
+
+private:
+    FTPConnectionPool(const std::string& host, const std::string& username, const std::string& password);
+
+    /**
+     * @brief 归还句柄
+     * @param curl CURL对象
+     * @param reusable 是否可以放回池中复用
+     */
+    void release(CURL* curl, bool reusable);
+
+    /**
+     * @brief 检查空闲连接是否仍然可用，服务器已关闭或发来超时通知(421)的连接视为不可用
+     * @param curl CURL对象
+     * @return 可用返回true，否则返回false
+     */
+    static bool isHealthy(CURL* curl);
+
+private:
+    struct IdleHandle {
+        CURL* curl;                                     // 空闲句柄
+        std::chrono::steady_clock::time_point since;    // 归还时间
+    };
+
+    std::string host_;      ///< FTP服务器主机名
+    std::string username_;  ///< FTP登录用户名
+    std::string password_;  ///< FTP登录密码
+
+    std::shared_ptr<FTPTrafficControl::Host> trafficHost_;  ///< 主机的带宽和连接数限制
+
+    std::mutex mutex_;
+    std::vector<IdleHandle> idle_;          ///< 空闲句柄，后进先出，每个都占用一个主机连接名额
+    size_t maxSize_;                        ///< 空闲句柄数量上限
+    std::chrono::seconds idleTimeout_;      ///< 空闲超时时间
+
+    static std::mutex registryMutex_;
+    static std::map<std::string, std::weak_ptr<FTPConnectionPool>> registry_;
+};
+
+#endif  // FTPCONNECTIONPOOL_H
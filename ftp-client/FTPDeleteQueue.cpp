@@ -0,0 +1,176 @@
+#include "FTPDeleteQueue.h"
+
+#include <algorithm>
+#include <iterator>
+#include <cctype>
+#include <cstring>
+#include <chrono>
+
+namespace {
+
+// 一次QUOTE列表中最多的DELE命令数，避免单个文件的结果回调等待过久
+const size_t kMaxBatchSize = 256;
+
+// 队列清空后继续持有连接的时间
+const std::chrono::seconds kIdleTimeout(1);
+
+}  // namespace
+
+FTPDeleteQueue::FTPDeleteQueue(std::shared_ptr<FTPConnectionPool> pool)
+    : pool_(pool),
+      inFlight_(0),
+      stopping_(false)
+{
+}
+
+FTPDeleteQueue::~FTPDeleteQueue()
+{
+    do{
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }while(false);
+    changed_.notify_all();
+
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+void FTPDeleteQueue::enqueue(const std::string& remoteFilePath, Callback callback)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!worker_.joinable()) {
+        worker_ = std::thread(&FTPDeleteQueue::run, this);
+    }
+    pending_.push_back(Request{remoteFilePath, std::move(callback), false});
+    changed_.notify_all();
+}
+
+void FTPDeleteQueue::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this]() { return pending_.empty() && inFlight_ == 0; });
+}
+
+void FTPDeleteQueue::run()
+{
+    FTPConnectionPool::Lease lease;
+    std::vector<Request> requests;
+    std::vector<std::string> replies;
+
+    while (true) {
+        requests.clear();
+        do{
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (pending_.empty() && lease) {
+                // 下载陆续完成时保留连接以便继续使用；空闲一段时间后归还，不长期占用主机的连接名额
+                changed_.wait_for(lock, kIdleTimeout, [this]() { return !pending_.empty() || stopping_; });
+                if (pending_.empty()) {
+                    lock.unlock();
+                    lease.release();
+                    lock.lock();
+                }
+            }
+            changed_.wait(lock, [this]() { return !pending_.empty() || stopping_; });
+            if (pending_.empty()) {
+                return;
+            }
+
+            size_t count = std::min(pending_.size(), kMaxBatchSize);
+            std::move(pending_.begin(), pending_.begin() + count, std::back_inserter(requests));
+            pending_.erase(pending_.begin(), pending_.begin() + count);
+            inFlight_ = count;
+        }while(false);
+
+        replies.assign(requests.size(), std::string());
+        if (!lease) {
+            lease = pool_->acquire();
+        }
+        CURLcode result = CURLE_FAILED_INIT;
+        if (lease) {
+            result = deleteBatch(lease.get(), requests, replies);
+        }
+        if (result != CURLE_OK && lease) {
+            lease.discard();
+            lease.release();
+        }
+
+        // 连接中断时没有得到回复的文件可能未被删除，换一个连接重试一次
+        std::vector<Request> retries;
+        for (size_t i = 0; i < requests.size(); ++i) {
+            Request& request = requests[i];
+            if (replies[i].empty() && !request.retried) {
+                request.retried = true;
+                retries.push_back(std::move(request));
+                continue;
+            }
+            request.callback(!replies[i].empty() && replies[i][0] == '2', replies[i]);
+        }
+
+        do{
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.insert(pending_.begin(), std::make_move_iterator(retries.begin()), std::make_move_iterator(retries.end()));
+            inFlight_ = 0;
+        }while(false);
+        changed_.notify_all();
+    }
+}
+
+CURLcode FTPDeleteQueue::deleteBatch(CURL* curl, const std::vector<Request>& requests, std::vector<std::string>& replies)
+{
+    // *前缀使libcurl忽略失败的命令继续发送下一条，每条的结果由调试回调记录
+    curl_slist* commands = NULL;
+    for (const Request& request : requests) {
+        commands = curl_slist_append(commands, ("*DELE " + request.path).c_str());
+    }
+
+    BatchState state;
+    state.replies = &replies;
+    state.sent = 0;
+    state.awaiting = false;
+
+    curl_easy_setopt(curl, CURLOPT_URL, ("ftp://" + pool_->host() + "/").c_str());
+    curl_easy_setopt(curl, CURLOPT_QUOTE, commands);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t)0);
+    curl_easy_setopt(curl, CURLOPT_UPLOAD, 0L);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+    // 设置了调试回调时VERBOSE的输出只交给回调，不会打印
+    curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, debugCallback);
+    curl_easy_setopt(curl, CURLOPT_DEBUGDATA, &state);
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+
+    CURLcode result = curl_easy_perform(curl);
+
+    // 清理设置的选项，连接在下一批中继续使用
+    curl_easy_setopt(curl, CURLOPT_VERBOSE, 0L);
+    curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, NULL);
+    curl_easy_setopt(curl, CURLOPT_DEBUGDATA, NULL);
+    curl_easy_setopt(curl, CURLOPT_QUOTE, NULL);
+    curl_easy_setopt(curl, CURLOPT_NOBODY, 0L);
+    curl_slist_free_all(commands);
+
+    return result;
+}
+
+int FTPDeleteQueue::debugCallback(CURL* curl, curl_infotype type, char* data, size_t size, BatchState* state)
+{
+    (void)curl;
+    if (type == CURLINFO_HEADER_OUT) {
+        if (size >= 5 && strncmp(data, "DELE ", 5) == 0 && state->sent < state->replies->size()) {
+            ++state->sent;
+            state->awaiting = true;
+        }
+    } else if (type == CURLINFO_HEADER_IN && state->awaiting) {
+        // 多行回复的中间行为"ddd-"，最终行为"ddd "
+        if (size >= 4 && isdigit((unsigned char)data[0]) && isdigit((unsigned char)data[1]) &&
+            isdigit((unsigned char)data[2]) && data[3] == ' ') {
+            while (size > 0 && (data[size - 1] == '\r' || data[size - 1] == '\n')) {
+                --size;
+            }
+            (*state->replies)[state->sent - 1].assign(data, size);
+            state->awaiting = false;
+        }
+    }
+    return 0;
+}
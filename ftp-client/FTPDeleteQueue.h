@@ -0,0 +1,107 @@
+#ifndef FTPDELETEQUEUE_H
+#define FTPDELETEQUEUE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+
+#include <curl/curl.h>
+
+#include "FTPConnectionPool.h"
+
+/**
+ * @brief 远程文件删除队列
+ *
+ * 下载完成的文件放入队列后由一个后台线程删除。线程从连接池借出一个连接并一直使用，
+ * 队列空闲一段时间后归还。每次取出队列中的所有路径（最多256个），作为一个QUOTE列表在控制连接上连续发送DELE，
+ * 一批只需一次curl_easy_perform。命令带*前缀，单个文件删除失败不影响后续命令，
+ * 每个文件的结果通过调试回调中的命令和回复逐条对应得到。正在删除一批时到达的路径合并到下一批。
+ */
+class FTPDeleteQueue
+{
+public:
+    /**
+     * @brief 删除结果回调，在删除线程中调用
+     * @param deleted 服务器是否以2xx回复DELE
+     * @param reply 服务器的回复，连接失败未得到回复时为空
+     */
+    typedef std::function<void(bool deleted, const std::string& reply)> Callback;
+
+    /**
+     * @brief 构造函数
+     * @param pool 借出删除连接的连接池
+     */
+    explicit FTPDeleteQueue(std::shared_ptr<FTPConnectionPool> pool);
+
+    /**
+     * @brief 析构函数，等待队列中的文件全部删除后返回
+     */
+    ~FTPDeleteQueue();
+
+    FTPDeleteQueue(const FTPDeleteQueue&) = delete;
+    FTPDeleteQueue& operator=(const FTPDeleteQueue&) = delete;
+
+    /**
+     * @brief 将文件加入删除队列，删除线程在首次调用时启动
+     * @param remoteFilePath 远程文件路径，以/开头
+     * @param callback 删除结果回调
+     */
+    void enqueue(const std::string& remoteFilePath, Callback callback);
+
+    /**
+     * @brief 等待队列中的文件全部删除
+     */
+    void wait();
+
+private:
+    struct Request {
+        std::string path;           // 远程文件路径
+        Callback callback;          // 删除结果回调
+        bool retried;               // 连接中断后是否已重试过
+    };
+
+    /**
+     * @brief 一批删除命令的执行状态，由调试回调填写
+     */
+    struct BatchState {
+        std::vector<std::string>* replies;  // 每个命令的最终回复行，顺序与命令相同
+        size_t sent;                        // 已发送的DELE数量
+        bool awaiting;                      // 最后发送的DELE是否还在等待回复
+    };
+
+    /**
+     * @brief 删除线程的主循环
+     */
+    void run();
+
+    /**
+     * @brief 在一个连接上删除一批文件
+     * @param curl CURL对象
+     * @param requests 本批的请求
+     * @param replies 每个请求的服务器回复，未得到回复的为空
+     * @return curl_easy_perform的结果
+     */
+    CURLcode deleteBatch(CURL* curl, const std::vector<Request>& requests, std::vector<std::string>& replies);
+
+    /**
+     * @brief 调试回调，按顺序把发出的DELE与收到的最终回复行对应起来
+     */
+    static int debugCallback(CURL* curl, curl_infotype type, char* data, size_t size, BatchState* state);
+
+private:
+    std::shared_ptr<FTPConnectionPool> pool_;   ///< 连接池
+
+    std::mutex mutex_;
+    std::condition_variable changed_;           ///< 有新请求、一批完成或停止时通知
+    std::deque<Request> pending_;               ///< 等待删除的请求
+    size_t inFlight_;                           ///< 正在删除的请求数
+    bool stopping_;                             ///< 析构时设置，删除线程处理完队列后退出
+    std::thread worker_;                        ///< 删除线程
+};
+
+#endif  // FTPDELETEQUEUE_H
@@ -0,0 +1,186 @@
+#include "FTPDownloadLedger.h"
+
+#include <iostream>
+#include <cstdio>
+
+std::mutex FTPDownloadLedger::registryMutex_;
+std::map<std::string, std::weak_ptr<FTPDownloadLedger>> FTPDownloadLedger::registry_;
+
+std::shared_ptr<FTPDownloadLedger> FTPDownloadLedger::shared(const std::string& ledgerPath)
+{
+    std::lock_guard<std::mutex> lock(registryMutex_);
+    std::shared_ptr<FTPDownloadLedger> ledger = registry_[ledgerPath].lock();
+    if (!ledger) {
+        ledger.reset(new FTPDownloadLedger(ledgerPath));
+        registry_[ledgerPath] = ledger;
+    }
+
+    // 顺带清理已失效的条目
+    for (auto it = registry_.begin(); it != registry_.end();) {
+        if (it->second.expired())
+            it = registry_.erase(it);
+        else
+            ++it;
+    }
+
+    return ledger;
+}
+
+FTPDownloadLedger::FTPDownloadLedger(const std::string& ledgerPath)
+    : ledgerPath_(ledgerPath),
+      staleCount_(0)
+{
+    bool unterminated = load();
+
+    // 上次运行留下的旧记录过多，或最后一行不完整时先压缩，压缩后的文件只含完整的记录；
+    // 不完整的行若只是接上换行，下次载入时会被当作路径被截断的记录
+    if ((unterminated || staleCount_ > records_.size()) && compactLocked()) {
+        unterminated = false;
+    }
+
+    if (!log_.is_open()) {
+        log_.open(ledgerPath_, std::ios::out | std::ios::app | std::ios::binary);
+    }
+    if (!log_.is_open()) {
+        std::cerr << "Failed to open download ledger: " << ledgerPath_ << std::endl;
+        return;
+    }
+
+    // 压缩失败时先换行再追加，新记录不会接在不完整的行后面
+    if (unterminated) {
+        log_ << '\n';
+        log_.flush();
+    }
+}
+
+FTPDownloadLedger::~FTPDownloadLedger()
+{
+    log_.close();
+}
+
+bool FTPDownloadLedger::load()
+{
+    std::ifstream file(ledgerPath_, std::ios::in | std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    // 每行格式：大小\t修改时间\t远程路径
+    std::string line;
+    while (std::getline(file, line)) {
+        if (file.eof()) {
+            // 没有换行结尾，即使字段齐全，路径也可能被截断
+            ++staleCount_;
+            return true;
+        }
+
+        size_t first = line.find('\t');
+        size_t second = first == std::string::npos ? std::string::npos : line.find('\t', first + 1);
+        if (second == std::string::npos) {
+            // 写入中途崩溃留下的不完整行
+            ++staleCount_;
+            continue;
+        }
+
+        Record record;
+        try {
+            record.fileSize = std::stoll(line.substr(0, first));
+            record.modifyTime = (time_t)std::stoll(line.substr(first + 1, second - first - 1));
+        } catch (const std::exception&) {
+            ++staleCount_;
+            continue;
+        }
+
+        auto result = records_.insert(std::make_pair(line.substr(second + 1), record));
+        if (!result.second) {
+            result.first->second = record;
+            ++staleCount_;
+        }
+    }
+    return false;
+}
+
+bool FTPDownloadLedger::contains(const std::string& remotePath, curl_off_t fileSize, time_t modifyTime)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = records_.find(remotePath);
+    return it != records_.end() && it->second.fileSize == fileSize && it->second.modifyTime == modifyTime;
+}
+
+bool FTPDownloadLedger::record(const std::string& remotePath, curl_off_t fileSize, time_t modifyTime)
+{
+    if (remotePath.find('\n') != std::string::npos) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto result = records_.insert(std::make_pair(remotePath, Record{fileSize, modifyTime}));
+    if (!result.second) {
+        if (result.first->second.fileSize == fileSize && result.first->second.modifyTime == modifyTime) {
+            return true;
+        }
+        result.first->second = Record{fileSize, modifyTime};
+        ++staleCount_;
+    }
+
+    if (!log_.is_open()) {
+        return false;
+    }
+    log_ << fileSize << '\t' << (long long)modifyTime << '\t' << remotePath << '\n';
+    log_.flush();
+
+    // 旧记录数量超过有效记录时压缩，保证文件大小与有效记录数同阶
+    if (staleCount_ > 1024 && staleCount_ > records_.size()) {
+        compactLocked();
+    }
+
+    return log_.good();
+}
+
+bool FTPDownloadLedger::compact()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return compactLocked();
+}
+
+size_t FTPDownloadLedger::size()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return records_.size();
+}
+
+bool FTPDownloadLedger::compactLocked()
+{
+    // 先写入临时文件再替换，压缩中途崩溃不会丢失记录
+    std::string tempPath = ledgerPath_ + ".tmp";
+    do{
+        std::ofstream temp(tempPath, std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!temp) {
+            std::cerr << "Failed to compact download ledger: " << ledgerPath_ << std::endl;
+            return false;
+        }
+        for (const auto& item : records_) {
+            temp << item.second.fileSize << '\t' << (long long)item.second.modifyTime << '\t' << item.first << '\n';
+        }
+        temp.flush();
+        if (!temp.good()) {
+            std::cerr << "Failed to compact download ledger: " << ledgerPath_ << std::endl;
+            return false;
+        }
+    }while(false);
+
+    log_.close();
+#if defined(_WIN32)
+    std::remove(ledgerPath_.c_str());
+#endif
+    bool renamed = std::rename(tempPath.c_str(), ledgerPath_.c_str()) == 0;
+    if (renamed) {
+        staleCount_ = 0;
+    } else {
+        std::cerr << "Failed to compact download ledger: " << ledgerPath_ << std::endl;
+    }
+
+    log_.clear();
+    log_.open(ledgerPath_, std::ios::out | std::ios::app | std::ios::binary);
+    return renamed && log_.is_open();
+}
@@ -0,0 +1,89 @@
+#ifndef FTPDOWNLOADLEDGER_H
+#define FTPDOWNLOADLEDGER_H
+
+#include <string>
+#include <fstream>
+#include <unordered_map>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <curl/curl.h>
+
+/**
+ * @brief 已下载文件记录
+ *
+ * 记录按 远程路径+大小+修改时间 精确匹配，远程文件变化后不再视为已下载。
+ * 打开时把记录文件一次性载入哈希索引，之后查询为O(1)；新记录追加到文件末尾，
+ * 被覆盖的旧记录过多时重写文件进行压缩。同一路径的记录文件在进程内共享，可在多个线程中使用。
+ */
+class FTPDownloadLedger
+{
+public:
+    /**
+     * @brief 获取指定记录文件对应的记录，不存在则载入
+     * @param ledgerPath 记录文件路径
+     * @return 下载记录，最后一个持有者释放后关闭文件
+     */
+    static std::shared_ptr<FTPDownloadLedger> shared(const std::string& ledgerPath);
+
+    ~FTPDownloadLedger();
+
+    /**
+     * @brief 判断文件是否已下载
+     * @param remotePath 远程文件路径
+     * @param fileSize 文件大小
+     * @param modifyTime 修改时间
+     * @return 存在完全相同的记录时返回true
+     */
+    bool contains(const std::string& remotePath, curl_off_t fileSize, time_t modifyTime);
+
+    /**
+     * @brief 记录已下载的文件，覆盖同一路径的旧记录
+     * @param remotePath 远程文件路径
+     * @param fileSize 文件大小
+     * @param modifyTime 修改时间
+     * @return 写入记录文件成功返回true
+     */
+    bool record(const std::string& remotePath, curl_off_t fileSize, time_t modifyTime);
+
+    /**
+     * @brief 重写记录文件，去掉被覆盖的旧记录
+     * @return 成功返回true
+     */
+    bool compact();
+
+    size_t size();
+
+private:
+    explicit FTPDownloadLedger(const std::string& ledgerPath);
+
+    /**
+     * @brief 载入记录文件，没有以换行结尾的最后一行视为写入中途崩溃留下的不完整记录
+     * @return 最后一行不完整时返回true
+     */
+    bool load();
+
+    /**
+     * @brief 重写记录文件，调用方须持有mutex_
+     */
+    bool compactLocked();
+
+private:
+    struct Record {
+        curl_off_t fileSize;    // 文件大小
+        time_t modifyTime;      // 修改时间
+    };
+
+    std::string ledgerPath_;                            ///< 记录文件路径
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, Record> records_;   ///< 远程路径到记录的索引
+    std::ofstream log_;                                 ///< 追加写入的记录文件
+    size_t staleCount_;                                 ///< 记录文件中已被覆盖的记录数量
+
+    static std::mutex registryMutex_;
+    static std::map<std::string, std::weak_ptr<FTPDownloadLedger>> registry_;
+};
+
+#endif  // FTPDOWNLOADLEDGER_H
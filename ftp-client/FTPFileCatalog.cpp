@@ -0,0 +1,102 @@
+#include "FTPFileCatalog.h"
+
+std::string FTPFileCatalog::View::fullPath() const
+{
+    std::string_view directory = path();
+    std::string_view fileName = name();
+
+    std::string result;
+    result.reserve(directory.size() + fileName.size());
+    result.append(directory.data(), directory.size()).append(fileName.data(), fileName.size());
+    return result;
+}
+
+FTPFileCatalog::FTPFileCatalog()
+{
+    nameOffsets_.push_back(0);
+    // 编号0为空字符串，MLSD不返回用户名等字段时使用
+    intern(std::string_view());
+}
+
+size_t FTPFileCatalog::add(std::string_view path, const FTPListParser::Entry& entry)
+{
+    size_t index = sizes_.size();
+
+    names_.append(entry.name.data(), entry.name.size());
+    nameOffsets_.push_back(names_.size());
+    // 同一目录的文件连续添加，与上一个文件比较即可省去大部分查找
+    if (!directories_.empty() && string(directories_.back()) == path) {
+        directories_.push_back(directories_.back());
+    } else {
+        directories_.push_back(intern(path));
+    }
+    permissions_.push_back(intern(entry.permissions));
+    owners_.push_back(intern(entry.owner));
+    groups_.push_back(intern(entry.group));
+    sizes_.push_back(entry.size > 0 ? entry.size : 0);
+    modifyTimes_.push_back(entry.modifyTime);
+
+    return index;
+}
+
+void FTPFileCatalog::reserve(size_t count, size_t nameBytes)
+{
+    names_.reserve(nameBytes);
+    nameOffsets_.reserve(count + 1);
+    directories_.reserve(count);
+    permissions_.reserve(count);
+    owners_.reserve(count);
+    groups_.reserve(count);
+    sizes_.reserve(count);
+    modifyTimes_.reserve(count);
+}
+
+void FTPFileCatalog::clear()
+{
+    stringIds_.clear();
+    strings_.clear();
+    names_.clear();
+    nameOffsets_.assign(1, 0);
+    directories_.clear();
+    permissions_.clear();
+    owners_.clear();
+    groups_.clear();
+    sizes_.clear();
+    modifyTimes_.clear();
+
+    intern(std::string_view());
+}
+
+size_t FTPFileCatalog::memoryUsage() const
+{
+    size_t bytes = sizeof(*this);
+
+    bytes += names_.capacity();
+    bytes += nameOffsets_.capacity() * sizeof(uint64_t);
+    bytes += (directories_.capacity() + permissions_.capacity() + owners_.capacity() + groups_.capacity()) * sizeof(uint32_t);
+    bytes += (sizes_.capacity() + modifyTimes_.capacity()) * sizeof(int64_t);
+
+    // 字符串池：每个字符串对象、超出短字符串优化的堆内存，以及索引的节点和桶
+    for (const std::string& value : strings_) {
+        bytes += sizeof(std::string);
+        if (value.capacity() >= sizeof(std::string)) {
+            bytes += value.capacity() + 1;
+        }
+    }
+    bytes += stringIds_.size() * (sizeof(std::pair<const std::string_view, uint32_t>) + 2 * sizeof(void*));
+    bytes += stringIds_.bucket_count() * sizeof(void*);
+    return bytes;
+}
+
+uint32_t FTPFileCatalog::intern(std::string_view value)
+{
+    auto it = stringIds_.find(value);
+    if (it != stringIds_.end()) {
+        return it->second;
+    }
+
+    uint32_t id = (uint32_t)strings_.size();
+    strings_.emplace_back(value.data(), value.size());
+    stringIds_.emplace(strings_.back(), id);
+    return id;
+}
@@ -0,0 +1,157 @@
+#ifndef FTPFILECATALOG_H
+#define FTPFILECATALOG_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <iterator>
+#include <ctime>
+#include <stdint.h>
+
+#include <curl/curl.h>
+
+#include "FTPListParser.h"
+
+/**
+ * @brief 远程文件目录
+ *
+ * 按列存储大量远程文件的信息：目录路径、用户名、用户组和权限在字符串池中只保存一份，
+ * 每个文件只记录其编号；文件名连续存放在一块内存中；大小和修改时间为64位整数。
+ * 每个文件约占40字节加文件名长度，而FTPFileInfo需要7个std::string。
+ * 不保存服务器返回的原始日期文本，只保存解析后的修改时间。
+ * 通过View按行访问，返回的字符串切片在下次add或clear前有效。不是线程安全的，并发添加须由调用方加锁。
+ */
+class FTPFileCatalog
+{
+public:
+    /**
+     * @brief 一个文件的只读视图
+     */
+    class View
+    {
+    public:
+        View(const FTPFileCatalog* catalog, size_t index) : catalog_(catalog), index_(index) {}
+
+        std::string_view path() const { return catalog_->string(catalog_->directories_[index_]); }           // 所在目录，以/开头和结尾
+        std::string_view name() const { return catalog_->name(index_); }                                     // 文件名
+        std::string_view permissions() const { return catalog_->string(catalog_->permissions_[index_]); }    // 文件权限
+        std::string_view owner() const { return catalog_->string(catalog_->owners_[index_]); }               // 用户名
+        std::string_view group() const { return catalog_->string(catalog_->groups_[index_]); }               // 用户组
+        curl_off_t size() const { return catalog_->sizes_[index_]; }                                         // 文件大小
+        time_t modifyTime() const { return (time_t)catalog_->modifyTimes_[index_]; }                         // 修改时间，未知时为-1
+
+        /**
+         * @brief 完整路径，即path() + name()
+         */
+        std::string fullPath() const;
+
+        size_t index() const { return index_; }
+
+    private:
+        const FTPFileCatalog* catalog_;
+        size_t index_;
+    };
+
+    class Iterator
+    {
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef View value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const View* pointer;
+        typedef View reference;
+
+        Iterator(const FTPFileCatalog* catalog, size_t index) : catalog_(catalog), index_(index) {}
+
+        View operator*() const { return View(catalog_, index_); }
+        View operator[](difference_type n) const { return View(catalog_, index_ + n); }
+        Iterator& operator++() { ++index_; return *this; }
+        Iterator operator++(int) { Iterator it = *this; ++index_; return it; }
+        Iterator& operator--() { --index_; return *this; }
+        Iterator operator--(int) { Iterator it = *this; --index_; return it; }
+        Iterator& operator+=(difference_type n) { index_ += n; return *this; }
+        Iterator& operator-=(difference_type n) { index_ -= n; return *this; }
+        Iterator operator+(difference_type n) const { return Iterator(catalog_, index_ + n); }
+        Iterator operator-(difference_type n) const { return Iterator(catalog_, index_ - n); }
+        difference_type operator-(const Iterator& other) const { return (difference_type)index_ - (difference_type)other.index_; }
+        bool operator==(const Iterator& other) const { return index_ == other.index_; }
+        bool operator!=(const Iterator& other) const { return index_ != other.index_; }
+        bool operator<(const Iterator& other) const { return index_ < other.index_; }
+
+    private:
+        const FTPFileCatalog* catalog_;
+        size_t index_;
+    };
+
+public:
+    FTPFileCatalog();
+
+    FTPFileCatalog(const FTPFileCatalog&) = delete;
+    FTPFileCatalog& operator=(const FTPFileCatalog&) = delete;
+
+    /**
+     * @brief 添加目录列表中的一个文件
+     * @param path 所在目录，以/开头和结尾
+     * @param entry 解析出的列表条目，其中的切片只在调用期间使用
+     * @return 文件的序号
+     */
+    size_t add(std::string_view path, const FTPListParser::Entry& entry);
+
+    /**
+     * @brief 预留文件数量，减少列存储扩容
+     * @param count 文件数量
+     * @param nameBytes 文件名总字节数
+     */
+    void reserve(size_t count, size_t nameBytes = 0);
+
+    void clear();
+
+    size_t size() const { return sizes_.size(); }
+    bool empty() const { return sizes_.empty(); }
+
+    View operator[](size_t index) const { return View(this, index); }
+    Iterator begin() const { return Iterator(this, 0); }
+    Iterator end() const { return Iterator(this, size()); }
+
+    /**
+     * @brief 字符串池中不同字符串的数量
+     */
+    size_t internedCount() const { return strings_.size(); }
+
+    /**
+     * @brief 估算占用的内存字节数，包括已分配未使用的容量
+     */
+    size_t memoryUsage() const;
+
+private:
+    /**
+     * @brief 取得字符串在池中的编号，不存在则加入
+     * @param value 字符串
+     * @return 编号
+     */
+    uint32_t intern(std::string_view value);
+
+    std::string_view string(uint32_t id) const { return strings_[id]; }
+
+    std::string_view name(size_t index) const
+    {
+        return std::string_view(names_.data() + nameOffsets_[index], nameOffsets_[index + 1] - nameOffsets_[index]);
+    }
+
+private:
+    std::deque<std::string> strings_;                           ///< 字符串池，deque扩容时不移动已有元素，索引中的切片保持有效
+    std::unordered_map<std::string_view, uint32_t> stringIds_;  ///< 字符串到编号的索引
+
+    std::string names_;                     ///< 所有文件名首尾相接
+    std::vector<uint64_t> nameOffsets_;     ///< 第i个文件名位于[nameOffsets_[i], nameOffsets_[i + 1])
+    std::vector<uint32_t> directories_;     ///< 所在目录的编号
+    std::vector<uint32_t> permissions_;     ///< 权限的编号
+    std::vector<uint32_t> owners_;          ///< 用户名的编号
+    std::vector<uint32_t> groups_;          ///< 用户组的编号
+    std::vector<int64_t> sizes_;            ///< 文件大小
+    std::vector<int64_t> modifyTimes_;      ///< 修改时间
+};
+
+#endif  // FTPFILECATALOG_H
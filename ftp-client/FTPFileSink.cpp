@@ -0,0 +1,342 @@
+#include "FTPFileSink.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+std::unique_ptr<FTPFileSink> FTPFileSink::create(const Options& options)
+{
+#if defined(__linux__) || defined(__APPLE__)
+    return std::unique_ptr<FTPFileSink>(new FTPBufferedFileSink(options));
+#else
+    return std::unique_ptr<FTPFileSink>(new FTPStreamSink());
+#endif
+}
+
+FTPStreamSink::FTPStreamSink()
+    : position_(0)
+{
+}
+
+bool FTPStreamSink::open(const std::string& path, bool resume)
+{
+    if (resume) {
+        file_.open(path, std::ios::out | std::ios::in | std::ios::binary);
+    }
+    if (!file_.is_open()) {
+        file_.open(path, std::ios::out | std::ios::trunc | std::ios::binary);
+    }
+    if (!file_.is_open()) {
+        return false;
+    }
+
+    file_.seekp(0, std::ios::end);
+    position_ = static_cast<curl_off_t>(file_.tellp());
+    return true;
+}
+
+bool FTPStreamSink::write(const char* data, size_t size)
+{
+    file_.write(data, size);
+    position_ += size;
+    return !file_.fail();
+}
+
+bool FTPStreamSink::close()
+{
+    if (!file_.is_open()) {
+        return true;
+    }
+    file_.close();
+    return !file_.fail();
+}
+
+FTPCallbackSink::FTPCallbackSink(WriteFunction function)
+    : function_(function),
+      position_(0),
+      opened_(false)
+{
+}
+
+bool FTPCallbackSink::open(const std::string&, bool)
+{
+    position_ = 0;
+    opened_ = true;
+    return true;
+}
+
+bool FTPCallbackSink::write(const char* data, size_t size)
+{
+    position_ += size;
+    return function_(data, size);
+}
+
+bool FTPCallbackSink::close()
+{
+    opened_ = false;
+    return true;
+}
+
+FTPStringSink::FTPStringSink(std::string* buffer)
+    : buffer_(buffer),
+      opened_(false)
+{
+}
+
+bool FTPStringSink::open(const std::string&, bool)
+{
+    buffer_->clear();
+    opened_ = true;
+    return true;
+}
+
+void FTPStringSink::reserve(curl_off_t totalSize)
+{
+    if (totalSize > 0 && (unsigned long long)totalSize < buffer_->max_size()) {
+        buffer_->reserve((size_t)totalSize);
+    }
+}
+
+bool FTPStringSink::write(const char* data, size_t size)
+{
+    buffer_->append(data, size);
+    return true;
+}
+
+bool FTPStringSink::close()
+{
+    opened_ = false;
+    return true;
+}
+
+#if defined(__linux__) || defined(__APPLE__)
+
+FTPBufferedFileSink::FTPBufferedFileSink(const Options& options)
+    : options_(options),
+      fd_(-1),
+      ownsFd_(false),
+      direct_(false),
+      failed_(false),
+      buffer_(NULL),
+      capacity_(0),
+      used_(0),
+      offset_(0),
+      reserved_(false)
+{
+    // O_DIRECT要求整块写入，此时至少需要一块缓冲
+    capacity_ = options_.bufferSize;
+    if (options_.directIO && capacity_ < alignment) {
+        capacity_ = alignment;
+    }
+    capacity_ = (capacity_ + alignment - 1) / alignment * alignment;
+
+    if (capacity_ > 0) {
+        void* buffer = NULL;
+        if (posix_memalign(&buffer, alignment, capacity_) == 0) {
+            buffer_ = static_cast<char*>(buffer);
+        } else {
+            capacity_ = 0;
+        }
+    }
+}
+
+FTPBufferedFileSink::~FTPBufferedFileSink()
+{
+    close();
+    free(buffer_);
+}
+
+bool FTPBufferedFileSink::open(const std::string& path, bool resume)
+{
+    close();
+
+    int flags = O_WRONLY | O_CREAT;
+    if (!resume) {
+        flags |= O_TRUNC;
+    }
+    fd_ = ::open(path.c_str(), flags, 0644);
+    if (fd_ < 0) {
+        return false;
+    }
+    ownsFd_ = true;
+    failed_ = false;
+    reserved_ = false;
+    used_ = 0;
+
+    off_t end = resume ? lseek(fd_, 0, SEEK_END) : 0;
+    offset_ = end > 0 ? (curl_off_t)end : 0;
+
+    direct_ = false;
+#if defined(O_DIRECT)
+    // 文件系统不支持时fcntl返回EINVAL，继续使用页缓存
+    if (options_.directIO && buffer_ && offset_ % alignment == 0) {
+        int current = fcntl(fd_, F_GETFL);
+        direct_ = current >= 0 && fcntl(fd_, F_SETFL, current | O_DIRECT) == 0;
+    }
+#endif
+
+    return true;
+}
+
+void FTPBufferedFileSink::attach(int fd, curl_off_t offset)
+{
+    close();
+
+    fd_ = fd;
+    ownsFd_ = false;
+    direct_ = false;
+    failed_ = false;
+    reserved_ = false;
+    used_ = 0;
+    offset_ = offset;
+}
+
+void FTPBufferedFileSink::reserve(curl_off_t totalSize)
+{
+    if (!options_.preallocate || fd_ < 0 || !ownsFd_ || totalSize <= position()) {
+        return;
+    }
+
+#if defined(__linux__)
+    // FALLOC_FL_KEEP_SIZE 只分配空间不改变文件长度，远程大小不准确时文件也不会多出数据
+    if (fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, (off_t)totalSize) == 0) {
+        reserved_ = true;
+    }
+#endif
+}
+
+bool FTPBufferedFileSink::write(const char* data, size_t size)
+{
+    if (failed_ || fd_ < 0) {
+        return false;
+    }
+
+    // 缓冲区为空且数据超过一块缓冲时直接写入，省去一次复制
+    if (!direct_ && used_ == 0 && size >= capacity_) {
+        if (!writeAt(data, size, offset_)) {
+            failed_ = true;
+            return false;
+        }
+        offset_ += size;
+        return true;
+    }
+
+    while (size > 0) {
+        size_t n = std::min(size, capacity_ - used_);
+        memcpy(buffer_ + used_, data, n);
+        used_ += n;
+        data += n;
+        size -= n;
+
+        if (used_ == capacity_ && !flush(false)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FTPBufferedFileSink::flush(bool all)
+{
+    size_t count = used_;
+    if (direct_) {
+        count -= count % alignment;
+    }
+
+    if (count > 0) {
+        if (!writeAt(buffer_, count, offset_)) {
+            failed_ = true;
+            return false;
+        }
+        offset_ += count;
+        used_ -= count;
+        memmove(buffer_, buffer_ + count, used_);
+    }
+
+    if (all && used_ > 0) {
+#if defined(O_DIRECT)
+        // 末尾不足一块的数据不能以O_DIRECT写入
+        int current = fcntl(fd_, F_GETFL);
+        if (current >= 0) {
+            fcntl(fd_, F_SETFL, current & ~O_DIRECT);
+        }
+        direct_ = false;
+#endif
+        if (!writeAt(buffer_, used_, offset_)) {
+            failed_ = true;
+            return false;
+        }
+        offset_ += used_;
+        used_ = 0;
+    }
+
+    return true;
+}
+
+bool FTPBufferedFileSink::writeAt(const char* data, size_t size, curl_off_t offset)
+{
+    while (size > 0) {
+        ssize_t n = pwrite(fd_, data, size, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+bool FTPBufferedFileSink::close()
+{
+    if (fd_ < 0) {
+        return !failed_;
+    }
+
+    bool succeeded = !failed_ && flush(true);
+
+    if (ownsFd_) {
+        // 传输提前结束时释放文件末尾之后预分配的空间
+        if (reserved_ && ftruncate(fd_, (off_t)offset_) != 0) {
+            succeeded = false;
+        }
+        if (succeeded && options_.syncOnClose && fsync(fd_) != 0) {
+            succeeded = false;
+        }
+        if (::close(fd_) != 0) {
+            succeeded = false;
+        }
+    }
+    fd_ = -1;
+    ownsFd_ = false;
+    direct_ = false;
+    used_ = 0;
+
+    return succeeded;
+}
+
+#else
+
+// 其他平台由create返回FTPStreamSink，这里只保留空实现
+FTPBufferedFileSink::FTPBufferedFileSink(const Options& options)
+    : options_(options), fd_(-1), ownsFd_(false), direct_(false), failed_(true),
+      buffer_(NULL), capacity_(0), used_(0), offset_(0), reserved_(false) {}
+FTPBufferedFileSink::~FTPBufferedFileSink() {}
+bool FTPBufferedFileSink::open(const std::string&, bool) { return false; }
+void FTPBufferedFileSink::attach(int, curl_off_t) {}
+void FTPBufferedFileSink::reserve(curl_off_t) {}
+bool FTPBufferedFileSink::write(const char*, size_t) { return false; }
+bool FTPBufferedFileSink::flush(bool) { return false; }
+bool FTPBufferedFileSink::writeAt(const char*, size_t, curl_off_t) { return false; }
+bool FTPBufferedFileSink::close() { return true; }
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef FTPFILESINK_H
+#define FTPFILESINK_H
+
+#include <string>
+#include <fstream>
+#include <memory>
+#include <functional>
+
+#include <stddef.h>
+
+#include <curl/curl.h>
+
+/**
+ * @brief 下载数据写入本地文件的接口
+ *
+ * libcurl每次回调只交付16KB左右的数据，直接写入文件会产生大量小的写系统调用。
+ * create按选项返回具体实现：POSIX平台上为带大块对齐缓冲的FTPBufferedFileSink，
+ * 其他平台为基于std::ofstream的FTPStreamSink。FTPCallbackSink和FTPStringSink不写入文件，用于把下载内容直接交给调用方。
+ */
+class FTPFileSink
+{
+public:
+    struct Options {
+        size_t bufferSize;      // 写缓冲大小，0表示每次回调直接写入
+        bool preallocate;       // 按已知的文件大小预分配磁盘空间
+        bool directIO;          // 使用O_DIRECT绕过页缓存，仅在POSIX平台且偏移量对齐时生效
+        bool syncOnClose;       // 关闭时调用fsync，close返回true即表示数据已写入磁盘，仅在POSIX平台生效
+
+        Options() : bufferSize(1024 * 1024), preallocate(true), directIO(false), syncOnClose(false) {}
+    };
+
+public:
+    /**
+     * @brief 按选项创建写入对象
+     * @param options 写入选项
+     * @return 写入对象
+     */
+    static std::unique_ptr<FTPFileSink> create(const Options& options);
+
+    virtual ~FTPFileSink() {}
+
+    /**
+     * @brief 打开本地文件
+     * @param path 本地文件路径
+     * @param resume 为true时保留已有内容并从末尾继续写入，否则清空文件
+     * @return 成功返回true
+     */
+    virtual bool open(const std::string& path, bool resume) = 0;
+
+    /**
+     * @brief 当前写入位置，打开续传文件后即为续传偏移量
+     */
+    virtual curl_off_t position() const = 0;
+
+    /**
+     * @brief 预分配到指定的文件总大小，不改变文件长度，不支持时忽略
+     * @param totalSize 文件总大小
+     */
+    virtual void reserve(curl_off_t totalSize) = 0;
+
+    /**
+     * @brief 写入数据
+     * @param data 数据
+     * @param size 字节数
+     * @return 成功返回true
+     */
+    virtual bool write(const char* data, size_t size) = 0;
+
+    /**
+     * @brief 写出缓冲区中剩余的数据并关闭文件
+     * @return 所有数据都写入成功返回true
+     */
+    virtual bool close() = 0;
+
+    virtual bool isOpen() const = 0;
+};
+
+/**
+ * @brief 基于std::ofstream的写入对象，即原有的写入方式
+ */
+class FTPStreamSink : public FTPFileSink
+{
+public:
+    FTPStreamSink();
+
+    bool open(const std::string& path, bool resume) override;
+    curl_off_t position() const override { return position_; }
+    void reserve(curl_off_t) override {}
+    bool write(const char* data, size_t size) override;
+    bool close() override;
+    bool isOpen() const override { return file_.is_open(); }
+
+private:
+    std::ofstream file_;
+    curl_off_t position_;
+};
+
+/**
+ * @brief 带对齐写缓冲、按偏移量写入（pwrite）的写入对象
+ *
+ * 数据先积累到大块缓冲区，写满后一次pwrite到文件中的对应位置。open时可以按选项使用O_DIRECT，
+ * 缓冲区和偏移量按块对齐；起始偏移量不对齐时不使用O_DIRECT，末尾不足一块的数据关闭O_DIRECT后写入。
+ * attach用于多个对象写入同一文件的不同区域（分段下载），此时不拥有文件描述符，也不使用O_DIRECT。
+ */
+class FTPBufferedFileSink : public FTPFileSink
+{
+public:
+    explicit FTPBufferedFileSink(const Options& options);
+    ~FTPBufferedFileSink() override;
+
+    bool open(const std::string& path, bool resume) override;
+
+    /**
+     * @brief 写入一个已打开的文件，从指定偏移量开始
+     * @param fd 文件描述符，由调用方关闭
+     * @param offset 起始偏移量
+     */
+    void attach(int fd, curl_off_t offset);
+
+    curl_off_t position() const override { return offset_ + (curl_off_t)used_; }
+    void reserve(curl_off_t totalSize) override;
+    bool write(const char* data, size_t size) override;
+    bool close() override;
+    bool isOpen() const override { return fd_ >= 0; }
+
+private:
+    /**
+     * @brief 将缓冲区中的数据写入文件
+     * @param all 为false时只写出整块的部分（O_DIRECT要求），其余留在缓冲区
+     */
+    bool flush(bool all);
+
+    /**
+     * @brief 在offset处写入全部数据，处理部分写入和EINTR
+     */
+    bool writeAt(const char* data, size_t size, curl_off_t offset);
+
+private:
+    // O_DIRECT要求的对齐大小，覆盖常见的512字节和4KB扇区
+    static const size_t alignment = 4096;
+
+    Options options_;
+    int fd_;                    ///< 文件描述符，未打开时为-1
+    bool ownsFd_;               ///< 是否由本对象关闭文件描述符
+    bool direct_;               ///< 当前是否以O_DIRECT写入
+    bool failed_;               ///< 写入出错后不再写入
+    char* buffer_;              ///< 对齐的写缓冲区
+    size_t capacity_;           ///< 缓冲区大小
+    size_t used_;               ///< 缓冲区中的字节数
+    curl_off_t offset_;         ///< 缓冲区第一个字节在文件中的偏移量
+    bool reserved_;             ///< 是否预分配了空间，关闭时须截掉未写入的部分
+};
+
+/**
+ * @brief 把数据交给回调函数的写入对象，open时忽略路径
+ */
+class FTPCallbackSink : public FTPFileSink
+{
+public:
+    /**
+     * @brief 数据回调，在传输线程中调用
+     * @param data 数据
+     * @param size 字节数
+     * @return 返回false中止下载
+     */
+    typedef std::function<bool(const char* data, size_t size)> WriteFunction;
+
+    explicit FTPCallbackSink(WriteFunction function);
+
+    bool open(const std::string& path, bool resume) override;
+    curl_off_t position() const override { return position_; }
+    void reserve(curl_off_t) override {}
+    bool write(const char* data, size_t size) override;
+    bool close() override;
+    bool isOpen() const override { return opened_; }
+
+private:
+    WriteFunction function_;
+    curl_off_t position_;
+    bool opened_;
+};
+
+/**
+ * @brief 追加到字符串的写入对象，open时清空字符串，按远程文件大小预留空间
+ */
+class FTPStringSink : public FTPFileSink
+{
+public:
+    /**
+     * @brief 构造函数
+     * @param buffer 接收数据的字符串，须在传输结束前保持有效
+     */
+    explicit FTPStringSink(std::string* buffer);
+
+    bool open(const std::string& path, bool resume) override;
+    curl_off_t position() const override { return (curl_off_t)buffer_->size(); }
+    void reserve(curl_off_t totalSize) override;
+    bool write(const char* data, size_t size) override;
+    bool close() override;
+    bool isOpen() const override { return opened_; }
+
+private:
+    std::string* buffer_;
+    bool opened_;
+};
+
+#endif  // FTPFILESINK_H
@@ -0,0 +1,261 @@
+#include "FTPFileSource.h"
+
+#include <cstring>
+#include <algorithm>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+std::unique_ptr<FTPFileSource> FTPFileSource::create()
+{
+#if defined(__linux__) || defined(__APPLE__)
+    return std::unique_ptr<FTPFileSource>(new FTPMappedFileSource());
+#else
+    return std::unique_ptr<FTPFileSource>(new FTPStreamSource());
+#endif
+}
+
+size_t FTPFileSource::readCallback(char* buffer, size_t size, size_t nitems, void* source)
+{
+    return static_cast<FTPFileSource*>(source)->read(buffer, size * nitems);
+}
+
+int FTPFileSource::seekCallback(void* source, curl_off_t offset, int origin)
+{
+    // libcurl续传上传时只使用SEEK_SET
+    if (origin != SEEK_SET) {
+        return CURL_SEEKFUNC_CANTSEEK;
+    }
+    return static_cast<FTPFileSource*>(source)->seek(offset) ? CURL_SEEKFUNC_OK : CURL_SEEKFUNC_FAIL;
+}
+
+FTPStreamSource::FTPStreamSource()
+    : size_(0)
+{
+}
+
+bool FTPStreamSource::open(const std::string& path)
+{
+    file_.open(path, std::ios::in | std::ios::binary);
+    if (!file_.is_open()) {
+        return false;
+    }
+
+    file_.seekg(0, std::ios::end);
+    size_ = static_cast<curl_off_t>(file_.tellg());
+    file_.seekg(0, std::ios::beg);
+    return true;
+}
+
+size_t FTPStreamSource::read(char* buffer, size_t size)
+{
+    file_.read(buffer, size);
+    if (file_.bad()) {
+        return CURL_READFUNC_ABORT;
+    }
+    return file_.gcount();
+}
+
+bool FTPStreamSource::seek(curl_off_t offset)
+{
+    file_.clear();
+    file_.seekg(offset, std::ios::beg);
+    return !file_.fail();
+}
+
+void FTPStreamSource::close()
+{
+    file_.close();
+}
+
+FTPMemorySource::FTPMemorySource(const char* data, size_t size)
+    : data_(data),
+      size_(size),
+      position_(0)
+{
+}
+
+bool FTPMemorySource::open(const std::string&)
+{
+    position_ = 0;
+    return true;
+}
+
+size_t FTPMemorySource::read(char* buffer, size_t size)
+{
+    size_t count = std::min(size, size_ - position_);
+    memcpy(buffer, data_ + position_, count);
+    position_ += count;
+    return count;
+}
+
+bool FTPMemorySource::seek(curl_off_t offset)
+{
+    if (offset < 0 || (unsigned long long)offset > size_) {
+        return false;
+    }
+    position_ = (size_t)offset;
+    return true;
+}
+
+FTPCallbackSource::FTPCallbackSource(ReadFunction function, curl_off_t size)
+    : function_(function),
+      size_(size),
+      position_(0)
+{
+}
+
+bool FTPCallbackSource::open(const std::string&)
+{
+    position_ = 0;
+    return true;
+}
+
+size_t FTPCallbackSource::read(char* buffer, size_t size)
+{
+    size_t count = function_(buffer, size);
+    if (count != CURL_READFUNC_ABORT && count != CURL_READFUNC_PAUSE) {
+        position_ += count;
+    }
+    return count;
+}
+
+bool FTPCallbackSource::seek(curl_off_t offset)
+{
+    // 数据只能顺序获取，libcurl只会在尚未读取时要求回到开头
+    return offset == position_;
+}
+
+#if defined(__linux__) || defined(__APPLE__)
+
+FTPMappedFileSource::FTPMappedFileSource()
+    : fd_(-1),
+      mapping_(NULL),
+      size_(0),
+      position_(0),
+      released_(0)
+{
+}
+
+FTPMappedFileSource::~FTPMappedFileSource()
+{
+    close();
+}
+
+bool FTPMappedFileSource::open(const std::string& path)
+{
+    close();
+
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        close();
+        return false;
+    }
+    size_ = (curl_off_t)st.st_size;
+    position_ = 0;
+    released_ = 0;
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+    // 加大内核对该文件的预读窗口
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    if (size_ > 0 && (unsigned long long)size_ <= (size_t)-1) {
+        void* mapping = mmap(NULL, (size_t)size_, PROT_READ, MAP_SHARED, fd_, 0);
+        if (mapping != MAP_FAILED) {
+            mapping_ = static_cast<char*>(mapping);
+            // 缺页时内核按顺序访问提前预读，已访问的页优先回收
+            madvise(mapping_, (size_t)size_, MADV_SEQUENTIAL);
+        }
+    }
+
+    return true;
+}
+
+void FTPMappedFileSource::release()
+{
+    // 已读过的部分积累到一定大小后释放映射，内容仍在页缓存中
+    curl_off_t pageSize = sysconf(_SC_PAGESIZE);
+    curl_off_t releaseEnd = position_ / pageSize * pageSize;
+    if (releaseEnd - released_ >= releaseSize) {
+        madvise(mapping_ + released_, (size_t)(releaseEnd - released_), MADV_DONTNEED);
+        released_ = releaseEnd;
+    }
+}
+
+size_t FTPMappedFileSource::read(char* buffer, size_t size)
+{
+    if (fd_ < 0) {
+        return CURL_READFUNC_ABORT;
+    }
+    if (position_ >= size_) {
+        return 0;
+    }
+
+    size_t count = (size_t)std::min((curl_off_t)size, size_ - position_);
+
+    if (!mapping_) {
+        ssize_t n;
+        do {
+            n = pread(fd_, buffer, count, (off_t)position_);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+            return CURL_READFUNC_ABORT;
+        }
+        position_ += n;
+        return (size_t)n;
+    }
+
+    release();
+    memcpy(buffer, mapping_ + position_, count);
+    position_ += count;
+    return count;
+}
+
+bool FTPMappedFileSource::seek(curl_off_t offset)
+{
+    if (fd_ < 0 || offset < 0 || offset > size_) {
+        return false;
+    }
+
+    position_ = offset;
+    released_ = std::max(released_, offset / sysconf(_SC_PAGESIZE) * sysconf(_SC_PAGESIZE));
+    return true;
+}
+
+void FTPMappedFileSource::close()
+{
+    if (mapping_) {
+        munmap(mapping_, (size_t)size_);
+        mapping_ = NULL;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+#else
+
+// 其他平台由create返回FTPStreamSource，这里只保留空实现
+FTPMappedFileSource::FTPMappedFileSource()
+    : fd_(-1), mapping_(NULL), size_(0), position_(0), released_(0) {}
+FTPMappedFileSource::~FTPMappedFileSource() {}
+bool FTPMappedFileSource::open(const std::string&) { return false; }
+void FTPMappedFileSource::release() {}
+size_t FTPMappedFileSource::read(char*, size_t) { return CURL_READFUNC_ABORT; }
+bool FTPMappedFileSource::seek(curl_off_t) { return false; }
+void FTPMappedFileSource::close() {}
+
+#endif
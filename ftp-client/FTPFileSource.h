@@ -0,0 +1,183 @@
+#ifndef FTPFILESOURCE_H
+#define FTPFILESOURCE_H
+
+#include <string>
+#include <fstream>
+#include <memory>
+#include <functional>
+
+#include <stddef.h>
+
+#include <curl/curl.h>
+
+/**
+ * @brief 上传时读取本地文件的接口
+ *
+ * create返回具体实现：POSIX平台上为FTPMappedFileSource，从文件映射直接复制到libcurl的缓冲区；
+ * 其他平台为基于std::ifstream的FTPStreamSource。FTPMemorySource和FTPCallbackSource不读取文件，用于上传调用方提供的数据。
+ */
+class FTPFileSource
+{
+public:
+    /**
+     * @brief 创建读取对象
+     * @return 读取对象
+     */
+    static std::unique_ptr<FTPFileSource> create();
+
+    virtual ~FTPFileSource() {}
+
+    /**
+     * @brief 打开本地文件
+     * @param path 本地文件路径
+     * @return 成功返回true
+     */
+    virtual bool open(const std::string& path) = 0;
+
+    /**
+     * @brief 打开时的文件大小，未知时为-1
+     */
+    virtual curl_off_t size() const = 0;
+
+    /**
+     * @brief 从当前位置读取数据
+     * @param buffer 缓冲区
+     * @param size 缓冲区大小
+     * @return 读取的字节数，到达文件末尾时为0，出错时为CURL_READFUNC_ABORT
+     */
+    virtual size_t read(char* buffer, size_t size) = 0;
+
+    /**
+     * @brief 移动读取位置，续传时由libcurl调用
+     * @param offset 距文件开头的偏移量
+     * @return 成功返回true
+     */
+    virtual bool seek(curl_off_t offset) = 0;
+
+    virtual void close() = 0;
+
+    /**
+     * @brief 作为CURLOPT_READFUNCTION的回调函数
+     */
+    static size_t readCallback(char* buffer, size_t size, size_t nitems, void* source);
+
+    /**
+     * @brief 作为CURLOPT_SEEKFUNCTION的回调函数，续传时libcurl直接跳到偏移量，不再逐块读取丢弃
+     */
+    static int seekCallback(void* source, curl_off_t offset, int origin);
+};
+
+/**
+ * @brief 基于std::ifstream的读取对象，即原有的读取方式
+ */
+class FTPStreamSource : public FTPFileSource
+{
+public:
+    FTPStreamSource();
+
+    bool open(const std::string& path) override;
+    curl_off_t size() const override { return size_; }
+    size_t read(char* buffer, size_t size) override;
+    bool seek(curl_off_t offset) override;
+    void close() override;
+
+private:
+    std::ifstream file_;
+    curl_off_t size_;
+};
+
+/**
+ * @brief 映射整个文件，读取时从映射直接复制到libcurl的缓冲区
+ *
+ * 相比ifstream省去了每次read系统调用，数据从页缓存直接复制到libcurl的缓冲区。映射设置顺序访问建议（MADV_SEQUENTIAL），
+ * 缺页时由内核提前预读；已读过的部分定期释放（MADV_DONTNEED），大文件上传时常驻内存不随文件增长。
+ * 映射失败时（如32位进程的地址空间不足）退回pread。上传过程中不应截短文件，否则访问映射会收到SIGBUS。
+ */
+class FTPMappedFileSource : public FTPFileSource
+{
+public:
+    FTPMappedFileSource();
+    ~FTPMappedFileSource() override;
+
+    bool open(const std::string& path) override;
+    curl_off_t size() const override { return size_; }
+    size_t read(char* buffer, size_t size) override;
+    bool seek(curl_off_t offset) override;
+    void close() override;
+
+private:
+    /**
+     * @brief 释放已读过的部分的映射
+     */
+    void release();
+
+private:
+    // 已读部分每积累这么多释放一次，释放过于频繁时撤销映射的开销明显
+    static const curl_off_t releaseSize = 64 * 1024 * 1024;
+
+    int fd_;                    ///< 文件描述符，未打开时为-1
+    char* mapping_;             ///< 文件映射，映射失败或空文件时为NULL
+    curl_off_t size_;           ///< 文件大小
+    curl_off_t position_;       ///< 读取位置
+    curl_off_t released_;       ///< 已释放到的位置
+};
+
+/**
+ * @brief 从调用方的内存读取的读取对象，open时忽略路径
+ */
+class FTPMemorySource : public FTPFileSource
+{
+public:
+    /**
+     * @brief 构造函数
+     * @param data 数据，须在传输结束前保持有效
+     * @param size 字节数
+     */
+    FTPMemorySource(const char* data, size_t size);
+
+    bool open(const std::string& path) override;
+    curl_off_t size() const override { return (curl_off_t)size_; }
+    size_t read(char* buffer, size_t size) override;
+    bool seek(curl_off_t offset) override;
+    void close() override {}
+
+private:
+    const char* data_;
+    size_t size_;
+    size_t position_;
+};
+
+/**
+ * @brief 从回调函数逐块获取数据的读取对象，open时忽略路径，只能从头读取
+ */
+class FTPCallbackSource : public FTPFileSource
+{
+public:
+    /**
+     * @brief 数据回调，在传输线程中调用
+     * @param buffer 缓冲区
+     * @param size 缓冲区大小
+     * @return 写入缓冲区的字节数，返回0表示数据结束，返回CURL_READFUNC_ABORT中止上传
+     */
+    typedef std::function<size_t(char* buffer, size_t size)> ReadFunction;
+
+    /**
+     * @brief 构造函数
+     * @param function 数据回调
+     * @param size 数据总大小，未知时为-1
+     */
+    FTPCallbackSource(ReadFunction function, curl_off_t size);
+
+    bool open(const std::string& path) override;
+    curl_off_t size() const override { return size_; }
+    size_t read(char* buffer, size_t size) override;
+    bool seek(curl_off_t offset) override;
+    void close() override {}
+
+private:
+    ReadFunction function_;
+    curl_off_t size_;
+    curl_off_t position_;
+};
+
+#endif  // FTPFILESOURCE_H
@@ -0,0 +1,242 @@
+#include "FTPListParser.h"
+
+bool FTPListParser::parseMlsdLine(std::string_view line, Entry& entry)
+{
+    entry.type = Other;
+    entry.name = std::string_view();
+    entry.size = -1;
+    entry.modifyTime = -1;
+    entry.permissions = std::string_view();
+    entry.owner = std::string_view();
+    entry.group = std::string_view();
+    entry.date = std::string_view();
+
+    // 事实列表与文件名之间以第一个空格分隔
+    size_t separator = line.find(' ');
+    if (separator == std::string_view::npos) {
+        return false;
+    }
+    std::string_view facts = line.substr(0, separator);
+    entry.name = line.substr(separator + 1);
+    if (entry.name.empty()) {
+        return false;
+    }
+
+    while (!facts.empty()) {
+        size_t end = facts.find(';');
+        std::string_view fact = facts.substr(0, end);
+        facts.remove_prefix(end == std::string_view::npos ? facts.size() : end + 1);
+
+        size_t equals = fact.find('=');
+        if (equals == std::string_view::npos) {
+            continue;
+        }
+        std::string_view key = fact.substr(0, equals);
+        std::string_view value = fact.substr(equals + 1);
+
+        if (equalsIgnoreCase(key, "type")) {
+            if (equalsIgnoreCase(value, "file")) {
+                entry.type = File;
+            } else if (equalsIgnoreCase(value, "dir")) {
+                entry.type = Directory;
+            } else if (equalsIgnoreCase(value, "cdir") || equalsIgnoreCase(value, "pdir")) {
+                return false;
+            } else if (equalsIgnoreCase(value, "OS.unix=symlink") || equalsIgnoreCase(value, "OS.unix=slink")) {
+                entry.type = Link;
+            }
+        } else if (equalsIgnoreCase(key, "size")) {
+            parseNumber(value, entry.size);
+        } else if (equalsIgnoreCase(key, "modify")) {
+            // YYYYMMDDHHMMSS[.sss]，UTC
+            curl_off_t year, month, day, hour, minute, second;
+            entry.date = value;
+            if (value.size() >= 14 &&
+                parseNumber(value.substr(0, 4), year) && parseNumber(value.substr(4, 2), month) &&
+                parseNumber(value.substr(6, 2), day) && parseNumber(value.substr(8, 2), hour) &&
+                parseNumber(value.substr(10, 2), minute) && parseNumber(value.substr(12, 2), second)) {
+                entry.modifyTime = toUnixTime((int)year, (int)month, (int)day, (int)hour, (int)minute, (int)second);
+            }
+        } else if (equalsIgnoreCase(key, "unix.mode")) {
+            entry.permissions = value;
+        } else if (equalsIgnoreCase(key, "perm")) {
+            if (entry.permissions.empty())
+                entry.permissions = value;
+        } else if (equalsIgnoreCase(key, "unix.owner") || equalsIgnoreCase(key, "unix.ownername")) {
+            entry.owner = value;
+        } else if (equalsIgnoreCase(key, "unix.group") || equalsIgnoreCase(key, "unix.groupname")) {
+            entry.group = value;
+        }
+    }
+
+    return true;
+}
+
+bool FTPListParser::parseListLine(std::string_view line, Entry& entry, time_t now)
+{
+    entry.type = Other;
+    entry.name = std::string_view();
+    entry.size = -1;
+    entry.modifyTime = -1;
+    entry.owner = std::string_view();
+    entry.group = std::string_view();
+    entry.date = std::string_view();
+
+    entry.permissions = nextField(line);
+    if (entry.permissions.size() < 10) {
+        // total 行或非UNIX格式
+        return false;
+    }
+    switch (entry.permissions[0]) {
+    case '-': entry.type = File; break;
+    case 'd': entry.type = Directory; break;
+    case 'l': entry.type = Link; break;
+    default: entry.type = Other; break;
+    }
+
+    curl_off_t value = 0;
+    if (!parseNumber(nextField(line), value)) {
+        return false;
+    }
+
+    entry.owner = nextField(line);
+    std::string_view groupOrSize = nextField(line);
+    std::string_view sizeOrMonth = nextField(line);
+    std::string_view monthField;
+
+    // 部分服务器不输出用户组，此时第4列已经是大小
+    if (monthFromName(sizeOrMonth) > 0 && parseNumber(groupOrSize, value)) {
+        monthField = sizeOrMonth;
+    } else {
+        entry.group = groupOrSize;
+        if (!parseNumber(sizeOrMonth, value)) {
+            return false;
+        }
+        monthField = nextField(line);
+    }
+    entry.size = value;
+
+    std::string_view dayField = nextField(line);
+    std::string_view timeField = nextField(line);
+    int month = monthFromName(monthField);
+    curl_off_t day = 0;
+    if (month <= 0 || !parseNumber(dayField, day) || timeField.empty()) {
+        return false;
+    }
+    entry.date = std::string_view(monthField.data(), timeField.data() + timeField.size() - monthField.data());
+
+    // 文件名与时间之间只有一个空格，文件名本身可以以空格开头或包含连续空格
+    if (line.empty() || line[0] != ' ') {
+        return false;
+    }
+    entry.name = line.substr(1);
+    if (entry.type == Link) {
+        size_t arrow = entry.name.find(" -> ");
+        if (arrow != std::string_view::npos)
+            entry.name = entry.name.substr(0, arrow);
+    }
+    if (entry.name.empty() || entry.name == "." || entry.name == "..") {
+        return false;
+    }
+
+    size_t colon = timeField.find(':');
+    if (colon == std::string_view::npos) {
+        curl_off_t year = 0;
+        if (parseNumber(timeField, year)) {
+            entry.modifyTime = toUnixTime((int)year, month, (int)day, 0, 0, 0);
+        }
+    } else {
+        // 只有时分时为最近半年内的文件，年份取当前年，若因此落在未来则取上一年
+        curl_off_t hour = 0, minute = 0;
+        if (parseNumber(timeField.substr(0, colon), hour) && parseNumber(timeField.substr(colon + 1), minute)) {
+            struct tm current;
+#if defined(_WIN32)
+            gmtime_s(&current, &now);
+#else
+            gmtime_r(&now, &current);
+#endif
+            int year = current.tm_year + 1900;
+            entry.modifyTime = toUnixTime(year, month, (int)day, (int)hour, (int)minute, 0);
+            if (entry.modifyTime > now + 24 * 60 * 60) {
+                entry.modifyTime = toUnixTime(year - 1, month, (int)day, (int)hour, (int)minute, 0);
+            }
+        }
+    }
+
+    return true;
+}
+
+time_t FTPListParser::toUnixTime(int year, int month, int day, int hour, int minute, int second)
+{
+    // 公历日期到1970-01-01的天数，不依赖时区设置
+    year -= month <= 2;
+    long era = (year >= 0 ? year : year - 399) / 400;
+    long yearOfEra = year - era * 400;
+    long dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    long long days = era * 146097LL + dayOfEra - 719468;
+
+    return (time_t)(days * 86400 + hour * 3600 + minute * 60 + second);
+}
+
+bool FTPListParser::parseNumber(std::string_view text, curl_off_t& value)
+{
+    if (text.empty()) {
+        return false;
+    }
+
+    curl_off_t result = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9')
+            return false;
+        result = result * 10 + (c - '0');
+    }
+    value = result;
+    return true;
+}
+
+bool FTPListParser::equalsIgnoreCase(std::string_view a, std::string_view b)
+{
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        char x = a[i];
+        char y = b[i];
+        if (x >= 'A' && x <= 'Z') x += 'a' - 'A';
+        if (y >= 'A' && y <= 'Z') y += 'a' - 'A';
+        if (x != y)
+            return false;
+    }
+    return true;
+}
+
+std::string_view FTPListParser::nextField(std::string_view& line)
+{
+    size_t begin = line.find_first_not_of(' ');
+    if (begin == std::string_view::npos) {
+        line = std::string_view();
+        return std::string_view();
+    }
+    line.remove_prefix(begin);
+
+    size_t end = line.find(' ');
+    std::string_view field = line.substr(0, end);
+    line.remove_prefix(field.size());
+    return field;
+}
+
+int FTPListParser::monthFromName(std::string_view name)
+{
+    static const char* const months[] = {
+        "jan", "feb", "mar", "apr", "may", "jun", "jul", "aug", "sep", "oct", "nov", "dec"
+    };
+
+    if (name.size() != 3) {
+        return 0;
+    }
+    for (int i = 0; i < 12; ++i) {
+        if (equalsIgnoreCase(name, months[i]))
+            return i + 1;
+    }
+    return 0;
+}
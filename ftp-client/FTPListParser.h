@@ -0,0 +1,87 @@
+#ifndef FTPLISTPARSER_H
+#define FTPLISTPARSER_H
+
+#include <string_view>
+#include <ctime>
+
+#include <curl/curl.h>
+
+/**
+ * @brief FTP目录列表解析器
+ *
+ * 支持MLSD(RFC 3659)的机器可读格式和UNIX风格的LIST格式。
+ * 解析直接在接收缓冲区上进行，结果中的字符串均为指向缓冲区的切片，
+ * 不分配内存，也不依赖locale。缓冲区须在使用结果期间保持有效。
+ */
+class FTPListParser
+{
+public:
+    enum EntryType {
+        File,
+        Directory,
+        Link,
+        Other
+    };
+
+    struct Entry {
+        EntryType type;                 // 条目类型
+        std::string_view name;          // 文件名，可包含连续空格
+        curl_off_t size;                // 文件大小，未知时为-1
+        time_t modifyTime;              // 修改时间（UNIX时间，UTC），未知时为-1
+        std::string_view permissions;   // 权限，LIST为 -rw-r--r-- 形式，MLSD为perm或unix.mode
+        std::string_view owner;         // 用户名
+        std::string_view group;         // 用户组
+        std::string_view date;          // 服务器返回的原始日期文本
+    };
+
+    /**
+     * @brief 解析MLSD返回的一行，如 "type=file;size=1024;modify=20240101120000; name"
+     * @param line 一行内容，不含行尾
+     * @param entry 解析结果
+     * @return 解析成功返回true；当前目录(cdir)、上级目录(pdir)和格式错误的行返回false
+     */
+    static bool parseMlsdLine(std::string_view line, Entry& entry);
+
+    /**
+     * @brief 解析UNIX风格LIST返回的一行，如 "-rw-r--r-- 1 user group 1024 Jan  2 10:00 name"
+     * @param line 一行内容，不含行尾
+     * @param entry 解析结果
+     * @param now 当前时间，用于推算只有时分没有年份的日期
+     * @return 解析成功返回true；total行、.和..以及无法识别的行返回false
+     */
+    static bool parseListLine(std::string_view line, Entry& entry, time_t now);
+
+    /**
+     * @brief 按行遍历缓冲区，去掉行尾的\r\n，跳过空行
+     * @param buffer 缓冲区
+     * @param callback 对每一行调用 callback(std::string_view)
+     */
+    template<typename Callback>
+    static void forEachLine(std::string_view buffer, Callback callback)
+    {
+        while (!buffer.empty()) {
+            size_t end = buffer.find('\n');
+            std::string_view line = buffer.substr(0, end);
+            buffer.remove_prefix(end == std::string_view::npos ? buffer.size() : end + 1);
+
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+            if (!line.empty())
+                callback(line);
+        }
+    }
+
+    /**
+     * @brief 将UTC日期转换为UNIX时间
+     * @return UNIX时间
+     */
+    static time_t toUnixTime(int year, int month, int day, int hour, int minute, int second);
+
+private:
+    static bool parseNumber(std::string_view text, curl_off_t& value);
+    static bool equalsIgnoreCase(std::string_view a, std::string_view b);
+    static std::string_view nextField(std::string_view& line);
+    static int monthFromName(std::string_view name);
+};
+
+#endif  // FTPLISTPARSER_H
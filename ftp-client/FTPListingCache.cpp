@@ -0,0 +1,67 @@
+#include "FTPListingCache.h"
+
+FTPListingCache::FTPListingCache(int ttlSeconds, bool revalidateByDirectoryTime)
+    : ttl_(ttlSeconds),
+      revalidateByDirectoryTime_(revalidateByDirectoryTime),
+      generation_(0)
+{
+}
+
+bool FTPListingCache::lookup(const std::string& key, time_t directoryTime, std::shared_ptr<const std::string>& response, bool& mlsd)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = listings_.find(key);
+    if (it == listings_.end()) {
+        return false;
+    }
+
+    const Listing& listing = it->second;
+    bool fresh = std::chrono::steady_clock::now() - listing.fetchTime < ttl_;
+    // 续用含子目录的列表会让下一级得不到新的修改时间，只续用末级目录
+    bool unchanged = revalidateByDirectoryTime_ && !listing.hasDirectories && directoryTime != -1 &&
+                     directoryTime == listing.directoryTime;
+    if (!fresh && !unchanged) {
+        return false;
+    }
+
+    response = listing.response;
+    mlsd = listing.mlsd;
+    return true;
+}
+
+void FTPListingCache::store(const std::string& key, std::shared_ptr<const std::string> response, bool mlsd, time_t directoryTime,
+                            bool hasDirectories, uint64_t generation)
+{
+    Listing listing;
+    listing.response = std::move(response);
+    listing.mlsd = mlsd;
+    listing.directoryTime = directoryTime;
+    listing.hasDirectories = hasDirectories;
+    listing.fetchTime = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation != generation_) {
+        return;
+    }
+    listings_[key] = std::move(listing);
+}
+
+void FTPListingCache::invalidate(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    listings_.erase(key);
+    ++generation_;
+}
+
+void FTPListingCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    listings_.clear();
+    ++generation_;
+}
+
+size_t FTPListingCache::size()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return listings_.size();
+}
@@ -0,0 +1,87 @@
+#ifndef FTPLISTINGCACHE_H
+#define FTPLISTINGCACHE_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+#include <atomic>
+#include <ctime>
+#include <stdint.h>
+
+/**
+ * @brief 远程目录列表缓存
+ *
+ * 按 主机+目录路径 保存MLSD/LIST返回的原始内容。未超过有效期的列表直接使用；超过有效期后，
+ * 如果该目录不含子目录，且刚列出的上级目录中它的修改时间与缓存时相同，说明目录内没有增删文件，也直接使用。
+ * 含有子目录的目录仍须重新列出，才能得到各子目录当前的修改时间，因此轮询时只需重新列出
+ * 中间目录和修改时间变化的末级目录，数量众多的末级目录大都不必重新列出。
+ * 目录的修改时间不随其中文件内容的改写而变化，LIST返回的时间通常只精确到分钟，需要严格一致时可关闭此项。
+ * 本客户端上传、删除文件和创建目录时使相关目录失效。可在多个线程中使用。
+ */
+class FTPListingCache
+{
+public:
+    /**
+     * @brief 构造函数
+     * @param ttlSeconds 列表有效期（秒）
+     * @param revalidateByDirectoryTime 超过有效期后是否按上级目录中的修改时间判断列表仍然有效
+     */
+    FTPListingCache(int ttlSeconds, bool revalidateByDirectoryTime);
+
+    /**
+     * @brief 查找目录列表
+     * @param key 主机+目录路径
+     * @param directoryTime 上级目录列表中该目录的修改时间，未知时为-1
+     * @param response 缓存的列表内容
+     * @param mlsd 列表内容是否为MLSD格式
+     * @return 有可用的缓存时返回true
+     */
+    bool lookup(const std::string& key, time_t directoryTime, std::shared_ptr<const std::string>& response, bool& mlsd);
+
+    /**
+     * @brief 当前的失效计数，开始列出目录前取得，保存时传回
+     */
+    uint64_t generation() const { return generation_; }
+
+    /**
+     * @brief 保存目录列表，覆盖旧的列表。列出期间有目录失效时不保存，以免存入失效前的内容
+     * @param key 主机+目录路径
+     * @param response 列表内容
+     * @param mlsd 列表内容是否为MLSD格式
+     * @param directoryTime 上级目录列表中该目录的修改时间，未知时为-1
+     * @param hasDirectories 列表中是否有子目录
+     * @param generation 开始列出前取得的generation()
+     */
+    void store(const std::string& key, std::shared_ptr<const std::string> response, bool mlsd, time_t directoryTime, bool hasDirectories,
+               uint64_t generation);
+
+    /**
+     * @brief 删除一个目录的列表
+     * @param key 主机+目录路径
+     */
+    void invalidate(const std::string& key);
+
+    void clear();
+
+    size_t size();
+
+private:
+    struct Listing {
+        std::shared_ptr<const std::string> response;        // 列表内容
+        bool mlsd;                                          // 是否为MLSD格式
+        time_t directoryTime;                               // 列出时上级目录中该目录的修改时间
+        bool hasDirectories;                                // 列表中是否有子目录
+        std::chrono::steady_clock::time_point fetchTime;    // 列出的时间
+    };
+
+    std::chrono::seconds ttl_;                              ///< 有效期
+    bool revalidateByDirectoryTime_;                        ///< 是否按目录修改时间续用过期列表
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, Listing> listings_;     ///< 主机+目录路径到列表的索引
+    std::atomic<uint64_t> generation_;                      ///< 每次失效或清空时加一
+};
+
+#endif  // FTPLISTINGCACHE_H
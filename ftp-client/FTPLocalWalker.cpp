@@ -0,0 +1,303 @@
+#include "FTPLocalWalker.h"
+
+#include <thread>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#endif
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#else
+#include <experimental/filesystem>
+#endif
+
+namespace {
+
+#if defined(__linux__)
+// getdents64返回的目录项，glibc未导出此结构
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+// 每个线程读取目录项的缓冲区大小，大目录一次系统调用可取回上千项
+const size_t kDirentBufferSize = 64 * 1024;
+
+}  // namespace
+
+FTPLocalWalker::FTPLocalWalker(size_t threadCount, bool statFiles)
+    : threadCount_(threadCount),
+      statFiles_(statFiles),
+      queued_(0),
+      pending_(0),
+      failed_(false)
+{
+    if (threadCount_ == 0) {
+        threadCount_ = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+}
+
+bool FTPLocalWalker::walk(const std::string& rootPath, Callback callback)
+{
+    callback_ = std::move(callback);
+    failed_ = false;
+
+#if defined(__linux__) || defined(__APPLE__)
+    queues_.clear();
+    for (size_t i = 0; i < threadCount_; ++i) {
+        queues_.emplace_back(new Queue());
+    }
+    queued_ = 0;
+    pending_ = 0;
+    push(0, rootPath);
+
+    // 调用线程也参与遍历
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < threadCount_; ++i) {
+        threads.emplace_back(&FTPLocalWalker::run, this, i);
+    }
+    run(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    queues_.clear();
+#else
+    walkPortable(rootPath);
+#endif
+
+    callback_ = nullptr;
+    return !failed_;
+}
+
+void FTPLocalWalker::run(size_t index)
+{
+    std::vector<char> buffer(kDirentBufferSize);
+    std::string path;
+    std::string directory;
+
+    while (true) {
+        if (pop(index, directory)) {
+            if (!scan(index, directory, buffer, path)) {
+                failed_ = true;
+            }
+            // 最后一个目录读取完时唤醒所有空闲线程退出
+            if (pending_.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lock(idleMutex_);
+                idle_.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(idleMutex_);
+        idle_.wait(lock, [this]() { return queued_ > 0 || pending_ == 0; });
+        if (pending_ == 0) {
+            return;
+        }
+    }
+}
+
+bool FTPLocalWalker::pop(size_t index, std::string& directory)
+{
+    // 自己的队列后进先出，沿着刚发现的子目录向下，路径前缀仍在缓存中
+    do{
+        Queue& own = *queues_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.directories.empty()) {
+            directory = std::move(own.directories.back());
+            own.directories.pop_back();
+            --queued_;
+            return true;
+        }
+    }while(false);
+
+    // 从其他队列开头窃取，取到的是较早发现、通常子树较大的目录
+    for (size_t i = 1; i < queues_.size(); ++i) {
+        Queue& victim = *queues_[(index + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.directories.empty()) {
+            directory = std::move(victim.directories.front());
+            victim.directories.pop_front();
+            --queued_;
+            return true;
+        }
+    }
+    return false;
+}
+
+void FTPLocalWalker::push(size_t index, std::string directory)
+{
+    ++pending_;
+    do{
+        Queue& own = *queues_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.directories.push_back(std::move(directory));
+        ++queued_;
+    }while(false);
+
+    std::lock_guard<std::mutex> lock(idleMutex_);
+    idle_.notify_one();
+}
+
+bool FTPLocalWalker::scan(size_t index, const std::string& directory, std::vector<char>& buffer, std::string& path)
+{
+#if defined(__linux__) || defined(__APPLE__)
+    int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Failed to open local folder: " << directory << std::endl;
+        return false;
+    }
+
+#if defined(__linux__)
+    bool succeeded = true;
+    while (true) {
+        long bytes = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+        if (bytes == 0) {
+            break;
+        }
+        if (bytes < 0) {
+            std::cerr << "Failed to read local folder: " << directory << std::endl;
+            succeeded = false;
+            break;
+        }
+        for (long offset = 0; offset < bytes;) {
+            const linux_dirent64* entry = reinterpret_cast<const linux_dirent64*>(buffer.data() + offset);
+            visit(index, fd, directory, entry->d_name, entry->d_type, path);
+            offset += entry->d_reclen;
+        }
+    }
+    close(fd);
+    return succeeded;
+#else
+    (void)buffer;
+    DIR* dir = fdopendir(fd);
+    if (dir == NULL) {
+        close(fd);
+        std::cerr << "Failed to open local folder: " << directory << std::endl;
+        return false;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        visit(index, dirfd(dir), directory, entry->d_name, entry->d_type, path);
+    }
+    closedir(dir);
+    return true;
+#endif
+#else
+    (void)index;
+    (void)directory;
+    (void)buffer;
+    (void)path;
+    return false;
+#endif
+}
+
+void FTPLocalWalker::visit(size_t index, int directoryFd, const std::string& directory, const char* name, unsigned char type, std::string& path)
+{
+#if defined(__linux__) || defined(__APPLE__)
+    if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+        return;
+    }
+
+    path.assign(directory);
+    path += '/';
+    path += name;
+
+    Entry entry;
+    entry.size = -1;
+    entry.modifyTime = -1;
+
+    // d_type可直接区分文件和目录，只有符号链接、文件系统不提供类型或需要大小时才stat
+    if (type == DT_LNK || type == DT_UNKNOWN || (type == DT_REG && statFiles_)) {
+        struct stat st;
+        if (fstatat(directoryFd, name, &st, 0) != 0) {
+            return;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            push(index, path);
+            return;
+        }
+        if (!S_ISREG(st.st_mode)) {
+            return;
+        }
+        if (statFiles_) {
+            entry.size = (curl_off_t)st.st_size;
+            entry.modifyTime = st.st_mtime;
+        }
+    } else if (type == DT_DIR) {
+        push(index, path);
+        return;
+    } else if (type != DT_REG) {
+        return;
+    }
+
+    entry.path = path;
+    entry.name = std::string_view(path).substr(directory.length() + 1);
+    callback_(entry);
+#else
+    (void)index;
+    (void)directoryFd;
+    (void)directory;
+    (void)name;
+    (void)type;
+    (void)path;
+#endif
+}
+
+bool FTPLocalWalker::walkPortable(const std::string& rootPath)
+{
+#if !defined(__linux__)
+    namespace fs = std::experimental::filesystem;
+
+    std::error_code error;
+    fs::recursive_directory_iterator it(rootPath, error);
+    if (error) {
+        std::cerr << "Failed to open local folder: " << rootPath << std::endl;
+        failed_ = true;
+        return false;
+    }
+
+    std::string path;
+    for (; it != fs::recursive_directory_iterator(); it.increment(error)) {
+        if (error) {
+            failed_ = true;
+            break;
+        }
+        fs::file_status status = it->status();
+        if (!fs::is_regular_file(status)) {
+            continue;
+        }
+
+        path = it->path().string();
+        std::string name = it->path().filename().string();
+
+        Entry entry;
+        entry.path = path;
+        entry.name = std::string_view(path).substr(path.length() - name.length());
+        entry.size = -1;
+        entry.modifyTime = -1;
+        if (statFiles_) {
+            entry.size = (curl_off_t)fs::file_size(it->path(), error);
+            auto writeTime = fs::last_write_time(it->path(), error);
+            entry.modifyTime = std::chrono::system_clock::to_time_t(writeTime);
+        }
+        callback_(entry);
+    }
+    return !failed_;
+#else
+    (void)rootPath;
+    return false;
+#endif
+}
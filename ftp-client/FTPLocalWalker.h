@@ -0,0 +1,127 @@
+#ifndef FTPLOCALWALKER_H
+#define FTPLOCALWALKER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+#include <time.h>
+
+#include <curl/curl.h>
+
+/**
+ * @brief 多线程遍历本地目录树
+ *
+ * 每个线程有自己的目录队列，新发现的子目录放入自己的队列末尾并优先处理，队列为空时从其他线程的队列开头窃取，
+ * 宽而浅和窄而深的目录树都能让所有线程保持忙碌。Linux上直接以getdents64按大块读取目录项，其他POSIX平台使用readdir，
+ * 都根据d_type区分文件和目录，只有类型未知、符号链接或要求获取大小时才调用stat。
+ * 每发现一个文件即调用回调，不在内存中保存整个文件列表。
+ */
+class FTPLocalWalker
+{
+public:
+    struct Entry {
+        std::string_view path;      // 完整路径，以根路径开头，仅在回调期间有效
+        std::string_view name;      // 文件名，即path的最后一部分
+        curl_off_t size;            // 文件大小，未要求获取时为-1
+        time_t modifyTime;          // 修改时间，未要求获取时为-1
+    };
+
+    /**
+     * @brief 文件回调，在遍历线程中并发调用
+     */
+    typedef std::function<void(const Entry& entry)> Callback;
+
+public:
+    /**
+     * @brief 构造函数
+     * @param threadCount 遍历线程数，为0时按CPU核数确定
+     * @param statFiles 是否获取每个文件的大小和修改时间，需要对每个文件调用一次stat
+     */
+    explicit FTPLocalWalker(size_t threadCount = 0, bool statFiles = false);
+
+    /**
+     * @brief 遍历目录树，所有文件处理完后返回。符号链接按其指向的目标处理
+     * @param rootPath 根目录路径，不以/结尾
+     * @param callback 文件回调
+     * @return 所有目录都读取成功时返回true
+     */
+    bool walk(const std::string& rootPath, Callback callback);
+
+private:
+    /**
+     * @brief 一个线程的目录队列
+     */
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::string> directories;
+    };
+
+    /**
+     * @brief 遍历线程的主循环
+     * @param index 线程序号
+     */
+    void run(size_t index);
+
+    /**
+     * @brief 取出一个目录：先从自己队列的末尾取，再从其他队列的开头窃取
+     * @param index 线程序号
+     * @param directory 取出的目录
+     * @return 取到时返回true
+     */
+    bool pop(size_t index, std::string& directory);
+
+    /**
+     * @brief 将目录放入指定线程的队列
+     * @param index 线程序号
+     * @param directory 目录路径
+     */
+    void push(size_t index, std::string directory);
+
+    /**
+     * @brief 读取一个目录，子目录放入队列，文件交给回调
+     * @param index 线程序号
+     * @param directory 目录路径
+     * @param buffer 读取目录项的缓冲区
+     * @param path 拼接文件路径的缓冲区
+     * @return 读取成功返回true
+     */
+    bool scan(size_t index, const std::string& directory, std::vector<char>& buffer, std::string& path);
+
+    /**
+     * @brief 处理一个目录项
+     * @param index 线程序号
+     * @param directoryFd 所在目录的文件描述符
+     * @param directory 所在目录路径
+     * @param name 文件名
+     * @param type 目录项的d_type
+     * @param path 拼接文件路径的缓冲区
+     */
+    void visit(size_t index, int directoryFd, const std::string& directory, const char* name, unsigned char type, std::string& path);
+
+    /**
+     * @brief 其他平台上的单线程遍历
+     */
+    bool walkPortable(const std::string& rootPath);
+
+private:
+    size_t threadCount_;                            ///< 遍历线程数
+    bool statFiles_;                                ///< 是否获取文件大小和修改时间
+    Callback callback_;                             ///< 文件回调
+
+    std::vector<std::unique_ptr<Queue>> queues_;    ///< 各线程的目录队列
+    std::atomic<size_t> queued_;                    ///< 队列中的目录总数
+    std::atomic<size_t> pending_;                   ///< 已发现但尚未读取完的目录数，为0时遍历结束
+    std::atomic<bool> failed_;                      ///< 是否有目录读取失败
+
+    std::mutex idleMutex_;
+    std::condition_variable idle_;                  ///< 有新目录入队或遍历结束时通知空闲线程
+};
+
+#endif  // FTPLOCALWALKER_H
@@ -0,0 +1,236 @@
+#include "FTPProgressTracker.h"
+
+#include <cmath>
+
+FTPProgressTracker::FTPProgressTracker(size_t slotCount)
+    : throttle_(NULL),
+      throttleContext_(NULL),
+      batchDepth_(0),
+      batchTotal_(0),
+      batchTransferred_(0),
+      activeTransfers_(0),
+      finishedTransfers_(0),
+      batchStart_(Clock::now().time_since_epoch().count()),
+      lastSampleTime_(Clock::now()),
+      lastSampleBytes_(0),
+      currentRate_(0)
+{
+    for (std::atomic<size_t>& count : retryEvents_) {
+        count = 0;
+    }
+    for (size_t i = 0; i < slotCount; ++i) {
+        Slot& slot = slots_.emplace_back();
+        slot.tracker = this;
+        slot.curl = NULL;
+        slot.rateLimit = 0;
+        slot.used = false;
+        slot.direction = Download;
+        slot.total = 0;
+        slot.transferred = 0;
+    }
+}
+
+void FTPProgressTracker::setThrottle(ThrottleFunction throttle, void* context)
+{
+    throttle_ = throttle;
+    throttleContext_ = context;
+}
+
+long FTPProgressTracker::begin(CURL* curl, const std::string& filename, Direction direction, curl_off_t totalSize)
+{
+    Slot* slot = NULL;
+    long index = -1;
+    do{
+        std::lock_guard<std::mutex> lock(metaMutex_);
+        for (size_t i = 0; i < slots_.size(); ++i) {
+            if (!slots_[i].used) {
+                slot = &slots_[i];
+                index = (long)i;
+                break;
+            }
+        }
+        if (!slot) {
+            slot = &slots_.emplace_back();
+            slot->tracker = this;
+            index = (long)slots_.size() - 1;
+        }
+        slot->filename = filename;
+        slot->curl = curl;
+        slot->direction = direction;
+        slot->total = totalSize;
+        slot->transferred = 0;
+        slot->used = true;
+    }while(false);
+
+    batchTotal_ += totalSize;
+    ++activeTransfers_;
+
+    // CURLOPT_XFERINFOFUNCTION 以 curl_off_t 报告进度，大文件不会溢出
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, slot);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, xferInfoCallback);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+
+    // 复用的句柄可能带有上一个传输的速率上限
+    slot->rateLimit = throttle_ ? throttle_(throttleContext_, TransferBegin) : 0;
+    curl_easy_setopt(curl, CURLOPT_MAX_RECV_SPEED_LARGE, direction == Download ? slot->rateLimit : (curl_off_t)0);
+    curl_easy_setopt(curl, CURLOPT_MAX_SEND_SPEED_LARGE, direction == Upload ? slot->rateLimit : (curl_off_t)0);
+
+    return index;
+}
+
+void FTPProgressTracker::end(long index)
+{
+    std::lock_guard<std::mutex> lock(metaMutex_);
+    if (index < 0 || (size_t)index >= slots_.size()) {
+        return;
+    }
+
+    Slot& slot = slots_[index];
+
+    // 未传输完的部分不再计入批次总量，避免剩余时间被失败的传输拉长
+    curl_off_t unfinished = slot.total - slot.transferred;
+    if (unfinished > 0) {
+        batchTotal_ -= unfinished;
+    }
+    --activeTransfers_;
+    ++finishedTransfers_;
+    if (throttle_) {
+        throttle_(throttleContext_, TransferEnd);
+    }
+
+    slot.filename.clear();
+    slot.curl = NULL;
+    slot.used = false;
+}
+
+bool FTPProgressTracker::beginBatch()
+{
+    if (batchDepth_++ != 0) {
+        return false;
+    }
+
+    batchTotal_ = 0;
+    batchTransferred_ = 0;
+    finishedTransfers_ = 0;
+    for (std::atomic<size_t>& count : retryEvents_) {
+        count = 0;
+    }
+    batchStart_ = Clock::now().time_since_epoch().count();
+
+    std::lock_guard<std::mutex> lock(rateMutex_);
+    lastSampleTime_ = Clock::now();
+    lastSampleBytes_ = 0;
+    currentRate_ = 0;
+    return true;
+}
+
+void FTPProgressTracker::endBatch()
+{
+    size_t depth = batchDepth_;
+    while (depth > 0 && !batchDepth_.compare_exchange_weak(depth, depth - 1)) {
+    }
+}
+
+void FTPProgressTracker::recordRetry(RetryEvent event)
+{
+    ++retryEvents_[event];
+}
+
+std::vector<FTPProgressTracker::TransferSnapshot> FTPProgressTracker::transfers()
+{
+    std::vector<TransferSnapshot> result;
+
+    std::lock_guard<std::mutex> lock(metaMutex_);
+    for (size_t i = 0; i < slots_.size(); ++i) {
+        const Slot& slot = slots_[i];
+        if (!slot.used) {
+            continue;
+        }
+        TransferSnapshot snapshot;
+        snapshot.filename = slot.filename;
+        snapshot.direction = slot.direction;
+        snapshot.totalSize = slot.total;
+        snapshot.transferredSize = slot.transferred;
+        result.push_back(snapshot);
+    }
+
+    return result;
+}
+
+FTPProgressTracker::BatchSnapshot FTPProgressTracker::batch()
+{
+    // 滑动平均的时间常数，越大越平滑
+    const double rateWindowSeconds = 5.0;
+
+    BatchSnapshot snapshot;
+    snapshot.totalBytes = batchTotal_;
+    snapshot.transferredBytes = batchTransferred_;
+    snapshot.activeTransfers = activeTransfers_;
+    snapshot.finishedTransfers = finishedTransfers_;
+    snapshot.concurrencyLevel = 0;
+    snapshot.retries = retryEvents_[Retried];
+    snapshot.recoveredTransfers = retryEvents_[Recovered];
+    snapshot.exhaustedTransfers = retryEvents_[Exhausted];
+    snapshot.fatalFailures = retryEvents_[Fatal];
+
+    Clock::time_point now = Clock::now();
+    Clock::time_point start = Clock::time_point(Clock::duration(batchStart_.load()));
+    snapshot.elapsedSeconds = std::chrono::duration<double>(now - start).count();
+    snapshot.averageRate = snapshot.elapsedSeconds > 0 ? snapshot.transferredBytes / snapshot.elapsedSeconds : 0;
+
+    do{
+        std::lock_guard<std::mutex> lock(rateMutex_);
+        double interval = std::chrono::duration<double>(now - lastSampleTime_).count();
+        if (interval >= 0.2) {
+            double rate = (snapshot.transferredBytes - lastSampleBytes_) / interval;
+            double alpha = 1.0 - std::exp(-interval / rateWindowSeconds);
+            currentRate_ += alpha * (rate - currentRate_);
+            lastSampleTime_ = now;
+            lastSampleBytes_ = snapshot.transferredBytes;
+        }
+        snapshot.currentRate = currentRate_ > 0 ? currentRate_ : 0;
+    }while(false);
+
+    double rate = snapshot.currentRate > 0 ? snapshot.currentRate : snapshot.averageRate;
+    curl_off_t remaining = snapshot.totalBytes - snapshot.transferredBytes;
+    if (snapshot.totalBytes > 0 && remaining <= 0) {
+        snapshot.etaSeconds = 0;
+    } else if (snapshot.totalBytes > 0 && rate > 0) {
+        snapshot.etaSeconds = remaining / rate;
+    } else {
+        snapshot.etaSeconds = -1;
+    }
+
+    return snapshot;
+}
+
+int FTPProgressTracker::xferInfoCallback(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+{
+    Slot* slot = static_cast<Slot*>(clientp);
+    FTPProgressTracker* tracker = slot->tracker;
+
+    curl_off_t total = slot->direction == Download ? dltotal : ultotal;
+    curl_off_t now = slot->direction == Download ? dlnow : ulnow;
+
+    // 下载的总大小在SIZE回复后才知道；上传时libcurl可能报告0，此时保留begin传入的值
+    if (total > 0) {
+        curl_off_t previous = slot->total.exchange(total);
+        if (previous != total)
+            tracker->batchTotal_ += total - previous;
+    }
+
+    curl_off_t previous = slot->transferred.exchange(now);
+    if (previous != now)
+        tracker->batchTransferred_ += now - previous;
+
+    // 限速由libcurl在传输的等待中执行，这里只在可用速率变化时更新句柄的选项
+    if (tracker->throttle_) {
+        curl_off_t rateLimit = tracker->throttle_(tracker->throttleContext_, TransferProgress);
+        if (rateLimit != slot->rateLimit) {
+            slot->rateLimit = rateLimit;
+            curl_easy_setopt(slot->curl, slot->direction == Download ? CURLOPT_MAX_RECV_SPEED_LARGE : CURLOPT_MAX_SEND_SPEED_LARGE, rateLimit);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,179 @@
+#ifndef FTPPROGRESSTRACKER_H
+#define FTPPROGRESSTRACKER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include <curl/curl.h>
+
+/**
+ * @brief 传输进度跟踪
+ *
+ * 每个进行中的传输占用一个槽位，槽位在传输之间复用，地址固定。libcurl的CURLOPT_XFERINFOFUNCTION回调
+ * 只更新槽位和批次的原子计数，不加锁；文件名等描述信息只在占用和释放槽位时写入。快照只复制数据，不会阻塞传输。
+ * 回调中还会调用限速函数取得传输当前可用的速率，有变化时更新句柄的CURLOPT_MAX_RECV_SPEED_LARGE或
+ * CURLOPT_MAX_SEND_SPEED_LARGE，由libcurl限速，回调本身不阻塞。
+ * 批次从beginBatch开始累计字节数，用于计算平均速率、滑动平均速率和剩余时间，同时累计重试次数和失败的分类。
+ */
+class FTPProgressTracker
+{
+public:
+    enum Direction {
+        Download,
+        Upload
+    };
+
+    /**
+     * @brief 重试相关的事件
+     */
+    enum RetryEvent {
+        Retried,        // 传输失败后重试
+        Recovered,      // 重试后传输成功
+        Exhausted,      // 重试次数用尽仍然失败
+        Fatal           // 因不可重试的错误失败
+    };
+
+    struct TransferSnapshot {
+        std::string filename;       // 文件名
+        Direction direction;        // 传输方向
+        curl_off_t totalSize;       // 本次需要传输的总字节数，未知时为0
+        curl_off_t transferredSize; // 已传输字节数
+    };
+
+    struct BatchSnapshot {
+        curl_off_t totalBytes;          // 已知的总字节数
+        curl_off_t transferredBytes;    // 已传输字节数
+        size_t activeTransfers;         // 进行中的传输数量
+        size_t finishedTransfers;       // 已结束的传输数量
+        double elapsedSeconds;          // 批次已进行的时间
+        double averageRate;             // 批次平均速率，字节/秒
+        double currentRate;             // 滑动平均速率，字节/秒
+        double etaSeconds;              // 预计剩余时间，无法估计时为-1
+        size_t concurrencyLevel;        // 当前的并发传输数量上限，由FTPClient填写
+        size_t retries;                 // 重试次数，一个文件重试多次时每次都计入
+        size_t recoveredTransfers;      // 重试后成功的传输数量
+        size_t exhaustedTransfers;      // 重试次数用尽仍然失败的传输数量
+        size_t fatalFailures;           // 因不可重试的错误失败的传输数量
+    };
+
+public:
+    /**
+     * @brief 调用限速函数的时机
+     */
+    enum ThrottleEvent {
+        TransferBegin,      // 占用槽位
+        TransferProgress,   // 进度回调中
+        TransferEnd         // 释放槽位，返回值被忽略
+    };
+
+    /**
+     * @brief 限速函数，不应阻塞
+     * @param context setThrottle传入的上下文
+     * @param event 调用时机
+     * @return 传输当前可用的速率，每秒字节数，为0时不限速
+     */
+    typedef curl_off_t (*ThrottleFunction)(void* context, ThrottleEvent event);
+
+public:
+    /**
+     * @brief 构造函数
+     * @param slotCount 预先创建的槽位数量，同时进行的传输更多时再增加
+     */
+    explicit FTPProgressTracker(size_t slotCount = 64);
+
+    /**
+     * @brief 设置限速函数，须在传输开始前设置
+     * @param throttle 限速函数，为NULL时不限速
+     * @param context 传给限速函数的上下文
+     */
+    void setThrottle(ThrottleFunction throttle, void* context);
+
+    /**
+     * @brief 占用槽位并在句柄上设置进度回调
+     * @param curl CURL对象
+     * @param filename 文件名
+     * @param direction 传输方向
+     * @param totalSize 需要传输的总字节数，未知时为0，下载时会由回调更新
+     * @return 槽位编号
+     */
+    long begin(CURL* curl, const std::string& filename, Direction direction, curl_off_t totalSize);
+
+    /**
+     * @brief 释放槽位
+     * @param slot 槽位编号，为-1时忽略
+     */
+    void end(long slot);
+
+    /**
+     * @brief 开始一个批次，没有其他进行中的批次时清零批次统计
+     * @return 清零了批次统计（开始了新的批次）返回true，加入进行中的批次返回false
+     */
+    bool beginBatch();
+
+    /**
+     * @brief 结束一个批次
+     */
+    void endBatch();
+
+    /**
+     * @brief 记录重试事件，计入当前批次
+     * @param event 事件
+     */
+    void recordRetry(RetryEvent event);
+
+    /**
+     * @brief 复制所有进行中传输的进度
+     */
+    std::vector<TransferSnapshot> transfers();
+
+    /**
+     * @brief 获取批次的累计进度和速率
+     */
+    BatchSnapshot batch();
+
+private:
+    /**
+     * @brief 传输进度回调，由libcurl在传输线程中调用
+     * @return 返回零以继续传输
+     */
+    static int xferInfoCallback(void* clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow);
+
+    struct Slot {
+        FTPProgressTracker* tracker;
+        CURL* curl;                             // 传输句柄，占用时写入
+        curl_off_t rateLimit;                   // 已设置到句柄的速率上限，只在占用时和传输线程中访问
+        std::atomic<bool> used;                 // 是否被占用
+        Direction direction;                    // 传输方向，占用时写入
+        std::string filename;                   // 文件名，占用时在metaMutex_内写入
+        std::atomic<curl_off_t> total;          // 总字节数
+        std::atomic<curl_off_t> transferred;    // 已传输字节数
+    };
+
+    typedef std::chrono::steady_clock Clock;
+
+    std::mutex metaMutex_;                      ///< 保护槽位列表和槽位的文件名，不在回调中使用
+    std::deque<Slot> slots_;                    ///< 只在末尾增加，已有槽位的地址不变
+
+    ThrottleFunction throttle_;                 ///< 限速函数
+    void* throttleContext_;
+
+    std::atomic<size_t> batchDepth_;            ///< 进行中的批次数量
+    std::atomic<curl_off_t> batchTotal_;        ///< 批次已知总字节数
+    std::atomic<curl_off_t> batchTransferred_;  ///< 批次已传输字节数
+    std::atomic<size_t> activeTransfers_;       ///< 进行中的传输数量
+    std::atomic<size_t> finishedTransfers_;     ///< 批次中已结束的传输数量
+    std::atomic<Clock::rep> batchStart_;        ///< 批次开始时间
+    std::atomic<size_t> retryEvents_[4];        ///< 批次中各类重试事件的次数，以RetryEvent为下标
+
+    std::mutex rateMutex_;                      ///< 保护滑动平均速率的采样状态
+    Clock::time_point lastSampleTime_;
+    curl_off_t lastSampleBytes_;
+    double currentRate_;
+};
+
+#endif  // FTPPROGRESSTRACKER_H
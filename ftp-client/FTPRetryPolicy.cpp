@@ -0,0 +1,99 @@
+#include "FTPRetryPolicy.h"
+
+#include <random>
+#include <algorithm>
+
+FTPRetryPolicy::FTPRetryPolicy(unsigned maxRetries, std::chrono::milliseconds baseDelay, std::chrono::milliseconds maxDelay)
+    : maxRetries_(maxRetries),
+      baseDelay_(std::max(baseDelay, std::chrono::milliseconds(1))),
+      maxDelay_(std::max(maxDelay, baseDelay_))
+{
+}
+
+FTPRetryPolicy::Verdict FTPRetryPolicy::classify(CURLcode result, long responseCode)
+{
+    switch (result) {
+    case CURLE_OK:
+        return Success;
+
+    // 连接和数据通道的网络错误
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_RECV_ERROR:
+    case CURLE_SEND_ERROR:
+    case CURLE_GOT_NOTHING:
+    case CURLE_PARTIAL_FILE:
+    case CURLE_SSL_CONNECT_ERROR:
+    case CURLE_FTP_WEIRD_PASV_REPLY:
+    case CURLE_FTP_WEIRD_227_FORMAT:
+    case CURLE_FTP_CANT_GET_HOST:
+    case CURLE_FTP_PORT_FAILED:
+    case CURLE_FTP_ACCEPT_FAILED:
+    case CURLE_FTP_ACCEPT_TIMEOUT:
+        return Retryable;
+
+    // 调用方取消、本地读写失败、路径错误，重试结果相同
+    case CURLE_ABORTED_BY_CALLBACK:
+    case CURLE_WRITE_ERROR:
+    case CURLE_READ_ERROR:
+    case CURLE_FAILED_INIT:
+    case CURLE_OUT_OF_MEMORY:
+    case CURLE_URL_MALFORMAT:
+    case CURLE_COULDNT_RESOLVE_HOST:
+    case CURLE_REMOTE_FILE_NOT_FOUND:
+    case CURLE_FILESIZE_EXCEEDED:
+        return Fatal;
+
+    default:
+        break;
+    }
+
+    // 其余错误由服务器的回复决定：4xx为暂时性错误，5xx为永久性错误
+    return responseCode >= 400 && responseCode < 500 ? Retryable : Fatal;
+}
+
+FTPRetryPolicy::Verdict FTPRetryPolicy::classify(CURL* curl, CURLcode result)
+{
+    long responseCode = 0;
+    if (curl && result != CURLE_OK) {
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+    }
+    return classify(result, responseCode);
+}
+
+bool FTPRetryPolicy::poisonsConnection(CURLcode result, long responseCode)
+{
+    switch (result) {
+    case CURLE_OK:
+    case CURLE_ABORTED_BY_CALLBACK:
+    case CURLE_WRITE_ERROR:
+    case CURLE_READ_ERROR:
+    case CURLE_REMOTE_FILE_NOT_FOUND:
+        return false;
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_RECV_ERROR:
+    case CURLE_SEND_ERROR:
+    case CURLE_GOT_NOTHING:
+    case CURLE_PARTIAL_FILE:
+    case CURLE_FTP_WEIRD_SERVER_REPLY:
+        // 控制连接上可能还有未读的回复，或者服务器已关闭连接
+        return true;
+    default:
+        // 421表示服务器即将关闭控制连接
+        return responseCode == 421;
+    }
+}
+
+std::chrono::milliseconds FTPRetryPolicy::backoff(unsigned attempts) const
+{
+    thread_local std::minstd_rand random(std::random_device{}());
+
+    long long delay = baseDelay_.count();
+    for (unsigned i = 0; i < attempts && delay < maxDelay_.count(); ++i) {
+        delay *= 2;
+    }
+    delay = std::min(delay, (long long)maxDelay_.count());
+
+    std::uniform_int_distribution<long long> jitter(delay / 2, delay);
+    return std::chrono::milliseconds(jitter(random));
+}
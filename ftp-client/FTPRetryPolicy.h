@@ -0,0 +1,76 @@
+#ifndef FTPRETRYPOLICY_H
+#define FTPRETRYPOLICY_H
+
+#include <stddef.h>
+#include <chrono>
+
+#include <curl/curl.h>
+
+/**
+ * @brief 传输失败的分类和重试间隔
+ *
+ * 根据CURLcode和服务器最后的回复码判断失败能否重试：网络中断、超时、被动模式建立数据连接失败
+ * 以及4xx（暂时性错误，如421服务不可用、425无法打开数据连接、426传输中止、450/451）可以重试；
+ * 远程文件不存在、权限不足、5xx（永久性错误）、本地读写失败和调用方取消不重试。
+ * 重试间隔按指数增长，上限为maxDelay，并在[间隔/2, 间隔]内随机取值，避免大量失败的传输同时重试。
+ */
+class FTPRetryPolicy
+{
+public:
+    enum Verdict {
+        Success,        // 传输成功
+        Retryable,      // 暂时性错误，可以重试
+        Fatal           // 重试也不会成功
+    };
+
+public:
+    /**
+     * @brief 构造函数
+     * @param maxRetries 单个传输最多重试的次数，为0时不重试
+     * @param baseDelay 第一次重试前的等待时间
+     * @param maxDelay 等待时间上限
+     */
+    FTPRetryPolicy(unsigned maxRetries, std::chrono::milliseconds baseDelay, std::chrono::milliseconds maxDelay);
+
+    /**
+     * @brief 按CURLcode和服务器最后的回复码对传输结果分类
+     * @param result 传输结果
+     * @param responseCode 服务器最后的回复码，没有回复时为0
+     */
+    static Verdict classify(CURLcode result, long responseCode);
+
+    /**
+     * @brief 对句柄上的传输结果分类，回复码从句柄中获取
+     * @param curl 完成传输的句柄，为NULL时只按result分类
+     * @param result 传输结果
+     */
+    static Verdict classify(CURL* curl, CURLcode result);
+
+    /**
+     * @brief 判断失败后控制连接是否可能已损坏，损坏的连接不应被重试复用
+     * @param result 传输结果
+     * @param responseCode 服务器最后的回复码
+     */
+    static bool poisonsConnection(CURLcode result, long responseCode);
+
+    /**
+     * @brief 判断是否还可以重试
+     * @param attempts 已重试的次数
+     */
+    bool allows(unsigned attempts) const { return attempts < maxRetries_; }
+
+    /**
+     * @brief 计算第attempts+1次重试前的等待时间，可在任意线程调用
+     * @param attempts 已重试的次数
+     */
+    std::chrono::milliseconds backoff(unsigned attempts) const;
+
+    unsigned maxRetries() const { return maxRetries_; }
+
+private:
+    unsigned maxRetries_;
+    std::chrono::milliseconds baseDelay_;
+    std::chrono::milliseconds maxDelay_;
+};
+
+#endif  // FTPRETRYPOLICY_H
@@ -0,0 +1,187 @@
+#include "FTPSyncState.h"
+
+#include <iostream>
+#include <cstdio>
+
+FTPSyncState::FTPSyncState(const std::string& statePath)
+    : statePath_(statePath)
+{
+    // 最后一行不完整时重写状态文件去掉该行，save会重新打开追加写入的文件
+    bool unterminated = load();
+    if (unterminated && save()) {
+        return;
+    }
+
+    if (!log_.is_open()) {
+        log_.open(statePath_, std::ios::out | std::ios::app | std::ios::binary);
+    }
+    if (!log_.is_open()) {
+        std::cerr << "Failed to open sync state: " << statePath_ << std::endl;
+        return;
+    }
+
+    // 重写失败时先换行再追加，新记录不会接在不完整的行后面
+    if (unterminated) {
+        log_ << '\n';
+        log_.flush();
+    }
+}
+
+FTPSyncState::~FTPSyncState()
+{
+    log_.close();
+}
+
+bool FTPSyncState::load()
+{
+    std::ifstream file(statePath_, std::ios::in | std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    // 每行格式：本地大小\t本地修改时间\t远程大小\t远程修改时间\t相对路径
+    std::string line;
+    while (std::getline(file, line)) {
+        if (file.eof()) {
+            // 没有换行结尾，即使字段齐全，路径也可能被截断
+            return true;
+        }
+
+        size_t fields[4];
+        size_t position = 0;
+        bool complete = true;
+        for (size_t i = 0; i < 4; ++i) {
+            fields[i] = line.find('\t', position);
+            if (fields[i] == std::string::npos) {
+                complete = false;
+                break;
+            }
+            position = fields[i] + 1;
+        }
+        if (!complete) {
+            // 写入中途崩溃留下的不完整行
+            continue;
+        }
+
+        Entry entry;
+        try {
+            entry.localSize = std::stoll(line.substr(0, fields[0]));
+            entry.localTime = (time_t)std::stoll(line.substr(fields[0] + 1, fields[1] - fields[0] - 1));
+            entry.remoteSize = std::stoll(line.substr(fields[1] + 1, fields[2] - fields[1] - 1));
+            entry.remoteTime = (time_t)std::stoll(line.substr(fields[2] + 1, fields[3] - fields[2] - 1));
+        } catch (const std::exception&) {
+            continue;
+        }
+
+        entries_[line.substr(fields[3] + 1)] = entry;
+    }
+    return false;
+}
+
+bool FTPSyncState::find(const std::string& path, Entry& entry)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(path);
+    if (it == entries_.end()) {
+        return false;
+    }
+    entry = it->second;
+    return true;
+}
+
+bool FTPSyncState::matches(const std::string& path, const Entry& current)
+{
+    Entry entry;
+    if (!find(path, entry)) {
+        return false;
+    }
+    return entry.localSize == current.localSize && entry.localTime == current.localTime &&
+           entry.remoteSize == current.remoteSize && (entry.remoteTime == -1 || entry.remoteTime == current.remoteTime);
+}
+
+bool FTPSyncState::record(const std::string& path, const Entry& entry)
+{
+    if (path.find('\n') != std::string::npos) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto result = entries_.insert(std::make_pair(path, entry));
+    if (!result.second) {
+        const Entry& old = result.first->second;
+        if (old.localSize == entry.localSize && old.localTime == entry.localTime &&
+            old.remoteSize == entry.remoteSize && old.remoteTime == entry.remoteTime) {
+            return true;
+        }
+        result.first->second = entry;
+    }
+
+    if (!log_.is_open()) {
+        return false;
+    }
+    log_ << entry.localSize << '\t' << (long long)entry.localTime << '\t'
+         << entry.remoteSize << '\t' << (long long)entry.remoteTime << '\t' << path << '\n';
+    log_.flush();
+    return log_.good();
+}
+
+void FTPSyncState::erase(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.erase(path);
+}
+
+void FTPSyncState::prune(std::function<bool(const std::string& path)> keep)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (keep(it->first))
+            ++it;
+        else
+            it = entries_.erase(it);
+    }
+}
+
+bool FTPSyncState::save()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // 先写入临时文件再替换，中途崩溃不会丢失记录
+    std::string tempPath = statePath_ + ".tmp";
+    do{
+        std::ofstream temp(tempPath, std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!temp) {
+            std::cerr << "Failed to save sync state: " << statePath_ << std::endl;
+            return false;
+        }
+        for (const auto& item : entries_) {
+            const Entry& entry = item.second;
+            temp << entry.localSize << '\t' << (long long)entry.localTime << '\t'
+                 << entry.remoteSize << '\t' << (long long)entry.remoteTime << '\t' << item.first << '\n';
+        }
+        temp.flush();
+        if (!temp.good()) {
+            std::cerr << "Failed to save sync state: " << statePath_ << std::endl;
+            return false;
+        }
+    }while(false);
+
+    log_.close();
+#if defined(_WIN32)
+    std::remove(statePath_.c_str());
+#endif
+    bool renamed = std::rename(tempPath.c_str(), statePath_.c_str()) == 0;
+    if (!renamed) {
+        std::cerr << "Failed to save sync state: " << statePath_ << std::endl;
+    }
+
+    log_.clear();
+    log_.open(statePath_, std::ios::out | std::ios::app | std::ios::binary);
+    return renamed && log_.is_open();
+}
+
+size_t FTPSyncState::size()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
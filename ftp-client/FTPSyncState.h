@@ -0,0 +1,97 @@
+#ifndef FTPSYNCSTATE_H
+#define FTPSYNCSTATE_H
+
+#include <string>
+#include <fstream>
+#include <unordered_map>
+#include <mutex>
+#include <functional>
+
+#include <curl/curl.h>
+
+/**
+ * @brief 文件夹同步的状态快照
+ *
+ * 按相对路径记录上次同步完成时两端文件的大小和修改时间。下次同步时两端都与记录一致的文件
+ * 直接跳过，不需要比较修改时间或校验和。记录方式与FTPDownloadLedger相同：打开时一次性载入，
+ * 每完成一个文件追加一行，同步结束时重写文件去掉旧记录和已删除的路径。中途崩溃时已追加的记录仍然有效。
+ */
+class FTPSyncState
+{
+public:
+    struct Entry {
+        curl_off_t localSize;       // 本地文件大小
+        time_t localTime;           // 本地文件修改时间
+        curl_off_t remoteSize;      // 远程文件大小
+        time_t remoteTime;          // 远程文件修改时间，-1表示刚上传、尚未观测到，只比较大小
+    };
+
+public:
+    /**
+     * @brief 构造函数，载入状态文件
+     * @param statePath 状态文件路径，不存在时为空状态
+     */
+    explicit FTPSyncState(const std::string& statePath);
+
+    ~FTPSyncState();
+
+    /**
+     * @brief 查找相对路径的记录
+     * @param path 相对路径
+     * @param entry 找到的记录
+     * @return 找到时返回true
+     */
+    bool find(const std::string& path, Entry& entry);
+
+    /**
+     * @brief 判断两端的当前状态是否与记录一致
+     * @param path 相对路径
+     * @param current 当前观测到的两端状态
+     * @return 一致时返回true
+     */
+    bool matches(const std::string& path, const Entry& current);
+
+    /**
+     * @brief 记录同步完成的文件，覆盖同一路径的旧记录
+     * @param path 相对路径
+     * @param entry 两端状态
+     * @return 写入状态文件成功返回true
+     */
+    bool record(const std::string& path, const Entry& entry);
+
+    /**
+     * @brief 删除记录，在下次save时生效
+     * @param path 相对路径
+     */
+    void erase(const std::string& path);
+
+    /**
+     * @brief 删除keep返回false的记录，在下次save时生效
+     * @param keep 对每个相对路径调用，返回是否保留
+     */
+    void prune(std::function<bool(const std::string& path)> keep);
+
+    /**
+     * @brief 重写状态文件，只保留当前记录
+     * @return 成功返回true
+     */
+    bool save();
+
+    size_t size();
+
+private:
+    /**
+     * @brief 载入状态文件，没有以换行结尾的最后一行视为写入中途崩溃留下的不完整记录
+     * @return 最后一行不完整时返回true
+     */
+    bool load();
+
+private:
+    std::string statePath_;                             ///< 状态文件路径
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;    ///< 相对路径到记录的索引
+    std::ofstream log_;                                 ///< 追加写入的状态文件
+};
+
+#endif  // FTPSYNCSTATE_H
@@ -0,0 +1,153 @@
+#include "FTPTrafficControl.h"
+
+#include <algorithm>
+
+std::mutex FTPTrafficControl::registryMutex_;
+std::map<std::string, std::shared_ptr<FTPTrafficControl::Host>> FTPTrafficControl::registry_;
+
+FTPTrafficControl::BandwidthLimit::BandwidthLimit()
+    : rate_(0),
+      transfers_(0)
+{
+}
+
+void FTPTrafficControl::BandwidthLimit::setRate(curl_off_t bytesPerSecond)
+{
+    rate_ = bytesPerSecond > 0 ? bytesPerSecond : 0;
+}
+
+void FTPTrafficControl::BandwidthLimit::addTransfer()
+{
+    ++transfers_;
+}
+
+void FTPTrafficControl::BandwidthLimit::removeTransfer()
+{
+    --transfers_;
+}
+
+curl_off_t FTPTrafficControl::BandwidthLimit::share() const
+{
+    curl_off_t rate = rate_;
+    size_t transfers = transfers_;
+    if (rate == 0 || transfers <= 1) {
+        return rate;
+    }
+    // libcurl把0当作不限速，传输数多于速率时每个至少分得1字节/秒
+    return std::max<curl_off_t>(rate / (curl_off_t)transfers, 1);
+}
+
+FTPTrafficControl::Host::Host(const std::string& name)
+    : name_(name),
+      connections_(0),
+      maxConnections_(0)
+{
+}
+
+void FTPTrafficControl::Host::beginTransfer()
+{
+    bandwidth_.addTransfer();
+    globalBandwidth().addTransfer();
+}
+
+void FTPTrafficControl::Host::endTransfer()
+{
+    bandwidth_.removeTransfer();
+    globalBandwidth().removeTransfer();
+}
+
+curl_off_t FTPTrafficControl::Host::transferRate() const
+{
+    curl_off_t host = bandwidth_.share();
+    curl_off_t global = globalBandwidth().share();
+    if (host == 0 || global == 0) {
+        return std::max(host, global);
+    }
+    return std::min(host, global);
+}
+
+void FTPTrafficControl::Host::acquireConnection(IdleConnections* requester)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (maxConnections_ != 0 && connections_ >= maxConnections_) {
+        lock.unlock();
+        bool reclaimed = reclaimIdleConnection(requester);
+        lock.lock();
+        if (!reclaimed) {
+            // 传输引擎在工作线程中关闭缓存的连接，归还时会通知；定期重新请求，名额可能又被空闲连接占用
+            released_.wait_for(lock, std::chrono::milliseconds(100));
+        }
+    }
+    ++connections_;
+}
+
+bool FTPTrafficControl::Host::tryAcquireConnection()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (maxConnections_ != 0 && connections_ >= maxConnections_) {
+        return false;
+    }
+    ++connections_;
+    return true;
+}
+
+void FTPTrafficControl::Host::releaseConnection()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (connections_ > 0)
+        --connections_;
+    released_.notify_one();
+}
+
+bool FTPTrafficControl::Host::reclaimIdleConnection(IdleConnections* requester)
+{
+    std::lock_guard<std::mutex> lock(holdersMutex_);
+    for (IdleConnections* holder : holders_) {
+        if (holder != requester && holder->closeIdleConnection()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FTPTrafficControl::Host::addIdleConnections(IdleConnections* holder)
+{
+    std::lock_guard<std::mutex> lock(holdersMutex_);
+    holders_.push_back(holder);
+}
+
+void FTPTrafficControl::Host::removeIdleConnections(IdleConnections* holder)
+{
+    // 与reclaimIdleConnection互斥，返回后不会再有对holder的调用
+    std::lock_guard<std::mutex> lock(holdersMutex_);
+    holders_.erase(std::remove(holders_.begin(), holders_.end(), holder), holders_.end());
+}
+
+void FTPTrafficControl::Host::setConnectionLimit(size_t maxConnections)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    maxConnections_ = maxConnections;
+    released_.notify_all();
+}
+
+size_t FTPTrafficControl::Host::connectionLimit()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return maxConnections_;
+}
+
+std::shared_ptr<FTPTrafficControl::Host> FTPTrafficControl::host(const std::string& host)
+{
+    std::lock_guard<std::mutex> lock(registryMutex_);
+    std::shared_ptr<Host>& entry = registry_[host];
+    if (!entry) {
+        entry = std::make_shared<Host>(host);
+    }
+    return entry;
+}
+
+FTPTrafficControl::BandwidthLimit& FTPTrafficControl::globalBandwidth()
+{
+    static BandwidthLimit limit;
+    return limit;
+}
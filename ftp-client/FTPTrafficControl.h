@@ -0,0 +1,169 @@
+#ifndef FTPTRAFFICCONTROL_H
+#define FTPTRAFFICCONTROL_H
+
+#include <string>
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+
+#include <curl/curl.h>
+
+/**
+ * @brief 进程内的流量控制
+ *
+ * 全局和每个主机各有一个带宽上限，由进行中的传输平分，每个传输分得的速率通过CURLOPT_MAX_RECV_SPEED_LARGE
+ * 或CURLOPT_MAX_SEND_SPEED_LARGE交给libcurl执行，libcurl在传输的等待中限速，不阻塞回调。
+ * 每个主机另有一个信号量限制同时打开的已登录连接数。
+ * 连接在关闭之前一直占用名额，包括连接池中的空闲连接和传输引擎中缓存的连接；
+ * 等待名额的调用方请求这些持有者关闭空闲连接。
+ * 同一进程内连接同一主机的所有FTPClient共享这些限制，限制可以在传输过程中随时修改，
+ * 正在进行的传输在下一次进度回调时按新的限制执行。
+ */
+class FTPTrafficControl
+{
+public:
+    /**
+     * @brief 带宽上限，由进行中的传输平分
+     */
+    class BandwidthLimit
+    {
+    public:
+        BandwidthLimit();
+
+        /**
+         * @brief 设置速率
+         * @param bytesPerSecond 每秒字节数，为0时不限速
+         */
+        void setRate(curl_off_t bytesPerSecond);
+
+        curl_off_t rate() const { return rate_; }
+
+        /**
+         * @brief 登记和注销进行中的传输
+         */
+        void addTransfer();
+        void removeTransfer();
+
+        /**
+         * @brief 每个传输分得的速率
+         * @return 每秒字节数，不限速时为0
+         */
+        curl_off_t share() const;
+
+    private:
+        std::atomic<curl_off_t> rate_;
+        std::atomic<size_t> transfers_;     ///< 进行中的传输数量
+    };
+
+    /**
+     * @brief 保留空闲连接的对象，如连接池和传输引擎，其空闲连接仍占用主机的连接名额
+     */
+    class IdleConnections
+    {
+    public:
+        virtual ~IdleConnections() {}
+
+        /**
+         * @brief 请求关闭一个空闲连接并归还其名额，可在任意线程调用，不应长时间阻塞
+         * @return 已归还一个名额返回true；没有空闲连接或稍后在其他线程归还时返回false
+         */
+        virtual bool closeIdleConnection() = 0;
+    };
+
+    /**
+     * @brief 单个主机的限制
+     */
+    class Host
+    {
+    public:
+        explicit Host(const std::string& name);
+
+        const std::string& name() const { return name_; }
+
+        /**
+         * @brief 登记和注销进行中的传输，参与主机和全局带宽的分配
+         */
+        void beginTransfer();
+        void endTransfer();
+
+        /**
+         * @brief 按主机和全局限速计算一个传输当前可用的速率
+         * @return 每秒字节数，不限速时为0
+         */
+        curl_off_t transferRate() const;
+
+        /**
+         * @brief 阻塞等待直到可以打开一个连接，等待期间请求其他持有者关闭空闲连接
+         * @param requester 调用方自己的空闲连接，不向其请求
+         */
+        void acquireConnection(IdleConnections* requester = NULL);
+
+        /**
+         * @brief 尝试占用一个连接，不阻塞
+         * @return 成功返回true
+         */
+        bool tryAcquireConnection();
+
+        /**
+         * @brief 归还acquireConnection或tryAcquireConnection占用的连接，在连接关闭后调用
+         */
+        void releaseConnection();
+
+        /**
+         * @brief 请求其他持有者关闭一个空闲连接，不阻塞等待异步的关闭
+         * @param requester 调用方自己的空闲连接，不向其请求
+         * @return 已有名额被同步归还返回true
+         */
+        bool reclaimIdleConnection(IdleConnections* requester);
+
+        /**
+         * @brief 登记空闲连接的持有者，持有者销毁前须调用removeIdleConnections
+         */
+        void addIdleConnections(IdleConnections* holder);
+        void removeIdleConnections(IdleConnections* holder);
+
+        /**
+         * @brief 设置同时使用的连接数上限
+         * @param maxConnections 连接数上限，为0时不限制
+         */
+        void setConnectionLimit(size_t maxConnections);
+
+        size_t connectionLimit();
+
+        BandwidthLimit& bandwidth() { return bandwidth_; }
+
+    private:
+        std::string name_;
+        BandwidthLimit bandwidth_;
+
+        std::mutex mutex_;
+        std::condition_variable released_;
+        size_t connections_;        ///< 占用名额的连接数，包括空闲连接
+        size_t maxConnections_;     ///< 连接数上限，0为不限制
+
+        std::mutex holdersMutex_;
+        std::vector<IdleConnections*> holders_;     ///< 空闲连接的持有者
+    };
+
+public:
+    /**
+     * @brief 获取主机的限制，不存在则创建
+     * @param host FTP服务器主机名:端口
+     */
+    static std::shared_ptr<Host> host(const std::string& host);
+
+    /**
+     * @brief 进程内所有传输共享的全局带宽上限
+     */
+    static BandwidthLimit& globalBandwidth();
+
+private:
+    static std::mutex registryMutex_;
+    static std::map<std::string, std::shared_ptr<Host>> registry_;
+};
+
+#endif  // FTPTRAFFICCONTROL_H
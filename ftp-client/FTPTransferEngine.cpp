@@ -0,0 +1,729 @@
+#include "FTPTransferEngine.h"
+
+#include <iostream>
+#include <limits>
+#include <algorithm>
+
+FTPTransferEngine::Batch::Batch()
+    : pending_(0),
+      allSucceeded_(true)
+{
+}
+
+void FTPTransferEngine::Batch::add(size_t count)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_ += count;
+}
+
+void FTPTransferEngine::Batch::done(bool succeeded)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!succeeded)
+        allSucceeded_ = false;
+    if (--pending_ == 0)
+        finished_.notify_all();
+}
+
+bool FTPTransferEngine::Batch::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    finished_.wait(lock, [this]() { return pending_ == 0; });
+    return allSucceeded_;
+}
+
+FTPTransferEngine::FTPTransferEngine(std::shared_ptr<FTPConnectionPool> pool, size_t maxConcurrent, size_t workerCount)
+    : pool_(pool),
+      trafficHost_(pool->trafficHost()),
+      workerCount_(0),
+      workerLimit_(workerCount > 0 ? workerCount : 1),
+      nextSequence_(0),
+      policy_(Fifo),
+      smallFileLimit_(-1),
+      reservedSlots_(0),
+      started_(0),
+      totalWaitSeconds_(0),
+      maxWaitSeconds_(0),
+      stopping_(false),
+      maxConcurrent_(maxConcurrent > 0 ? maxConcurrent : 1),
+      activeCount_(0),
+      activeLarge_(0),
+      controlGeneration_(0),
+      reclaimGeneration_(0),
+      lastAdjustment_(std::chrono::steady_clock::now()),
+      bytesMoved_(0),
+      refusals_(0),
+      saturated_(false)
+{
+    // 其他线程在不加锁的情况下遍历已启动的工作线程，预留全部位置使增加时不会移动已有的元素
+    workers_.reserve(workerLimit_);
+    ensureWorkers(maxConcurrent_);
+    trafficHost_->addIdleConnections(this);
+}
+
+FTPTransferEngine::~FTPTransferEngine()
+{
+    trafficHost_->removeIdleConnections(this);
+    do{
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }while(false);
+    wakeAll();
+
+    for (auto& worker : workers_) {
+        worker->thread.join();
+    }
+
+    for (auto& worker : workers_) {
+        for (CURL* curl : worker->freeHandles) {
+            curl_easy_cleanup(curl);
+        }
+        curl_multi_cleanup(worker->multi);
+        for (; worker->permits > 0; --worker->permits) {
+            trafficHost_->releaseConnection();
+        }
+    }
+}
+
+bool FTPTransferEngine::QueueKey::operator<(const QueueKey& other) const
+{
+    if (urgent != other.urgent)
+        return urgent;
+    if (priority != other.priority)
+        return priority > other.priority;
+    if (order != other.order)
+        return order < other.order;
+    return sequence < other.sequence;
+}
+
+void FTPTransferEngine::submit(Job job, bool urgent)
+{
+    do{
+        std::lock_guard<std::mutex> lock(mutex_);
+        QueueKey key;
+        key.urgent = urgent;
+        key.priority = job.priority;
+        key.order = 0;
+        key.sequence = nextSequence_++;
+        enqueue(key, Queued{std::move(job), std::chrono::steady_clock::now()});
+    }while(false);
+    wakeAll();
+}
+
+void FTPTransferEngine::submitAfter(Job job, std::chrono::milliseconds delay)
+{
+    do{
+        std::lock_guard<std::mutex> lock(mutex_);
+        delayed_.emplace(std::chrono::steady_clock::now() + delay, std::move(job));
+    }while(false);
+    // 工作线程按最早的到期时间重新计算等待超时
+    wakeAll();
+}
+
+void FTPTransferEngine::releaseDelayed()
+{
+    auto now = std::chrono::steady_clock::now();
+    while (!delayed_.empty() && delayed_.begin()->first <= now) {
+        Job job = std::move(delayed_.begin()->second);
+        delayed_.erase(delayed_.begin());
+
+        QueueKey key;
+        key.urgent = false;
+        key.priority = job.priority;
+        key.order = 0;
+        key.sequence = nextSequence_++;
+        Queued queued{std::move(job), now};
+        if (queued.job.control && queued.job.control->paused) {
+            held_.emplace_back(key, std::move(queued));
+        } else {
+            enqueue(key, std::move(queued));
+        }
+    }
+}
+
+void FTPTransferEngine::enqueue(QueueKey key, Queued queued)
+{
+    curl_off_t size = queued.job.size;
+    switch (policy_) {
+    case ShortestFirst:
+        key.order = size >= 0 ? size : std::numeric_limits<curl_off_t>::max();
+        break;
+    case LargestFirst:
+        // 已知大小的任务排序值不大于0，大小未知的排在其后
+        key.order = size >= 0 ? -size : 1;
+        break;
+    default:
+        key.order = 0;
+        break;
+    }
+
+    bool small = key.urgent || (smallFileLimit_ >= 0 && size >= 0 && size <= smallFileLimit_);
+    (small ? smallQueue_ : largeQueue_).emplace(key, std::move(queued));
+}
+
+FTPTransferEngine::Queue* FTPTransferEngine::selectQueue()
+{
+    size_t largeSlots = maxConcurrent_ > reservedSlots_ ? maxConcurrent_ - reservedSlots_ : 1;
+    bool largeAllowed = !largeQueue_.empty() && activeLarge_ < largeSlots;
+    if (smallQueue_.empty()) {
+        return largeAllowed ? &largeQueue_ : NULL;
+    }
+    if (!largeAllowed || smallQueue_.begin()->first < largeQueue_.begin()->first) {
+        return &smallQueue_;
+    }
+    return &largeQueue_;
+}
+
+void FTPTransferEngine::requeueAll()
+{
+    std::vector<std::pair<QueueKey, Queued>> queued;
+    for (Queue* queue : {&smallQueue_, &largeQueue_}) {
+        for (auto& item : *queue) {
+            queued.emplace_back(item.first, std::move(item.second));
+        }
+        queue->clear();
+    }
+    for (auto& item : queued) {
+        enqueue(item.first, std::move(item.second));
+    }
+}
+
+void FTPTransferEngine::setPolicy(Policy policy)
+{
+    do{
+        std::lock_guard<std::mutex> lock(mutex_);
+        policy_ = policy;
+        requeueAll();
+    }while(false);
+    wakeAll();
+}
+
+void FTPTransferEngine::setSmallFileLane(curl_off_t maxSize, size_t reservedSlots)
+{
+    do{
+        std::lock_guard<std::mutex> lock(mutex_);
+        smallFileLimit_ = maxSize;
+        reservedSlots_ = maxSize >= 0 ? reservedSlots : 0;
+        requeueAll();
+    }while(false);
+    wakeAll();
+}
+
+FTPTransferEngine::QueueStats FTPTransferEngine::queueStats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    QueueStats stats;
+    stats.queued = smallQueue_.size() + largeQueue_.size();
+    stats.delayed = delayed_.size();
+    stats.started = started_;
+    stats.totalWaitSeconds = totalWaitSeconds_;
+    stats.maxWaitSeconds = maxWaitSeconds_;
+    return stats;
+}
+
+void FTPTransferEngine::wake()
+{
+    ++controlGeneration_;
+    wakeAll();
+}
+
+bool FTPTransferEngine::closeIdleConnection()
+{
+    ++reclaimGeneration_;
+    wakeAll();
+    return false;
+}
+
+void FTPTransferEngine::setMaxConcurrentTransfers(size_t maxConcurrent)
+{
+    maxConcurrent_ = maxConcurrent > 0 ? maxConcurrent : 1;
+    ensureWorkers(maxConcurrent_);
+    wakeAll();
+}
+
+void FTPTransferEngine::ensureWorkers(size_t maxConcurrent)
+{
+    std::lock_guard<std::mutex> lock(workersMutex_);
+    size_t target = std::min(workerLimit_, std::max<size_t>(maxConcurrent, 1));
+    while (workers_.size() < target) {
+        std::unique_ptr<Worker> worker(new Worker());
+        worker->multi = curl_multi_init();
+        worker->appliedMaxConnects = 0;
+        worker->waitingForConnection = false;
+        worker->appliedControlGeneration = 0;
+        worker->permits = 0;
+        worker->appliedReclaimGeneration = reclaimGeneration_;
+
+        // 先公开再启动线程，新线程按包括自己在内的工作线程数分配连接缓存
+        Worker* started = worker.get();
+        workers_.push_back(std::move(worker));
+        workerCount_ = workers_.size();
+        started->thread = std::thread(&FTPTransferEngine::run, this, started);
+    }
+}
+
+void FTPTransferEngine::setAdaptiveConcurrency(bool enabled, size_t minConcurrent, size_t maxConcurrent)
+{
+    do{
+        std::lock_guard<std::mutex> lock(controllerMutex_);
+        if (!enabled) {
+            controller_.reset();
+            break;
+        }
+        controller_.reset(new FTPConcurrencyController(minConcurrent, maxConcurrent, maxConcurrent_));
+        ensureWorkers(maxConcurrent);
+        maxConcurrent_ = controller_->level();
+        lastAdjustment_ = std::chrono::steady_clock::now();
+        bytesMoved_ = 0;
+        refusals_ = 0;
+        saturated_ = false;
+    }while(false);
+    wakeAll();
+}
+
+void FTPTransferEngine::adjustConcurrency()
+{
+    // 测量周期，太短时吞吐量受单个文件开始和结束的影响较大
+    const double periodSeconds = 2.0;
+
+    std::unique_lock<std::mutex> lock(controllerMutex_, std::try_to_lock);
+    if (!lock.owns_lock() || !controller_) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - lastAdjustment_).count();
+    if (seconds < periodSeconds) {
+        return;
+    }
+    lastAdjustment_ = now;
+
+    size_t level = controller_->update(seconds, bytesMoved_.exchange(0), refusals_.exchange(0), saturated_.exchange(false));
+    if (level != maxConcurrent_) {
+        maxConcurrent_ = level;
+        wakeAll();
+    }
+}
+
+void FTPTransferEngine::measure(Worker* worker)
+{
+    curl_off_t moved = 0;
+    for (auto& item : worker->transferred) {
+        curl_off_t downloaded = 0;
+        curl_off_t uploaded = 0;
+        curl_easy_getinfo(item.first, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+        curl_easy_getinfo(item.first, CURLINFO_SIZE_UPLOAD_T, &uploaded);
+        moved += downloaded + uploaded - item.second;
+        item.second = downloaded + uploaded;
+    }
+    if (moved > 0) {
+        bytesMoved_ += moved;
+    }
+}
+
+void FTPTransferEngine::measureFinished(Worker* worker, CURL* curl)
+{
+    auto it = worker->transferred.find(curl);
+    if (it == worker->transferred.end()) {
+        return;
+    }
+
+    curl_off_t downloaded = 0;
+    curl_off_t uploaded = 0;
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &uploaded);
+    if (downloaded + uploaded > it->second) {
+        bytesMoved_ += downloaded + uploaded - it->second;
+    }
+    worker->transferred.erase(it);
+}
+
+bool FTPTransferEngine::isRefusal(CURL* curl, CURLcode result)
+{
+    if (result == CURLE_OK) {
+        return false;
+    }
+    if (result == CURLE_COULDNT_CONNECT || result == CURLE_LOGIN_DENIED) {
+        return true;
+    }
+
+    // 421 服务不可用（常见于连接数过多），530 未登录（部分服务器超出会话数时返回）
+    long responseCode = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+    return responseCode == 421 || responseCode == 530;
+}
+
+void FTPTransferEngine::wakeAll()
+{
+    for (size_t i = 0; i < workerCount_; ++i) {
+        std::lock_guard<std::mutex> lock(workers_[i]->multiMutex);
+        curl_multi_wakeup(workers_[i]->multi);
+    }
+}
+
+void FTPTransferEngine::wakeOthers(Worker* self)
+{
+    for (size_t i = 0; i < workerCount_; ++i) {
+        if (workers_[i].get() != self) {
+            std::lock_guard<std::mutex> lock(workers_[i]->multiMutex);
+            curl_multi_wakeup(workers_[i]->multi);
+        }
+    }
+}
+
+void FTPTransferEngine::closeCachedConnections(Worker* worker)
+{
+    if (worker->permits == 0) {
+        return;
+    }
+
+    // libcurl没有单独关闭缓存连接的接口，连接随multi句柄一起关闭
+    CURLM* multi = curl_multi_init();
+    if (!multi) {
+        return;
+    }
+    curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long)worker->appliedMaxConnects);
+
+    CURLM* old = NULL;
+    do{
+        std::lock_guard<std::mutex> lock(worker->multiMutex);
+        old = worker->multi;
+        worker->multi = multi;
+    }while(false);
+    curl_multi_cleanup(old);
+
+    for (; worker->permits > 0; --worker->permits) {
+        trafficHost_->releaseConnection();
+    }
+}
+
+void FTPTransferEngine::run(Worker* worker)
+{
+    while (true) {
+        bool stopping;
+        do{
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping = stopping_;
+        }while(false);
+        if (stopping) {
+            abortAll(worker);
+            return;
+        }
+
+        // multi句柄的选项只在所属工作线程中修改
+        size_t maxConnects = maxConcurrent_ / workerCount_ + 1;
+        if (worker->appliedMaxConnects != maxConnects) {
+            worker->appliedMaxConnects = maxConnects;
+            curl_multi_setopt(worker->multi, CURLMOPT_MAXCONNECTS, (long)maxConnects);
+        }
+
+        applyControls(worker);
+        activatePending(worker);
+
+        int running = 0;
+        curl_multi_perform(worker->multi, &running);
+        measure(worker);
+        collectFinished(worker);
+        adjustConcurrency();
+
+        // 有其他调用方等待主机连接名额，空闲后关闭缓存的连接
+        unsigned reclaim = reclaimGeneration_;
+        if (worker->appliedReclaimGeneration != reclaim && worker->active.empty()) {
+            worker->appliedReclaimGeneration = reclaim;
+            closeCachedConnections(worker);
+        }
+
+        // 立即用等待中的任务填补刚结束的传输腾出的位置，新加入的句柄会使下面的等待立即返回
+        activatePending(worker);
+        if (worker->waitingForConnection) {
+            trafficHost_->reclaimIdleConnection(this);
+        }
+
+        // 有新任务提交或并发上限变化时由 curl_multi_wakeup 唤醒；
+        // 连接名额可能被其他FTPClient归还，等待名额时缩短超时以便及时重试
+        int timeout = worker->waitingForConnection ? 50 : 1000;
+        do{
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!delayed_.empty()) {
+                auto due = std::chrono::duration_cast<std::chrono::milliseconds>(delayed_.begin()->first - std::chrono::steady_clock::now());
+                timeout = (int)std::max<long long>(0, std::min<long long>(timeout, due.count() + 1));
+            }
+        }while(false);
+        curl_multi_poll(worker->multi, NULL, 0, timeout, NULL);
+    }
+}
+
+void FTPTransferEngine::activatePending(Worker* worker)
+{
+    worker->waitingForConnection = false;
+    do{
+        std::lock_guard<std::mutex> lock(mutex_);
+        releaseDelayed();
+    }while(false);
+
+    while (true) {
+        Job job;
+        bool large = false;
+        do{
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (smallQueue_.empty() && largeQueue_.empty()) {
+                return;
+            }
+            if (activeCount_ >= maxConcurrent_) {
+                saturated_ = true;
+                return;
+            }
+            if (worker->active.size() >= worker->appliedMaxConnects) {
+                // 超出连接缓存上限的传输结束时连接会被关闭，下一个任务又要重新登录，交给其他工作线程
+                wakeOthers(worker);
+                return;
+            }
+            // 大文件名额已满且没有小文件时，剩余的位置留给之后到达的小文件
+            Queue* queue = selectQueue();
+            if (!queue) {
+                return;
+            }
+            // 名额多于进行中的传输时，多出的名额对应缓存的连接，新任务沿用
+            if (worker->permits <= worker->active.size()) {
+                if (!trafficHost_->tryAcquireConnection()) {
+                    worker->waitingForConnection = true;
+                    return;
+                }
+                ++worker->permits;
+            }
+            auto next = queue->begin();
+            double wait = std::chrono::duration<double>(std::chrono::steady_clock::now() - next->second.since).count();
+            ++started_;
+            totalWaitSeconds_ += wait;
+            maxWaitSeconds_ = std::max(maxWaitSeconds_, wait);
+
+            job = std::move(next->second.job);
+            queue->erase(next);
+            large = queue == &largeQueue_;
+            ++activeCount_;
+            if (large) {
+                ++activeLarge_;
+            }
+        }while(false);
+
+        CURL* curl = takeHandle(worker);
+        if (!curl) {
+            releaseSlot(large);
+            job.complete(NULL, CURLE_FAILED_INIT);
+            continue;
+        }
+
+        if (!job.prepare(curl)) {
+            releaseSlot(large);
+            job.complete(curl, CURLE_FAILED_INIT);
+            recycleHandle(worker, curl);
+            continue;
+        }
+
+        if (curl_multi_add_handle(worker->multi, curl) != CURLM_OK) {
+            releaseSlot(large);
+            job.complete(curl, CURLE_FAILED_INIT);
+            recycleHandle(worker, curl);
+            continue;
+        }
+        worker->active[curl] = std::move(job);
+        worker->transferred[curl] = 0;
+        if (large) {
+            worker->large.insert(curl);
+        }
+    }
+}
+
+void FTPTransferEngine::applyControls(Worker* worker)
+{
+    unsigned generation = controlGeneration_;
+    if (worker->appliedControlGeneration == generation) {
+        return;
+    }
+    worker->appliedControlGeneration = generation;
+
+    // 等待中和延迟提交的任务：取消的直接结束，暂停的移到held_，恢复的按原来的排序键放回队列
+    std::vector<Job> cancelled;
+    do{
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<std::pair<QueueKey, Queued>> held;
+        for (Queue* queue : {&smallQueue_, &largeQueue_}) {
+            for (auto it = queue->begin(); it != queue->end();) {
+                Control* control = it->second.job.control.get();
+                if (control && control->cancelled) {
+                    cancelled.push_back(std::move(it->second.job));
+                } else if (control && control->paused) {
+                    held.emplace_back(it->first, std::move(it->second));
+                } else {
+                    ++it;
+                    continue;
+                }
+                it = queue->erase(it);
+            }
+        }
+        for (auto it = delayed_.begin(); it != delayed_.end();) {
+            Control* control = it->second.control.get();
+            if (control && control->cancelled) {
+                cancelled.push_back(std::move(it->second));
+                it = delayed_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        for (auto& item : held_) {
+            Control* control = item.second.job.control.get();
+            if (control->cancelled) {
+                cancelled.push_back(std::move(item.second.job));
+            } else if (control->paused) {
+                held.push_back(std::move(item));
+            } else {
+                // 暂停的时间不计入排队时间
+                item.second.since = std::chrono::steady_clock::now();
+                enqueue(item.first, std::move(item.second));
+            }
+        }
+        held_.swap(held);
+    }while(false);
+
+    for (Job& job : cancelled) {
+        job.complete(NULL, CURLE_ABORTED_BY_CALLBACK);
+    }
+
+    // 进行中的传输：取消的从multi句柄移除，暂停和恢复由curl_easy_pause在本线程中执行
+    for (auto it = worker->active.begin(); it != worker->active.end();) {
+        CURL* curl = it->first;
+        Control* control = it->second.control.get();
+        if (control && control->cancelled) {
+            curl_multi_remove_handle(worker->multi, curl);
+            measureFinished(worker, curl);
+            worker->paused.erase(curl);
+            Job job = std::move(it->second);
+            it = worker->active.erase(it);
+            releaseSlot(worker->large.erase(curl) > 0);
+
+            job.complete(curl, CURLE_ABORTED_BY_CALLBACK);
+            recycleHandle(worker, curl);
+            continue;
+        }
+
+        bool paused = control && control->paused;
+        if (paused != (worker->paused.count(curl) > 0)) {
+            curl_easy_pause(curl, paused ? CURLPAUSE_ALL : CURLPAUSE_CONT);
+            if (paused) {
+                worker->paused.insert(curl);
+            } else {
+                worker->paused.erase(curl);
+            }
+        }
+        ++it;
+    }
+}
+
+void FTPTransferEngine::collectFinished(Worker* worker)
+{
+    CURLMsg* msg;
+    int remaining = 0;
+    while ((msg = curl_multi_info_read(worker->multi, &remaining)) != NULL) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+
+        CURL* curl = msg->easy_handle;
+        CURLcode result = msg->data.result;
+        curl_multi_remove_handle(worker->multi, curl);
+
+        measureFinished(worker, curl);
+        if (isRefusal(curl, result)) {
+            ++refusals_;
+        }
+
+        auto it = worker->active.find(curl);
+        if (it == worker->active.end()) {
+            recycleHandle(worker, curl);
+            continue;
+        }
+        Job job = std::move(it->second);
+        worker->active.erase(it);
+        worker->paused.erase(curl);
+        releaseSlot(worker->large.erase(curl) > 0);
+
+        job.complete(curl, result);
+        recycleHandle(worker, curl);
+    }
+}
+
+void FTPTransferEngine::abortAll(Worker* worker)
+{
+    for (auto& item : worker->active) {
+        curl_multi_remove_handle(worker->multi, item.first);
+        releaseSlot(worker->large.count(item.first) > 0);
+        item.second.complete(item.first, CURLE_ABORTED_BY_CALLBACK);
+        recycleHandle(worker, item.first);
+    }
+    worker->active.clear();
+    worker->transferred.clear();
+    worker->paused.clear();
+    worker->large.clear();
+
+    // complete回调中可能继续提交后续任务，直到队列清空为止
+    while (true) {
+        std::vector<Job> pending;
+        do{
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (Queue* queue : {&smallQueue_, &largeQueue_}) {
+                for (auto& item : *queue) {
+                    pending.push_back(std::move(item.second.job));
+                }
+                queue->clear();
+            }
+            for (auto& item : held_) {
+                pending.push_back(std::move(item.second.job));
+            }
+            held_.clear();
+            for (auto& item : delayed_) {
+                pending.push_back(std::move(item.second));
+            }
+            delayed_.clear();
+        }while(false);
+
+        if (pending.empty()) {
+            break;
+        }
+        for (Job& job : pending) {
+            job.complete(NULL, CURLE_ABORTED_BY_CALLBACK);
+        }
+    }
+}
+
+void FTPTransferEngine::releaseSlot(bool large)
+{
+    --activeCount_;
+    if (large) {
+        --activeLarge_;
+    }
+}
+
+CURL* FTPTransferEngine::takeHandle(Worker* worker)
+{
+    CURL* curl = NULL;
+    if (!worker->freeHandles.empty()) {
+        curl = worker->freeHandles.back();
+        worker->freeHandles.pop_back();
+    } else {
+        curl = curl_easy_init();
+        if (!curl) {
+            std::cerr << "Failed to initialize curl handle for: " << pool_->host() << std::endl;
+            return NULL;
+        }
+    }
+
+    pool_->applyDefaults(curl);
+    return curl;
+}
+
+void FTPTransferEngine::recycleHandle(Worker* worker, CURL* curl)
+{
+    // 连接缓存在multi句柄中，easy句柄只保留选项，重置后即可复用
+    curl_easy_reset(curl);
+    worker->freeHandles.push_back(curl);
+}
@@ -0,0 +1,360 @@
+#ifndef FTPTRANSFERENGINE_H
+#define FTPTRANSFERENGINE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <memory>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+
+#include <curl/curl.h>
+
+#include "FTPConnectionPool.h"
+#include "FTPConcurrencyController.h"
+
+/**
+ * @brief 基于libcurl multi接口的传输引擎
+ *
+ * 少量工作线程各自驱动一个multi句柄，从共享队列中领取任务；工作线程数随并发上限增加，最多为workerCount个，
+ * 同时进行的传输总数受并发上限和主机连接数上限控制，超出上限的任务在队列中等待。
+ * 开启自适应并发后，并发上限由FTPConcurrencyController根据吞吐量和服务器拒绝次数周期性调整。
+ * 连接由各multi句柄缓存，在任务之间复用。libcurl在FTP传输结束时会阻塞等待226回复，
+ * 多个工作线程可避免该等待使所有传输串行化。
+ * 缓存的连接继续占用主机连接名额，其他调用方等待名额时，工作线程在没有进行中的传输后关闭缓存的连接并归还名额。
+ * 等待队列按优先级排序，优先级相同时按排序策略以任务大小或提交顺序排序。
+ * 设置小文件通道后，大文件最多占用并发上限减去保留名额的传输位置，保留的名额只执行小文件和紧急任务。
+ * 延迟提交的任务（如失败后的重试）在到期前不进入等待队列，也不占用并发名额。
+ */
+class FTPTransferEngine : public FTPTrafficControl::IdleConnections
+{
+public:
+    /**
+     * @brief 等待队列的排序策略，用于优先级相同的任务
+     */
+    enum Policy {
+        Fifo,               // 按提交顺序
+        ShortestFirst,      // 小的先执行，缩短平均完成时间；大小未知的排在最后
+        LargestFirst        // 大的先执行，避免大文件拖在批次末尾，缩短整批的完成时间；大小未知的排在最后
+    };
+
+    /**
+     * @brief 排队统计，从引擎创建时开始累计
+     */
+    struct QueueStats {
+        size_t queued;              // 当前等待中的任务数，不含暂停的任务
+        size_t delayed;             // 延迟提交尚未到期的任务数
+        size_t started;             // 已开始执行的任务数
+        double totalWaitSeconds;    // 已开始的任务在队列中等待的总时间
+        double maxWaitSeconds;      // 单个任务的最长等待时间
+    };
+
+    /**
+     * @brief 任务的外部控制，可在任意线程中修改，修改后调用wake，由工作线程在下一轮循环中执行
+     */
+    struct Control {
+        std::atomic<bool> cancelled;    // 取消：等待中的任务不再执行，进行中的传输被中止，complete的result为CURLE_ABORTED_BY_CALLBACK
+        std::atomic<bool> paused;       // 暂停：等待中的任务暂不执行，进行中的传输停止收发但保留连接和并发名额
+
+        Control() : cancelled(false), paused(false) {}
+    };
+
+    /**
+     * @brief 传输任务
+     *
+     * prepare 在引擎线程中调用，用于在句柄上设置传输选项，返回false表示不执行传输；
+     * complete 在传输结束后于引擎线程中调用，无论prepare是否成功都只调用一次，
+     * prepare失败时result为CURLE_FAILED_INIT。回调中不应执行阻塞操作，可以再次调用submit。
+     * control不为空时调用方可取消、暂停和恢复该任务。
+     * size为要传输的字节数，只有控制命令、不传输数据的任务为0，未知时为-1；priority大的先执行。
+     */
+    struct Job {
+        std::function<bool(CURL*)> prepare;
+        std::function<void(CURL*, CURLcode)> complete;
+        std::shared_ptr<Control> control;
+        curl_off_t size;
+        int priority;
+
+        Job() : size(-1), priority(0) {}
+    };
+
+    /**
+     * @brief 等待一组任务全部结束
+     */
+    class Batch
+    {
+    public:
+        Batch();
+
+        /**
+         * @brief 增加未完成任务数量，须在任务提交之前调用
+         * @param count 任务数量
+         */
+        void add(size_t count = 1);
+
+        /**
+         * @brief 标记一个任务结束
+         * @param succeeded 任务是否成功
+         */
+        void done(bool succeeded);
+
+        /**
+         * @brief 阻塞等待全部任务结束
+         * @return 全部成功返回true，否则返回false
+         */
+        bool wait();
+
+    private:
+        std::mutex mutex_;
+        std::condition_variable finished_;
+        size_t pending_;
+        bool allSucceeded_;
+    };
+
+public:
+    /**
+     * @brief 构造函数，启动工作线程
+     * @param pool 连接池，用于获取登录信息等公共选项
+     * @param maxConcurrent 同时进行的传输数量上限
+     * @param workerCount 工作线程数量的上限，实际启动的数量不超过并发上限，并发上限提高时补足
+     */
+    FTPTransferEngine(std::shared_ptr<FTPConnectionPool> pool, size_t maxConcurrent, size_t workerCount = 4);
+
+    /**
+     * @brief 析构函数，中止未完成的任务并停止工作线程
+     */
+    ~FTPTransferEngine();
+
+    /**
+     * @brief 提交任务，可在任意线程调用
+     * @param job 传输任务
+     * @param urgent 为true时排在等待队列最前面，用于目录列表等需要尽快执行的任务
+     */
+    void submit(Job job, bool urgent = false);
+
+    /**
+     * @brief 延迟提交任务，到期后按普通任务排队，可在任意线程调用
+     * @param job 传输任务，等待期间可被取消；到期时已暂停的任务在恢复后才排队
+     * @param delay 延迟时间
+     */
+    void submitAfter(Job job, std::chrono::milliseconds delay);
+
+    /**
+     * @brief 设置同时进行的传输数量上限，正在进行的传输不受影响，工作线程不足时启动新的工作线程
+     * @param maxConcurrent 并发上限，最小为1
+     */
+    void setMaxConcurrentTransfers(size_t maxConcurrent);
+
+    size_t maxConcurrentTransfers() const { return maxConcurrent_; }
+
+    /**
+     * @brief 开启或关闭自适应并发，开启后并发上限在[minConcurrent, maxConcurrent]内自动调整，
+     *        从当前的并发上限开始；此时setMaxConcurrentTransfers设置的值会在下一个周期被覆盖
+     * @param enabled 是否开启
+     * @param minConcurrent 并发数下限
+     * @param maxConcurrent 并发数上限
+     */
+    void setAdaptiveConcurrency(bool enabled, size_t minConcurrent, size_t maxConcurrent);
+
+    /**
+     * @brief 通知工作线程有任务的Control被修改，可在任意线程调用
+     */
+    void wake();
+
+    /**
+     * @brief 设置等待队列的排序策略，已在队列中的任务重新排序
+     * @param policy 排序策略
+     */
+    void setPolicy(Policy policy);
+
+    /**
+     * @brief 设置小文件通道
+     * @param maxSize 不超过该大小的任务为小文件，为负数时关闭通道
+     * @param reservedSlots 为小文件保留的传输位置数，大文件最多占用并发上限减去该值（至少1个）
+     */
+    void setSmallFileLane(curl_off_t maxSize, size_t reservedSlots);
+
+    /**
+     * @brief 获取排队统计
+     */
+    QueueStats queueStats();
+
+    /**
+     * @brief 请求工作线程在没有进行中的传输后关闭缓存的连接，名额异步归还
+     * @return 始终返回false
+     */
+    bool closeIdleConnection() override;
+
+private:
+    /**
+     * @brief 工作线程及其multi句柄，成员仅在该线程中访问
+     */
+    struct Worker {
+        CURLM* multi;                   ///< 其他线程唤醒时须持有multiMutex
+        std::mutex multiMutex;          ///< 保护替换multi句柄与其他线程的唤醒
+        std::thread thread;
+        size_t appliedMaxConnects;      ///< 已设置到multi句柄的连接缓存上限
+        std::map<CURL*, Job> active;    ///< 进行中的任务
+        std::vector<CURL*> freeHandles; ///< 可复用的空闲句柄
+        bool waitingForConnection;      ///< 有任务因主机连接数上限而等待
+        std::map<CURL*, curl_off_t> transferred;   ///< 进行中的任务上次统计时已传输的字节数
+        std::set<CURL*> paused;         ///< 已暂停的传输
+        std::set<CURL*> large;          ///< 占用大文件名额的传输
+        unsigned appliedControlGeneration;  ///< 已处理到的控制修改次数
+        size_t permits;                 ///< 占用的主机连接名额，不少于进行中的传输和缓存的连接数
+        unsigned appliedReclaimGeneration;  ///< 已处理到的关闭连接请求次数
+    };
+
+    /**
+     * @brief 等待队列的排序键，紧急任务最先，其次优先级高的，再按策略排序，最后按提交顺序
+     */
+    struct QueueKey {
+        bool urgent;
+        int priority;
+        curl_off_t order;           ///< 由任务大小和排序策略得到，入队时计算
+        uint64_t sequence;          ///< 提交序号
+
+        bool operator<(const QueueKey& other) const;
+    };
+
+    /**
+     * @brief 等待中的任务
+     */
+    struct Queued {
+        Job job;
+        std::chrono::steady_clock::time_point since;    ///< 入队时间，恢复暂停时重新计时
+    };
+
+    typedef std::map<QueueKey, Queued> Queue;
+
+    /**
+     * @brief 按当前的排序策略和小文件通道设置将任务放入队列，调用时须持有mutex_
+     */
+    void enqueue(QueueKey key, Queued queued);
+
+    /**
+     * @brief 选择下一个任务所在的队列，大文件名额已满时只选小文件队列，调用时须持有mutex_
+     * @return 没有可以开始的任务时返回NULL
+     */
+    Queue* selectQueue();
+
+    /**
+     * @brief 将已到期的延迟任务放入等待队列，调用时须持有mutex_
+     */
+    void releaseDelayed();
+
+    /**
+     * @brief 按新的设置重新排列所有等待中的任务，调用时须持有mutex_
+     */
+    void requeueAll();
+
+    /**
+     * @brief 归还一个传输占用的并发名额，主机连接名额由工作线程保留到连接关闭
+     * @param large 是否占用了大文件名额
+     */
+    void releaseSlot(bool large);
+
+    /**
+     * @brief 按并发上限补足工作线程，只增不减，最多workerLimit_个
+     * @param maxConcurrent 并发上限
+     */
+    void ensureWorkers(size_t maxConcurrent);
+
+    /**
+     * @brief 工作线程主循环
+     */
+    void run(Worker* worker);
+
+    /**
+     * @brief 在并发上限和主机连接数上限内从等待队列取出任务加入multi句柄
+     */
+    void activatePending(Worker* worker);
+
+    /**
+     * @brief 执行Control的修改：结束已取消的任务，暂停或恢复传输，暂停的等待任务移出队列
+     */
+    void applyControls(Worker* worker);
+
+    /**
+     * @brief 处理已结束的传输
+     */
+    void collectFinished(Worker* worker);
+
+    /**
+     * @brief 统计进行中的传输自上次统计以来传输的字节数
+     */
+    void measure(Worker* worker);
+
+    /**
+     * @brief 统计一个传输最后传输的字节数并移除其统计记录
+     */
+    void measureFinished(Worker* worker, CURL* curl);
+
+    /**
+     * @brief 每个测量周期由控制器计算一次新的并发上限，可在任意工作线程中调用
+     */
+    void adjustConcurrency();
+
+    /**
+     * @brief 判断传输是否因服务器拒绝（421/530）或无法连接而失败
+     */
+    static bool isRefusal(CURL* curl, CURLcode result);
+
+    /**
+     * @brief 换用新的multi句柄以关闭缓存的连接，并归还工作线程占用的全部主机连接名额，须在没有进行中的传输时调用
+     */
+    void closeCachedConnections(Worker* worker);
+
+    /**
+     * @brief 中止所有等待中和进行中的任务
+     */
+    void abortAll(Worker* worker);
+
+    CURL* takeHandle(Worker* worker);
+    void recycleHandle(Worker* worker, CURL* curl);
+    void wakeAll();
+    void wakeOthers(Worker* self);
+
+private:
+    std::shared_ptr<FTPConnectionPool> pool_;
+    std::shared_ptr<FTPTrafficControl::Host> trafficHost_;    ///< 主机连接数限制，与其他FTPClient共享
+    std::vector<std::unique_ptr<Worker>> workers_;     ///< 预留workerLimit_个位置，增加工作线程时不重新分配
+    std::mutex workersMutex_;           ///< 串行化工作线程的增加
+    std::atomic<size_t> workerCount_;   ///< 已启动的工作线程数，其他线程只访问workers_的前workerCount_个
+    size_t workerLimit_;                ///< 工作线程数上限
+
+    std::mutex mutex_;
+    Queue smallQueue_;                  ///< 走小文件通道的等待任务，包括紧急任务
+    Queue largeQueue_;                  ///< 其他等待任务
+    std::vector<std::pair<QueueKey, Queued>> held_; ///< 暂停的等待任务，恢复后按原来的排序键放回队列
+    std::multimap<std::chrono::steady_clock::time_point, Job> delayed_;    ///< 延迟提交的任务，按到期时间排序
+    uint64_t nextSequence_;
+    Policy policy_;
+    curl_off_t smallFileLimit_;         ///< 小文件大小上限，为负数时不区分
+    size_t reservedSlots_;              ///< 为小文件保留的传输位置数
+    size_t started_;                    ///< 已开始的任务数
+    double totalWaitSeconds_;           ///< 已开始的任务的排队总时间
+    double maxWaitSeconds_;             ///< 最长排队时间
+    bool stopping_;
+    std::atomic<size_t> maxConcurrent_; ///< 并发上限
+    std::atomic<size_t> activeCount_;   ///< 所有工作线程中进行中的传输数量
+    std::atomic<size_t> activeLarge_;   ///< 占用大文件名额的传输数量
+    std::atomic<unsigned> controlGeneration_;   ///< Control的修改次数，工作线程据此判断是否需要处理
+    std::atomic<unsigned> reclaimGeneration_;   ///< 其他调用方请求关闭空闲连接的次数
+
+    std::mutex controllerMutex_;
+    std::unique_ptr<FTPConcurrencyController> controller_;     ///< 自适应并发控制器，未开启时为空
+    std::chrono::steady_clock::time_point lastAdjustment_;     ///< 上一个测量周期的结束时间
+    std::atomic<curl_off_t> bytesMoved_;    ///< 本周期传输的字节数
+    std::atomic<size_t> refusals_;          ///< 本周期被拒绝的次数
+    std::atomic<bool> saturated_;           ///< 本周期是否有任务因并发上限而等待
+};
+
+#endif  // FTPTRANSFERENGINE_H
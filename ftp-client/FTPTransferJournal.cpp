@@ -0,0 +1,248 @@
+#include "FTPTransferJournal.h"
+
+#include <iostream>
+#include <cstdio>
+
+namespace {
+
+/**
+ * @brief 按\t拆分一行
+ */
+std::vector<std::string> splitFields(const std::string& line)
+{
+    std::vector<std::string> fields;
+    size_t begin = 0;
+    while (true) {
+        size_t end = line.find('\t', begin);
+        fields.push_back(line.substr(begin, end == std::string::npos ? std::string::npos : end - begin));
+        if (end == std::string::npos) {
+            break;
+        }
+        begin = end + 1;
+    }
+    return fields;
+}
+
+}  // namespace
+
+FTPTransferJournal::FTPTransferJournal(const std::string& journalPath)
+    : journalPath_(journalPath),
+      completed_(0)
+{
+}
+
+FTPTransferJournal::~FTPTransferJournal()
+{
+    log_.close();
+}
+
+bool FTPTransferJournal::recordable(const std::string& text)
+{
+    return text.find('\t') == std::string::npos && text.find('\n') == std::string::npos;
+}
+
+bool FTPTransferJournal::begin(const std::string& remoteRoot, const std::string& localRoot, const std::vector<std::string>& filterKeywords)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    remoteRoot_ = remoteRoot;
+    localRoot_ = localRoot;
+    filterKeywords_.clear();
+    directories_.clear();
+    listed_.clear();
+    files_.clear();
+    completed_ = 0;
+
+    log_.close();
+    log_.clear();
+    log_.open(journalPath_, std::ios::out | std::ios::trunc | std::ios::binary);
+    if (!log_.is_open() || !recordable(remoteRoot) || !recordable(localRoot)) {
+        std::cerr << "Failed to create transfer journal: " << journalPath_ << std::endl;
+        log_.close();
+        return false;
+    }
+
+    append("H\t" + remoteRoot + "\t" + localRoot);
+    for (const std::string& keyword : filterKeywords) {
+        if (recordable(keyword)) {
+            filterKeywords_.push_back(keyword);
+            append("K\t" + keyword);
+        }
+    }
+    return log_.good();
+}
+
+bool FTPTransferJournal::load()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::ifstream file(journalPath_, std::ios::in | std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to open transfer journal: " << journalPath_ << std::endl;
+        return false;
+    }
+
+    bool started = false;
+    std::string line;
+    while (std::getline(file, line)) {
+        // 写入中途崩溃留下的不完整行在解析时被忽略
+        std::vector<std::string> fields = splitFields(line);
+        const std::string& type = fields[0];
+        if (type == "H" && fields.size() == 3) {
+            remoteRoot_ = fields[1];
+            localRoot_ = fields[2];
+            started = true;
+        } else if (type == "K" && fields.size() == 2) {
+            filterKeywords_.push_back(fields[1]);
+        } else if (type == "D" && fields.size() == 2) {
+            directories_.insert(fields[1]);
+        } else if (type == "L" && fields.size() == 2) {
+            listed_.insert(fields[1]);
+        } else if (type == "F" && fields.size() == 5) {
+            Entry entry;
+            try {
+                entry.size = std::stoll(fields[1]);
+                entry.modifyTime = (time_t)std::stoll(fields[2]);
+            } catch (const std::exception&) {
+                continue;
+            }
+            entry.localPath = fields[4];
+            entry.offset = 0;
+            entry.completed = false;
+            files_.insert(std::make_pair(fields[3], entry));
+        } else if (type == "C" && fields.size() == 2) {
+            auto it = files_.find(fields[1]);
+            if (it != files_.end() && !it->second.completed) {
+                it->second.completed = true;
+                ++completed_;
+            }
+        } else if (type == "X" && fields.size() == 3) {
+            auto it = files_.find(fields[1]);
+            if (it != files_.end()) {
+                try {
+                    it->second.offset = std::stoll(fields[2]);
+                } catch (const std::exception&) {
+                }
+            }
+        }
+    }
+    file.close();
+
+    if (!started) {
+        std::cerr << "Invalid transfer journal: " << journalPath_ << std::endl;
+        return false;
+    }
+
+    // 最后一行可能不完整，先换行再追加，不完整的行在下次载入时被忽略
+    log_.close();
+    log_.clear();
+    log_.open(journalPath_, std::ios::out | std::ios::app | std::ios::binary);
+    if (!log_.is_open()) {
+        std::cerr << "Failed to open transfer journal: " << journalPath_ << std::endl;
+        return false;
+    }
+    log_ << '\n';
+    log_.flush();
+    return true;
+}
+
+std::vector<std::string> FTPTransferJournal::pendingDirectories()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<std::string> directories;
+    for (const std::string& directory : directories_) {
+        if (listed_.count(directory) == 0) {
+            directories.push_back(directory);
+        }
+    }
+    return directories;
+}
+
+std::vector<FTPTransferJournal::File> FTPTransferJournal::pendingFiles()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<File> files;
+    for (const auto& item : files_) {
+        if (!item.second.completed) {
+            files.push_back(File{item.first, item.second.localPath, item.second.size, item.second.modifyTime, item.second.offset});
+        }
+    }
+    return files;
+}
+
+void FTPTransferJournal::directoryQueued(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (recordable(path) && directories_.insert(path).second) {
+        append("D\t" + path);
+    }
+}
+
+void FTPTransferJournal::directoryListed(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (recordable(path) && listed_.insert(path).second) {
+        append("L\t" + path);
+    }
+}
+
+bool FTPTransferJournal::fileQueued(const File& file)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto result = files_.insert(std::make_pair(file.remotePath, Entry{file.localPath, file.size, file.modifyTime, 0, false}));
+    if (!result.second) {
+        return false;
+    }
+    // 无法记录的文件照常下载，恢复时由重新列出其所在目录得到
+    if (recordable(file.remotePath) && recordable(file.localPath)) {
+        append("F\t" + std::to_string(file.size) + "\t" + std::to_string((long long)file.modifyTime) + "\t" +
+               file.remotePath + "\t" + file.localPath);
+    }
+    return true;
+}
+
+void FTPTransferJournal::fileCompleted(const std::string& remotePath)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = files_.find(remotePath);
+    if (it == files_.end() || it->second.completed) {
+        return;
+    }
+    it->second.completed = true;
+    ++completed_;
+    if (recordable(remotePath)) {
+        append("C\t" + remotePath);
+    }
+}
+
+void FTPTransferJournal::fileFailed(const std::string& remotePath, curl_off_t offset)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = files_.find(remotePath);
+    if (it == files_.end()) {
+        return;
+    }
+    it->second.offset = offset;
+    if (recordable(remotePath)) {
+        append("X\t" + remotePath + "\t" + std::to_string(offset));
+    }
+}
+
+bool FTPTransferJournal::finish()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (completed_ < files_.size() || listed_.size() < directories_.size()) {
+        log_.flush();
+        return false;
+    }
+    log_.close();
+    std::remove(journalPath_.c_str());
+    return true;
+}
+
+void FTPTransferJournal::append(const std::string& line)
+{
+    if (!log_.is_open()) {
+        return;
+    }
+    log_ << line << '\n';
+    log_.flush();
+}
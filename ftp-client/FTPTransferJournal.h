@@ -0,0 +1,155 @@
+#ifndef FTPTRANSFERJOURNAL_H
+#define FTPTRANSFERJOURNAL_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+
+#include <curl/curl.h>
+
+/**
+ * @brief 文件夹传输日志
+ *
+ * 记录一次文件夹下载中发现的目录、已列出的目录、排队的文件以及每个文件的结果，每个事件追加一行并立即写出，
+ * 进程崩溃后最多丢失正在写的一行。重新载入后可得到尚未列出的目录和尚未完成的文件，
+ * 从而只列出未列出的目录、只下载未完成的文件，不必重新列出整个目录树。
+ * 文件下载完成并改名为最终文件名后才记录完成，最后一条记录丢失时该文件会再次续传，远程文件未变化时不传输数据。
+ *
+ * 每行格式（以\t分隔）：
+ *   H 远程根路径 本地根路径      批次开始
+ *   K 关键词                    过滤关键词
+ *   D 目录                      发现的目录
+ *   L 目录                      已列出的目录，其中的文件已在此行之前记录
+ *   F 大小 修改时间 远程路径 本地路径   排队的文件
+ *   C 远程路径                  已完成的文件
+ *   X 远程路径 偏移量           失败的文件及临时文件中已有的字节数
+ */
+class FTPTransferJournal
+{
+public:
+    /**
+     * @brief 日志中的文件
+     */
+    struct File {
+        std::string remotePath;     // 远程文件路径
+        std::string localPath;      // 本地文件路径
+        curl_off_t size;            // 列表中的文件大小
+        time_t modifyTime;          // 列表中的修改时间，未知时为-1
+        curl_off_t offset;          // 上次失败时已下载的字节数，未失败过时为0
+    };
+
+    /**
+     * @brief 构造函数，不读写文件
+     * @param journalPath 日志文件路径
+     */
+    explicit FTPTransferJournal(const std::string& journalPath);
+
+    ~FTPTransferJournal();
+
+    FTPTransferJournal(const FTPTransferJournal&) = delete;
+    FTPTransferJournal& operator=(const FTPTransferJournal&) = delete;
+
+    /**
+     * @brief 开始新的批次，覆盖已有的日志文件
+     * @param remoteRoot 远程根路径
+     * @param localRoot 本地根路径
+     * @param filterKeywords 过滤关键词
+     * @return 成功创建日志文件返回true
+     */
+    bool begin(const std::string& remoteRoot, const std::string& localRoot, const std::vector<std::string>& filterKeywords);
+
+    /**
+     * @brief 载入已有的日志文件，之后的记录追加到该文件末尾
+     * @return 文件存在且格式正确返回true
+     */
+    bool load();
+
+    const std::string& remoteRoot() const { return remoteRoot_; }
+    const std::string& localRoot() const { return localRoot_; }
+    const std::vector<std::string>& filterKeywords() const { return filterKeywords_; }
+
+    /**
+     * @brief 已发现但尚未列出的目录
+     */
+    std::vector<std::string> pendingDirectories();
+
+    /**
+     * @brief 已排队但尚未完成的文件
+     */
+    std::vector<File> pendingFiles();
+
+    /**
+     * @brief 记录发现的目录
+     * @param path 目录路径，与遍历中使用的路径一致
+     */
+    void directoryQueued(const std::string& path);
+
+    /**
+     * @brief 记录目录已列出，须在记录其中的文件和子目录之后调用
+     * @param path 目录路径
+     */
+    void directoryListed(const std::string& path);
+
+    /**
+     * @brief 记录排队的文件
+     * @param file 文件
+     * @return 文件已在日志中时返回false，调用方不应再次下载
+     */
+    bool fileQueued(const File& file);
+
+    /**
+     * @brief 记录文件已完成
+     * @param remotePath 远程文件路径
+     */
+    void fileCompleted(const std::string& remotePath);
+
+    /**
+     * @brief 记录文件失败，重新载入后仍为未完成
+     * @param remotePath 远程文件路径
+     * @param offset 临时文件中已有的字节数
+     */
+    void fileFailed(const std::string& remotePath, curl_off_t offset);
+
+    /**
+     * @brief 结束批次，所有目录已列出且所有文件已完成时删除日志文件
+     * @return 删除了日志文件返回true，仍有未完成的工作时返回false
+     */
+    bool finish();
+
+private:
+    struct Entry {
+        std::string localPath;
+        curl_off_t size;
+        time_t modifyTime;
+        curl_off_t offset;
+        bool completed;
+    };
+
+    /**
+     * @brief 追加一行并写出，调用方须持有mutex_
+     */
+    void append(const std::string& line);
+
+    /**
+     * @brief 路径中含有分隔符时无法记录
+     */
+    static bool recordable(const std::string& text);
+
+private:
+    std::string journalPath_;                       ///< 日志文件路径
+    std::string remoteRoot_;                        ///< 远程根路径
+    std::string localRoot_;                         ///< 本地根路径
+    std::vector<std::string> filterKeywords_;       ///< 过滤关键词
+
+    std::mutex mutex_;
+    std::ofstream log_;                             ///< 追加写入的日志文件
+    std::unordered_set<std::string> directories_;   ///< 发现的目录
+    std::unordered_set<std::string> listed_;        ///< 已列出的目录
+    std::unordered_map<std::string, Entry> files_;  ///< 远程路径到文件状态
+    size_t completed_;                              ///< 已完成的文件数
+};
+
+#endif  // FTPTRANSFERJOURNAL_H
@@ -0,0 +1,393 @@
+#include "FTPTransferMetrics.h"
+
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+namespace {
+
+// 耗时直方图第一个桶的上限（微秒），24个桶覆盖到约9分钟
+const uint64_t timeBase = 64;
+
+// 速率直方图第一个桶的上限（字节/秒），24个桶覆盖到8GiB/s
+const uint64_t speedBase = 1024;
+
+const double microsecondsPerSecond = 1000000.0;
+
+uint64_t nonNegative(curl_off_t value)
+{
+    return value > 0 ? (uint64_t)value : 0;
+}
+
+/**
+ * @brief 以较短的形式输出耗时，用于摘要
+ */
+std::string formatMicroseconds(double microseconds)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    if (microseconds >= microsecondsPerSecond) {
+        out << microseconds / microsecondsPerSecond << " s";
+    } else {
+        out << microseconds / 1000.0 << " ms";
+    }
+    return out.str();
+}
+
+/**
+ * @brief 以较短的形式输出字节数或速率，用于摘要
+ */
+std::string formatBytes(double bytes)
+{
+    const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    size_t unit = 0;
+    while (bytes >= 1024 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+        bytes /= 1024;
+        ++unit;
+    }
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(unit == 0 ? 0 : 1) << bytes << " " << units[unit];
+    return out.str();
+}
+
+}  // namespace
+
+double FTPTransferMetrics::Histogram::quantile(double q) const
+{
+    if (count == 0) {
+        return 0;
+    }
+
+    double rank = std::max(1.0, std::min(q, 1.0) * count);
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i <= BucketCount; ++i) {
+        if (buckets[i] == 0) {
+            continue;
+        }
+        if (cumulative + buckets[i] >= rank) {
+            double lower = i == 0 ? 0 : (double)(base << (i - 1));
+            double upper = i < BucketCount ? (double)(base << i) : (double)max;
+            if ((double)max >= lower && (double)max < upper) {
+                upper = (double)max;
+            }
+            return lower + (upper - lower) * (rank - cumulative) / buckets[i];
+        }
+        cumulative += buckets[i];
+    }
+    return (double)max;
+}
+
+FTPTransferMetrics::Snapshot FTPTransferMetrics::Snapshot::since(const Snapshot& baseline) const
+{
+    auto subtract = [](uint64_t now, uint64_t before) {
+        return now > before ? now - before : 0;
+    };
+    auto difference = [&subtract](const Histogram& now, const Histogram& before) {
+        Histogram histogram = now;
+        histogram.count = 0;
+        histogram.max = 0;
+        for (size_t i = 0; i <= BucketCount; ++i) {
+            histogram.buckets[i] = subtract(now.buckets[i], before.buckets[i]);
+            histogram.count += histogram.buckets[i];
+            if (histogram.buckets[i] > 0) {
+                // 无法得知这段时间内的最大值，取所在桶的上限
+                histogram.max = i < BucketCount ? std::min(now.max, now.base << i) : now.max;
+            }
+        }
+        histogram.sum = subtract(now.sum, before.sum);
+        return histogram;
+    };
+
+    Snapshot result;
+    for (size_t op = 0; op < OperationCount; ++op) {
+        result.transfers[op] = subtract(transfers[op], baseline.transfers[op]);
+        result.failures[op] = subtract(failures[op], baseline.failures[op]);
+        result.newConnections[op] = subtract(newConnections[op], baseline.newConnections[op]);
+        result.bytes[op] = subtract(bytes[op], baseline.bytes[op]);
+        for (size_t phase = 0; phase < PhaseCount; ++phase) {
+            result.phases[op][phase] = difference(phases[op][phase], baseline.phases[op][phase]);
+        }
+        result.speed[op] = difference(speed[op], baseline.speed[op]);
+    }
+    return result;
+}
+
+std::string FTPTransferMetrics::Snapshot::toPrometheus(const std::string& prefix) const
+{
+    std::ostringstream out;
+    out << std::setprecision(10);
+
+    struct Counter {
+        const char* name;
+        const char* help;
+        const uint64_t* values;
+    };
+    const Counter counters[] = {
+        {"_transfers_total", "Successful transfers by operation.", transfers},
+        {"_failures_total", "Failed transfers by operation.", failures},
+        {"_new_connections_total", "Successful transfers that opened a new control connection.", newConnections},
+        {"_transferred_bytes_total", "Bytes transferred by successful transfers.", bytes},
+    };
+    for (const Counter& counter : counters) {
+        out << "# HELP " << prefix << counter.name << " " << counter.help << "\n";
+        out << "# TYPE " << prefix << counter.name << " counter\n";
+        for (size_t op = 0; op < OperationCount; ++op) {
+            if (transfers[op] + failures[op] > 0) {
+                out << prefix << counter.name << "{operation=\"" << operationName((Operation)op) << "\"} " << counter.values[op] << "\n";
+            }
+        }
+    }
+
+    auto writeHistogram = [&out](const std::string& name, const std::string& labels, const Histogram& histogram, double scale) {
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i < BucketCount; ++i) {
+            cumulative += histogram.buckets[i];
+            out << name << "_bucket{" << labels << ",le=\"" << (double)(histogram.base << i) / scale << "\"} " << cumulative << "\n";
+        }
+        out << name << "_bucket{" << labels << ",le=\"+Inf\"} " << histogram.count << "\n";
+        out << name << "_sum{" << labels << "} " << (double)histogram.sum / scale << "\n";
+        out << name << "_count{" << labels << "} " << histogram.count << "\n";
+    };
+
+    std::string name = prefix + "_phase_seconds";
+    out << "# HELP " << name << " Time spent in each phase of a transfer.\n";
+    out << "# TYPE " << name << " histogram\n";
+    for (size_t op = 0; op < OperationCount; ++op) {
+        if (transfers[op] == 0) {
+            continue;
+        }
+        for (size_t phase = 0; phase < PhaseCount; ++phase) {
+            std::string labels = std::string("operation=\"") + operationName((Operation)op) + "\",phase=\"" + phaseName((Phase)phase) + "\"";
+            writeHistogram(name, labels, phases[op][phase], microsecondsPerSecond);
+        }
+    }
+
+    name = prefix + "_transfer_speed_bytes_per_second";
+    out << "# HELP " << name << " Average speed of each transfer.\n";
+    out << "# TYPE " << name << " histogram\n";
+    for (size_t op = 0; op < OperationCount; ++op) {
+        if (transfers[op] == 0) {
+            continue;
+        }
+        writeHistogram(name, std::string("operation=\"") + operationName((Operation)op) + "\"", speed[op], 1.0);
+    }
+
+    return out.str();
+}
+
+std::string FTPTransferMetrics::Snapshot::toJson() const
+{
+    std::ostringstream out;
+    out << std::fixed;
+
+    auto writeSummary = [&out](const Histogram& histogram, double scale, int precision) {
+        out << std::setprecision(precision)
+            << "{\"count\":" << histogram.count
+            << ",\"mean\":" << histogram.mean() / scale
+            << ",\"p50\":" << histogram.quantile(0.5) / scale
+            << ",\"p90\":" << histogram.quantile(0.9) / scale
+            << ",\"p99\":" << histogram.quantile(0.99) / scale
+            << ",\"max\":" << (double)histogram.max / scale << "}";
+    };
+
+    out << "{";
+    bool first = true;
+    for (size_t op = 0; op < OperationCount; ++op) {
+        if (transfers[op] + failures[op] == 0) {
+            continue;
+        }
+        out << (first ? "" : ",") << "\"" << operationName((Operation)op) << "\":{"
+            << "\"transfers\":" << transfers[op]
+            << ",\"failures\":" << failures[op]
+            << ",\"new_connections\":" << newConnections[op]
+            << ",\"bytes\":" << bytes[op]
+            << ",\"phases_seconds\":{";
+        for (size_t phase = 0; phase < PhaseCount; ++phase) {
+            out << (phase == 0 ? "" : ",") << "\"" << phaseName((Phase)phase) << "\":";
+            writeSummary(phases[op][phase], microsecondsPerSecond, 6);
+        }
+        out << "},\"speed_bytes_per_second\":";
+        writeSummary(speed[op], 1.0, 0);
+        out << "}";
+        first = false;
+    }
+    out << "}";
+    return out.str();
+}
+
+std::string FTPTransferMetrics::Snapshot::summary() const
+{
+    std::ostringstream out;
+    for (size_t op = 0; op < OperationCount; ++op) {
+        if (transfers[op] + failures[op] == 0) {
+            continue;
+        }
+        out << operationName((Operation)op) << ": " << transfers[op] << " ok, " << failures[op] << " failed, "
+            << newConnections[op] << " new connections, " << formatBytes((double)bytes[op]);
+        for (size_t phase = 0; phase < PhaseCount; ++phase) {
+            const Histogram& histogram = phases[op][phase];
+            if (histogram.count == 0) {
+                continue;
+            }
+            out << "; " << phaseName((Phase)phase) << " p50 " << formatMicroseconds(histogram.quantile(0.5))
+                << " p90 " << formatMicroseconds(histogram.quantile(0.9));
+        }
+        if (speed[op].count > 0) {
+            out << "; speed p50 " << formatBytes(speed[op].quantile(0.5)) << "/s";
+        }
+        out << "\n";
+    }
+    return out.str();
+}
+
+FTPTransferMetrics::AtomicHistogram::AtomicHistogram()
+    : base_(1),
+      sum_(0),
+      max_(0)
+{
+    for (std::atomic<uint64_t>& bucket : buckets_) {
+        bucket = 0;
+    }
+}
+
+void FTPTransferMetrics::AtomicHistogram::add(uint64_t value)
+{
+    size_t index = 0;
+    while (index < BucketCount && value > (base_ << index)) {
+        ++index;
+    }
+
+    // 各计数独立更新，快照中的计数和总和可能相差正在记录的一个样本
+    buckets_[index].fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+    uint64_t previous = max_.load(std::memory_order_relaxed);
+    while (value > previous && !max_.compare_exchange_weak(previous, value, std::memory_order_relaxed)) {
+    }
+}
+
+void FTPTransferMetrics::AtomicHistogram::load(Histogram& histogram) const
+{
+    histogram.base = base_;
+    histogram.count = 0;
+    for (size_t i = 0; i <= BucketCount; ++i) {
+        histogram.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        histogram.count += histogram.buckets[i];
+    }
+    histogram.sum = sum_.load(std::memory_order_relaxed);
+    histogram.max = max_.load(std::memory_order_relaxed);
+}
+
+FTPTransferMetrics::FTPTransferMetrics()
+{
+    for (size_t op = 0; op < OperationCount; ++op) {
+        transfers_[op] = 0;
+        failures_[op] = 0;
+        newConnections_[op] = 0;
+        bytes_[op] = 0;
+        for (size_t phase = 0; phase < PhaseCount; ++phase) {
+            phases_[op][phase].setBase(timeBase);
+        }
+        speed_[op].setBase(speedBase);
+    }
+}
+
+void FTPTransferMetrics::record(Operation operation, CURL* curl, CURLcode result)
+{
+    if (!curl || operation >= OperationCount) {
+        return;
+    }
+    if (result != CURLE_OK) {
+        failures_[operation].fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // 各时间点都从传输开始计时，单位为微秒
+    curl_off_t connect = 0;
+    curl_off_t pretransfer = 0;
+    curl_off_t startTransfer = 0;
+    curl_off_t total = 0;
+    curl_off_t downloaded = 0;
+    curl_off_t uploaded = 0;
+    curl_off_t speed = 0;
+    curl_off_t uploadSpeed = 0;
+    long connects = 0;
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &startTransfer);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &uploaded);
+    curl_easy_getinfo(curl, CURLINFO_SPEED_DOWNLOAD_T, &speed);
+    curl_easy_getinfo(curl, CURLINFO_SPEED_UPLOAD_T, &uploadSpeed);
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+
+    transfers_[operation].fetch_add(1, std::memory_order_relaxed);
+    bytes_[operation].fetch_add(nonNegative(downloaded) + nonNegative(uploaded), std::memory_order_relaxed);
+
+    // 数据连接也计入NUM_CONNECTS，扣除后仍有新连接说明控制连接是新建的
+    bool dataConnection = operation != Command;
+    bool newConnection = connects > (dataConnection ? 1 : 0);
+    if (newConnection) {
+        newConnections_[operation].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // FTP的CONNECT_TIME_T在数据连接建立时才记录，没有数据连接的命令则只到控制连接建立；
+    // 登录在PRETRANSFER_TIME_T之前完成
+    AtomicHistogram* phases = phases_[operation];
+    curl_off_t setup = dataConnection ? connect : pretransfer;
+    phases[newConnection ? Login : Negotiate].add(nonNegative(setup));
+    if (dataConnection) {
+        phases[Request].add(nonNegative(pretransfer - connect));
+    }
+    curl_off_t dataStart = pretransfer;
+    if (startTransfer > 0) {
+        phases[FirstByte].add(nonNegative(startTransfer - pretransfer));
+        dataStart = std::max(startTransfer, pretransfer);
+    }
+    phases[Transfer].add(nonNegative(total - dataStart));
+    phases[Total].add(nonNegative(total));
+
+    if (downloaded + uploaded > 0) {
+        speed_[operation].add(nonNegative(std::max(speed, uploadSpeed)));
+    }
+}
+
+FTPTransferMetrics::Snapshot FTPTransferMetrics::snapshot() const
+{
+    Snapshot snapshot;
+    for (size_t op = 0; op < OperationCount; ++op) {
+        snapshot.transfers[op] = transfers_[op].load(std::memory_order_relaxed);
+        snapshot.failures[op] = failures_[op].load(std::memory_order_relaxed);
+        snapshot.newConnections[op] = newConnections_[op].load(std::memory_order_relaxed);
+        snapshot.bytes[op] = bytes_[op].load(std::memory_order_relaxed);
+        for (size_t phase = 0; phase < PhaseCount; ++phase) {
+            phases_[op][phase].load(snapshot.phases[op][phase]);
+        }
+        speed_[op].load(snapshot.speed[op]);
+    }
+    return snapshot;
+}
+
+const char* FTPTransferMetrics::operationName(Operation operation)
+{
+    switch (operation) {
+    case Download: return "download";
+    case Upload: return "upload";
+    case Listing: return "listing";
+    case Command: return "command";
+    default: return "unknown";
+    }
+}
+
+const char* FTPTransferMetrics::phaseName(Phase phase)
+{
+    switch (phase) {
+    case Login: return "login";
+    case Negotiate: return "negotiate";
+    case Request: return "request";
+    case FirstByte: return "first_byte";
+    case Transfer: return "transfer";
+    case Total: return "total";
+    default: return "unknown";
+    }
+}
@@ -0,0 +1,147 @@
+#ifndef FTPTRANSFERMETRICS_H
+#define FTPTRANSFERMETRICS_H
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+#include <curl/curl.h>
+
+/**
+ * @brief 传输各阶段的耗时统计
+ *
+ * 每个结束的libcurl传输按操作类型记录一次：从句柄取得CURLINFO_CONNECT_TIME_T、PRETRANSFER_TIME_T、
+ * STARTTRANSFER_TIME_T、TOTAL_TIME_T和平均速率，拆分为登录/协商、传输命令、首字节和数据传输等阶段，
+ * 分别计入按2的幂分桶的直方图。记录只做原子加法，不加锁，可在任意传输线程中调用。
+ * FTP的CONNECT_TIME_T在数据连接建立后才记录，libcurl无法把TCP连接、登录和EPSV/PASV分开，
+ * 因此新建控制连接上的准备时间计入Login，复用连接上的计入Negotiate，两者中位数之差即为连接和登录的开销。
+ * 快照只复制计数；两个快照相减得到一段时间（如一个批次）内的统计，可导出为Prometheus文本格式或JSON。
+ */
+class FTPTransferMetrics
+{
+public:
+    enum Operation {
+        Download,       // 文件下载
+        Upload,         // 文件上传
+        Listing,        // 目录列表
+        Command,        // 只在控制连接上执行的命令，如SIZE/MDTM、HASH
+        OperationCount
+    };
+
+    enum Phase {
+        Login,          // 新建控制连接：TCP连接、登录、CWD、EPSV/PASV和建立数据连接；命令到准备发送为止
+        Negotiate,      // 复用控制连接：CWD、EPSV/PASV和建立数据连接；命令到准备发送为止
+        Request,        // 数据连接建立后的TYPE、SIZE、REST和传输命令，直到服务器回复150
+        FirstByte,      // 从服务器接受传输命令到收到第一个字节（上传时为开始发送）
+        Transfer,       // 数据传输直到收到完成回复；命令为命令本身的往返
+        Total,          // 整个传输，不含在传输引擎中排队的时间
+        PhaseCount
+    };
+
+    static const size_t BucketCount = 24;   ///< 有上限的桶数，另有一个溢出桶
+
+    /**
+     * @brief 直方图的一份拷贝，第i个桶的上限为 base<<i，最后一个桶没有上限
+     */
+    struct Histogram {
+        uint64_t base;                      // 第一个桶的上限：耗时为64微秒，速率为1024字节/秒
+        uint64_t buckets[BucketCount + 1];  // 各桶的计数，不累计
+        uint64_t count;                     // 样本数
+        uint64_t sum;                       // 样本之和
+        uint64_t max;                       // 最大样本，相减得到的直方图中为所在桶的上限
+
+        /**
+         * @brief 估计分位数，在所在桶内线性插值
+         * @param q 分位，0到1之间
+         * @return 样本单位的估计值，没有样本时为0
+         */
+        double quantile(double q) const;
+
+        double mean() const { return count > 0 ? (double)sum / count : 0; }
+    };
+
+    /**
+     * @brief 统计的拷贝，耗时以微秒、速率以字节/秒为单位
+     */
+    struct Snapshot {
+        uint64_t transfers[OperationCount];         // 成功的传输数
+        uint64_t failures[OperationCount];          // 失败的传输数，不计入直方图
+        uint64_t newConnections[OperationCount];    // 新建连接的传输数，其余复用已有连接
+        uint64_t bytes[OperationCount];             // 传输的字节数
+        Histogram phases[OperationCount][PhaseCount];
+        Histogram speed[OperationCount];            // 每个传输的平均速率
+
+        /**
+         * @brief 计算从baseline到本快照之间的统计
+         * @param baseline 较早的快照
+         */
+        Snapshot since(const Snapshot& baseline) const;
+
+        /**
+         * @brief 导出为Prometheus文本格式，只包含有记录的操作类型
+         * @param prefix 指标名前缀
+         */
+        std::string toPrometheus(const std::string& prefix = "ftpclient") const;
+
+        /**
+         * @brief 导出为JSON，耗时以秒为单位，给出每个阶段的样本数、平均值、P50/P90/P99和最大值
+         */
+        std::string toJson() const;
+
+        /**
+         * @brief 生成可读的摘要，每个有记录的操作类型一行，列出各阶段的中位数和P90
+         */
+        std::string summary() const;
+    };
+
+public:
+    FTPTransferMetrics();
+
+    FTPTransferMetrics(const FTPTransferMetrics&) = delete;
+    FTPTransferMetrics& operator=(const FTPTransferMetrics&) = delete;
+
+    /**
+     * @brief 记录一个结束的传输，须在句柄被重置或复用之前调用
+     * @param operation 操作类型
+     * @param curl 完成传输的句柄，为NULL时忽略
+     * @param result 传输结果，失败时只计数
+     */
+    void record(Operation operation, CURL* curl, CURLcode result);
+
+    /**
+     * @brief 复制当前的统计
+     */
+    Snapshot snapshot() const;
+
+    static const char* operationName(Operation operation);
+    static const char* phaseName(Phase phase);
+
+private:
+    /**
+     * @brief 原子计数的直方图
+     */
+    class AtomicHistogram
+    {
+    public:
+        AtomicHistogram();
+
+        void setBase(uint64_t base) { base_ = base; }
+        void add(uint64_t value);
+        void load(Histogram& histogram) const;
+
+    private:
+        uint64_t base_;
+        std::atomic<uint64_t> buckets_[BucketCount + 1];
+        std::atomic<uint64_t> sum_;
+        std::atomic<uint64_t> max_;
+    };
+
+    std::atomic<uint64_t> transfers_[OperationCount];
+    std::atomic<uint64_t> failures_[OperationCount];
+    std::atomic<uint64_t> newConnections_[OperationCount];
+    std::atomic<uint64_t> bytes_[OperationCount];
+    AtomicHistogram phases_[OperationCount][PhaseCount];
+    AtomicHistogram speed_[OperationCount];
+};
+
+#endif  // FTPTRANSFERMETRICS_H